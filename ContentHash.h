@@ -0,0 +1,104 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+
+/// <summary>
+/// 64-bit hash of the contents of plain data, used as the key of cached precomputation.
+/// The value only depends on the bytes added and their order, so it is the same across sessions and machines
+/// of the same endianness.
+/// </summary>
+class ContentHash
+{
+public:
+	ContentHash() = default;
+	~ContentHash() = default;
+
+	/// <summary>
+	/// Add raw bytes
+	/// </summary>
+	void Add(const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+		// 8 bytes at a time, and the rest one by one
+		size_t pos = 0;
+		for (; pos + sizeof(uint64_t) <= size; pos += sizeof(uint64_t))
+		{
+			uint64_t word;
+			std::memcpy(&word, bytes + pos, sizeof(uint64_t));
+			AddWord(word);
+		}
+
+		uint64_t tail = 0;
+		for (size_t shift = 0; pos < size; pos++, shift += 8)
+		{
+			tail |= static_cast<uint64_t>(bytes[pos]) << shift;
+		}
+		AddWord(tail ^ (static_cast<uint64_t>(size) << 56));
+	}
+
+	/// <summary>
+	/// Add a value of trivially copyable type
+	/// </summary>
+	template <typename T>
+	void AddValue(const T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "only plain data can be hashed");
+		Add(&value, sizeof(T));
+	}
+
+	/// <summary>
+	/// Add the # of elements and the elements of the array
+	/// </summary>
+	template <typename T>
+	void AddArray(const std::vector<T>& values)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "only plain data can be hashed");
+		AddValue(static_cast<uint64_t>(values.size()));
+		Add(values.data(), values.size() * sizeof(T));
+	}
+
+	uint64_t Value() const
+	{
+		return Mix(m_state);
+	}
+
+	/// <summary>
+	/// 16 hexadecimal digits of the hash value, e.g. for file names
+	/// </summary>
+	static std::string ToHex(uint64_t value)
+	{
+		static const char digits[] = "0123456789abcdef";
+		std::string hex(16, '0');
+		for (int i = 15; i >= 0; i--, value >>= 4)
+		{
+			hex[i] = digits[value & 0xf];
+		}
+		return hex;
+	}
+
+private:
+	uint64_t m_state = 0xcbf29ce484222325ull;
+
+	void AddWord(uint64_t word)
+	{
+		m_state = (m_state ^ Mix(word)) * 0x100000001b3ull;
+	}
+
+	/// <summary>
+	/// finalizer of splitmix64, so that every input bit affects every output bit
+	/// </summary>
+	static uint64_t Mix(uint64_t x)
+	{
+		x ^= x >> 30;
+		x *= 0xbf58476d1ce4e5b9ull;
+		x ^= x >> 27;
+		x *= 0x94d049bb133111ebull;
+		x ^= x >> 31;
+		return x;
+	}
+};
@@ -3,8 +3,23 @@
 #include <maya/MFnMatrixData.h>
 #include <maya/MFnEnumAttribute.h>
 #include <maya/MFnNumericAttribute.h>
+#include <maya/MFnTypedAttribute.h>
+#include <maya/MFnStringData.h>
+#include <maya/MEvaluationNode.h>
+#include <maya/MDGContext.h>
+#include <maya/MPlug.h>
+#include <maya/MPlugArray.h>
 #include <maya/MPoint.h>
+#include <maya/MGlobal.h>
+#include <maya/MFnMesh.h>
+#include <maya/MIntArray.h>
+#include "PrecomputeCache.h"
+#include "ContentHash.h"
 #include <vector>
+#include <algorithm>
+#include <string>
+#include <cstdlib>
+#include <cmath>
 
 
 const MTypeId CustomSkinCluster::id(0x00080031);
@@ -14,6 +29,20 @@ MObject CustomSkinCluster::doRecompute;
 MObject CustomSkinCluster::needRebindMesh;
 MObject CustomSkinCluster::smoothAmount;
 MObject CustomSkinCluster::smoothIteration;
+MObject CustomSkinCluster::smoothImplicit;
+MObject CustomSkinCluster::smoothMatrixFree;
+MObject CustomSkinCluster::smoothPruneThreshold;
+MObject CustomSkinCluster::smoothPruneRing;
+MObject CustomSkinCluster::smoothEigenpairs;
+MObject CustomSkinCluster::numThreads;
+MObject CustomSkinCluster::vectorize;
+MObject CustomSkinCluster::pruneWeightThreshold;
+MObject CustomSkinCluster::deltaMushFrame;
+MObject CustomSkinCluster::deltaMushChebyshevTolerance;
+MObject CustomSkinCluster::vertexOrder;
+MObject CustomSkinCluster::cacheDirectory;
+MObject CustomSkinCluster::warmStartRotations;
+MObject CustomSkinCluster::asyncPrecompute;
 
 MStatus CustomSkinCluster::deform(MDataBlock& block, MItGeometry& iter, const MMatrix& localToWorld, unsigned int multiIdx)
 {
@@ -32,115 +61,361 @@ MStatus CustomSkinCluster::deform(MDataBlock& block, MItGeometry& iter, const MM
 	MArrayDataHandle bindHandle = block.inputArrayValue(bindPreMatrix, &returnStat);
 	CHECK_MSTATUS(returnStat);
 
-	MArrayDataHandle weightListsHandle = block.inputArrayValue(weightList, &returnStat);
-	CHECK_MSTATUS(returnStat);
-	int numWeightLists = weightListsHandle.elementCount(); // = # of points
-	if (numWeightLists == 0)
+	// weights are read from the datablock only when weightList has been changed
+	const WeightTable& weightTable = UpdateWeightTable(block, iter.exactCount());
+	if (weightTable.NumEntries() == 0)
 	{
 		// if no weights, nothing to do
 		return MS::kSuccess;
 	}
 
+	// skinning matrices are computed once here, and the deformers only read the palette
+	CHECK_MSTATUS(m_palette.Build(transformsHandle, bindHandle, weightTable.NumJoints()));
+
 	const auto skinningMethod = static_cast<const SkinningType>(block.inputValue(customSkinningMethod).asShort());
 
-	// recompute if necessary
+	// recompute only if the inputs of the precomputation have been changed since the last one
 	const bool& doRecomputeVal = block.inputValue(doRecompute).asBool();
-	if (/*doRecomputeVal*/true)
+	const int numThreadsVal = block.inputValue(numThreads).asInt();
+	const bool isDDM = skinningMethod >= SkinningType::DDM;
+	if (isDDM || skinningMethod == SkinningType::DMLBS)
 	{
 		MFnDependencyNode thisNode(thisMObject());
 		MObject origGeom = thisNode.attribute("originalGeometry", &returnStat);
 		MObject originalGeomVal = block.inputArrayValue(origGeom, &returnStat).inputValue().asMesh();
+		UpdateGeometryFingerprint(originalGeomVal);
 
 		double smoothAmountVal = block.inputValue(smoothAmount).asDouble();
 		int smoothItrVal = block.inputValue(smoothIteration).asInt();
+		bool smoothImplicitVal = block.inputValue(smoothImplicit).asBool();
+		bool smoothMatrixFreeVal = block.inputValue(smoothMatrixFree).asBool();
+		double smoothPruneThresholdVal = block.inputValue(smoothPruneThreshold).asDouble();
+		int smoothPruneRingVal = block.inputValue(smoothPruneRing).asInt();
+		int smoothEigenpairsVal = block.inputValue(smoothEigenpairs).asInt();
+		const auto vertexOrderVal = static_cast<VertexOrder::Kind>(block.inputValue(vertexOrder).asShort());
+
+		InputFingerprint fingerprint;
+		fingerprint.Topology = m_topologyHash;
+		fingerprint.Points = m_pointsHash;
+
+		ContentHash smoothingHash;
+		smoothingHash.AddValue(smoothAmountVal);
+		smoothingHash.AddValue(smoothItrVal);
+		smoothingHash.AddValue(vertexOrderVal);
 
 		bool& needRebindMeshVal = block.inputValue(needRebindMesh).asBool();
-		if (doRecomputeVal && 
-			(skinningMethod == SkinningType::DDM
-				|| skinningMethod == SkinningType::DDM_v1
-				|| skinningMethod == SkinningType::DDM_v2
-				|| skinningMethod == SkinningType::DDM_v3
-				|| skinningMethod == SkinningType::DDM_v4
-				|| skinningMethod == SkinningType::DDM_v5))
+		if (isDDM)
 		{
-			m_ddmDeformer.SetSmoothingProperty({ smoothAmountVal, smoothItrVal, false });
-			m_ddmDeformer.Precompute(originalGeomVal, weightListsHandle, needRebindMeshVal);
+			smoothingHash.AddValue(smoothImplicitVal);
+			smoothingHash.AddValue(smoothMatrixFreeVal);
+			smoothingHash.AddValue(smoothPruneThresholdVal);
+			smoothingHash.AddValue(smoothPruneRingVal);
+			smoothingHash.AddValue(smoothEigenpairsVal);
+			fingerprint.Smoothing = smoothingHash.Value();
+			fingerprint.Weights = m_weightsHash;
+
+			// the current data is kept while doRecompute is off, unless there is none to deform with
+			if (!m_ddmDeformer.HasBindData() || (doRecomputeVal && (needRebindMeshVal || fingerprint != m_ddmFingerprint)))
+			{
+				std::string cacheDirectoryVal = block.inputValue(cacheDirectory).asString().asChar();
+				if (cacheDirectoryVal.empty())
+				{
+					const char* envVal = std::getenv(PrecomputeCache::DirectoryEnvVar);
+					cacheDirectoryVal = envVal ? envVal : "";
+				}
+
+				// the Laplacian only has to be rebuilt for a new topology
+				const bool needRebind = needRebindMeshVal || fingerprint.Topology != m_ddmFingerprint.Topology;
+
+				m_ddmDeformer.SetSmoothingProperty({ smoothAmountVal, smoothItrVal, smoothImplicitVal, smoothPruneThresholdVal, smoothPruneRingVal, smoothMatrixFreeVal, smoothEigenpairsVal });
+				m_ddmDeformer.SetCacheDirectory(cacheDirectoryVal);
+				m_ddmDeformer.SetVertexOrder(vertexOrderVal);
 
-			needRebindMeshVal = false;
+				// the precomputation blocks the evaluation only in batch mode, where nothing can redraw the result later
+				if (block.inputValue(asyncPrecompute).asBool() && MGlobal::mayaState() == MGlobal::kInteractive)
+				{
+					// the worker keeps the previous Psi matrices in use until it publishes the new ones, and then the node is evaluated again
+					const MString command = "dgdirty " + thisNode.name();
+					m_ddmDeformer.PrecomputeAsync(originalGeomVal, weightTable, needRebind, numThreadsVal,
+						[command]() { MGlobal::executeCommandOnIdle(command); });
+				}
+				else
+				{
+					m_ddmDeformer.Precompute(originalGeomVal, weightTable, needRebind, numThreadsVal);
+				}
+
+				m_ddmFingerprint = fingerprint;
+				needRebindMeshVal = false;
+			}
 		}
 		else if (skinningMethod == SkinningType::DMLBS)
 		{
-			m_dmDeformer.InitializeData(originalGeomVal, smoothItrVal, smoothAmountVal);
+			// Delta Mush does not depend on the weights
+			const auto deltaMushFrameVal = static_cast<DeformerDeltaMush::TangentFrame>(block.inputValue(deltaMushFrame).asShort());
+			const double chebyshevToleranceVal = block.inputValue(deltaMushChebyshevTolerance).asDouble();
+			smoothingHash.AddValue(deltaMushFrameVal);
+			smoothingHash.AddValue(chebyshevToleranceVal);
+			smoothingHash.AddValue(smoothImplicitVal);
+			fingerprint.Smoothing = smoothingHash.Value();
+
+			// the current data is kept while doRecompute is off, unless there is none to deform with
+			if (!m_dmDeformer.IsInitialized() || (doRecomputeVal && (needRebindMeshVal || fingerprint != m_dmFingerprint)))
+			{
+				m_dmDeformer.SetTangentFrame(deltaMushFrameVal);
+				m_dmDeformer.SetChebyshevTolerance(chebyshevToleranceVal);
+				m_dmDeformer.SetImplicit(smoothImplicitVal);
+				m_dmDeformer.SetVertexOrder(vertexOrderVal);
+				m_dmDeformer.InitializeData(originalGeomVal, smoothItrVal, smoothAmountVal);
+
+				const DeformerDeltaMush::SmoothingReport& report = m_dmDeformer.GetSmoothingReport();
+				if (report.IsImplicit)
+				{
+					MString msg = thisNode.name() + ": Delta Mush smoothing by an implicit step, factorization ";
+					msg += report.FactorizationTime * 1000.0;
+					msg += " ms, ";
+					msg += report.SmoothingTime * 1000.0;
+					msg += " ms per smoothing instead of ";
+					msg += report.PlainSmoothingTime * 1000.0;
+					msg += " ms for ";
+					msg += smoothItrVal;
+					msg += " passes, max deviation ";
+					msg += report.MaxDeviation;
+					msg += " of the bounding box at bind";
+					MGlobal::displayInfo(msg);
+				}
+				else if (report.NumPasses < static_cast<uint32_t>(smoothItrVal))
+				{
+					MString msg = thisNode.name() + ": Delta Mush smoothing in ";
+					msg += report.NumPasses;
+					msg += " passes instead of ";
+					msg += smoothItrVal;
+					msg += ", response error <= ";
+					msg += report.ResponseError;
+					msg += ", max deviation ";
+					msg += report.MaxDeviation;
+					msg += " of the bounding box at bind";
+					MGlobal::displayInfo(msg);
+				}
 
-			needRebindMeshVal = false;
+				m_dmFingerprint = fingerprint;
+				needRebindMeshVal = false;
+			}
 		}
 	}
 
 
 	const MMatrix worldToLocal = localToWorld.inverse();
 
-	// Iterate through each point in the geometry
-	for (iter.reset(), weightListsHandle.jumpToArrayElement(0); !iter.isDone(); iter.next())
-	{
-		MPoint pt = iter.position();
+	// read all the positions at once. The deformer covers the whole geometry, so the array index is the vertex index
+	MPointArray points;
+	CHECK_MSTATUS(iter.allPositions(points));
+	const bool vectorizeVal = block.inputValue(vectorize).asBool();
 
-		// get the weights for this point
-		MArrayDataHandle weightsHandle = weightListsHandle.inputValue(&returnStat).child(weights);
-		CHECK_MSTATUS(returnStat);
+	// DDM is not ready until the first precomputation for the current mesh and joints is published, and LBS is shown in the meantime
+	auto deformType = skinningMethod;
+	if (skinningMethod >= SkinningType::DDM && !m_ddmDeformer.UpdateBindData(points.length(), m_palette.NumJoints()))
+	{
+		deformType = SkinningType::LBS;
+	}
 
-		// compute the skinned position
-		MPoint skinned;
-		switch (skinningMethod)
+	// compute the skinned positions in parallel. Each vertex only depends on its own inputs, so the result is the same as the serial loop.
+	// The deformers run a kernel unrolled for the # of influences on each bucket of vertices
+	switch (deformType)
+	{
+	case SkinningType::LBS:
+	case SkinningType::DMLBS:
+		if (vectorizeVal)
+		{
+			// the float kernel rounds differently from the double path, so report which one is running
+			if (!m_hasReportedISA)
+			{
+				MString msg = name() + ": vectorized LBS in float with the ";
+				msg += LBSKernel::ISAName(m_lbsDeformer.ISA());
+				msg += " kernel";
+				MGlobal::displayInfo(msg);
+				m_hasReportedISA = true;
+			}
+			m_lbsDeformer.DeformVectorized(points, worldToLocal, m_palette, weightTable, numThreadsVal);
+		}
+		else
 		{
-		case SkinningType::LBS:
-		case SkinningType::DMLBS:
-			skinned = m_lbsDeformer.Deform(iter.index(), pt, worldToLocal, transformsHandle, bindHandle, weightsHandle, &returnStat);
-			break;
-		case SkinningType::DDM:
-			skinned = m_ddmDeformer.Deform(iter.index(), pt, worldToLocal, transformsHandle, bindHandle, weightsHandle, &returnStat);
-			break;
-		case SkinningType::DDM_v1:
-			skinned = m_ddmDeformer.Deform_v1(iter.index(), pt, worldToLocal, transformsHandle, bindHandle, weightsHandle, &returnStat);
-			break;
-		case SkinningType::DDM_v2:
-			skinned = m_ddmDeformer.Deform_v2(iter.index(), pt, worldToLocal, transformsHandle, bindHandle, weightsHandle, &returnStat);
-			break;
-		case SkinningType::DDM_v3:
-			skinned = m_ddmDeformer.Deform_v3(iter.index(), pt, worldToLocal, transformsHandle, bindHandle, weightsHandle, &returnStat);
-			break;
-		case SkinningType::DDM_v4:
-			skinned = m_ddmDeformer.Deform_v4(iter.index(), pt, worldToLocal, transformsHandle, bindHandle, weightsHandle, &returnStat);
-			break;
-		case SkinningType::DDM_v5:
-			skinned = m_ddmDeformer.Deform_v5(iter.index(), pt, worldToLocal, transformsHandle, bindHandle, weightsHandle, &returnStat);
-			break;
-		default:
-			break;
+			m_lbsDeformer.DeformPoints(points, worldToLocal, m_palette, weightTable, numThreadsVal);
 		}
-		CHECK_MSTATUS(returnStat);
-		CHECK_MSTATUS(iter.setPosition(skinned));
+		break;
+	case SkinningType::DDM:
+		{
+			// the rotations of the previous evaluation are a good initial guess only if the time has moved by at most a frame
+			const MTime time = block.context().getTime();
+			const bool isCoherent = m_hasLastDDMTime && std::abs((time - m_lastDDMTime).as(MTime::uiUnit())) <= 1.0;
+			m_ddmDeformer.SetWarmStart(block.inputValue(warmStartRotations).asBool());
+			if (!isCoherent)
+			{
+				m_ddmDeformer.ResetWarmStart();
+			}
+			m_lastDDMTime = time;
+			m_hasLastDDMTime = true;
 
-		// advance the weight list handle
-		CHECK_MSTATUS(weightListsHandle.next());
+			m_ddmDeformer.DeformPoints(DeformerDDM::Variant::v0, points, worldToLocal, m_palette, numThreadsVal);
+		}
+		break;
+	case SkinningType::DDM_v1:
+		m_ddmDeformer.DeformPoints(DeformerDDM::Variant::v1, points, worldToLocal, m_palette, numThreadsVal);
+		break;
+	case SkinningType::DDM_v2:
+		m_ddmDeformer.DeformPoints(DeformerDDM::Variant::v2, points, worldToLocal, m_palette, numThreadsVal);
+		break;
+	case SkinningType::DDM_v3:
+		m_ddmDeformer.DeformPoints(DeformerDDM::Variant::v3, points, worldToLocal, m_palette, numThreadsVal);
+		break;
+	case SkinningType::DDM_v4:
+		m_ddmDeformer.DeformPoints(DeformerDDM::Variant::v4, points, worldToLocal, m_palette, numThreadsVal);
+		break;
+	case SkinningType::DDM_v5:
+		m_ddmDeformer.DeformPoints(DeformerDDM::Variant::v5, points, worldToLocal, m_palette, numThreadsVal);
+		break;
+	default:
+		break;
 	}
 
 	if (skinningMethod == SkinningType::DMLBS)
 	{
-		// LBS ̌ʂ擾i擾 ObjectSpace ōĂ邩Hj
-		MPointArray skinnedPoints;
-		iter.allPositions(skinnedPoints, MSpace::Space::kObject);
-
 		// Delta Mush Kpʂ擾
 		MPointArray deformedPoints;
-		m_dmDeformer.ApplyDeltaMush(skinnedPoints, deformedPoints);
-
-		// Delta Mush ̌ʂݒiObjectSpace ōĂ邩Hj
-		iter.setAllPositions(deformedPoints);
+		m_dmDeformer.ApplyDeltaMush(points, deformedPoints, numThreadsVal);
+		points = deformedPoints;
 	}
 
+	// write all the positions back at once
+	CHECK_MSTATUS(iter.setAllPositions(points));
+
 	return returnStat;
 }
 
+MStatus CustomSkinCluster::setDependentsDirty(const MPlug& plug, MPlugArray& plugArray)
+{
+	// dirty propagation in DG evaluation
+	if (plug == weightList || plug == weights)
+	{
+		m_isWeightTableDirty = true;
+	}
+	if (plug == originalGeometry)
+	{
+		m_isGeometryFingerprintDirty = true;
+	}
+
+	return MPxSkinCluster::setDependentsDirty(plug, plugArray);
+}
+
+MStatus CustomSkinCluster::preEvaluation(const MDGContext& context, const MEvaluationNode& evaluationNode)
+{
+	// setDependentsDirty is not called under the Evaluation Manager, so query the dirty plugs here
+	MStatus status;
+	if (evaluationNode.dirtyPlugExists(weightList, &status) || evaluationNode.dirtyPlugExists(weights, &status))
+	{
+		m_isWeightTableDirty = true;
+	}
+	if (evaluationNode.dirtyPlugExists(originalGeometry, &status))
+	{
+		m_isGeometryFingerprintDirty = true;
+	}
+
+	return MPxSkinCluster::preEvaluation(context, evaluationNode);
+}
+
+const WeightTable& CustomSkinCluster::UpdateWeightTable(MDataBlock& block, unsigned int numVertices, bool forceRebuild)
+{
+	// maxInfluences and maintainMaxInfluences are the attributes of skinCluster, which are only used by the weight tools otherwise
+	MFnDependencyNode thisNode(thisMObject());
+	WeightTable::Conditioning conditioning;
+	if (block.inputValue(thisNode.attribute("maintainMaxInfluences")).asBool())
+	{
+		conditioning.MaxInfluences = std::max(block.inputValue(thisNode.attribute("maxInfluences")).asInt(), 0);
+	}
+	conditioning.MinWeight = block.inputValue(pruneWeightThreshold).asDouble();
+
+	if (forceRebuild || m_isWeightTableDirty || m_weightTable.NumVertices() != numVertices || conditioning != m_weightConditioning)
+	{
+		MStatus status;
+		MArrayDataHandle weightListsHandle = block.inputArrayValue(weightList, &status);
+		CHECK_MSTATUS(status);
+		CHECK_MSTATUS(m_weightTable.Build(weightListsHandle, numVertices));
+
+		// drop the influences every deformer would spend time on for little effect
+		WeightTable::ConditioningStats stats;
+		m_weightTable.Condition(conditioning, &stats);
+		if (stats.NumDroppedEntries != m_weightStats.NumDroppedEntries || stats.NumEntriesBefore != m_weightStats.NumEntriesBefore)
+		{
+			if (stats.NumDroppedEntries > 0)
+			{
+				// the deformation costs are linear in the # of entries
+				MString msg = thisNode.name() + ": dropped ";
+				msg += stats.NumDroppedEntries;
+				msg += " of ";
+				msg += stats.NumEntriesBefore;
+				msg += " influences (max per vertex ";
+				msg += stats.MaxInfluencesBefore;
+				msg += " -> ";
+				msg += m_weightTable.MaxInfluences();
+				msg += ", max dropped weight ";
+				msg += stats.MaxDroppedWeight;
+				msg += "), about ";
+				msg += static_cast<double>(stats.NumEntriesBefore) / std::max(m_weightTable.NumEntries(), 1u);
+				msg += "x throughput";
+				MGlobal::displayInfo(msg);
+			}
+			m_weightStats = stats;
+		}
+		m_weightConditioning = conditioning;
+
+		// the weightList plug is also dirtied by edits which leave the weights as they are, e.g. reconnections
+		ContentHash hash;
+		m_weightTable.AddToHash(hash);
+		m_weightsHash = hash.Value();
+
+		m_isWeightTableDirty = false;
+	}
+
+	return m_weightTable;
+}
+
+void CustomSkinCluster::UpdateGeometryFingerprint(MObject& mesh)
+{
+	if (!m_isGeometryFingerprintDirty)
+	{
+		return;
+	}
+
+	MFnMesh meshFn(mesh);
+
+	ContentHash topologyHash;
+	MIntArray polyCounts, polyConnects;
+	meshFn.getVertices(polyCounts, polyConnects);
+	topologyHash.AddValue(meshFn.numVertices());
+	topologyHash.AddValue(polyCounts.length());
+	for (unsigned int i = 0; i < polyCounts.length(); i++)
+	{
+		topologyHash.AddValue(polyCounts[i]);
+	}
+	for (unsigned int i = 0; i < polyConnects.length(); i++)
+	{
+		topologyHash.AddValue(polyConnects[i]);
+	}
+	m_topologyHash = topologyHash.Value();
+
+	ContentHash pointsHash;
+	MPointArray points;
+	meshFn.getPoints(points, MSpace::kObject);
+	for (unsigned int i = 0; i < points.length(); i++)
+	{
+		pointsHash.AddValue(points[i].x);
+		pointsHash.AddValue(points[i].y);
+		pointsHash.AddValue(points[i].z);
+	}
+	m_pointsHash = pointsHash.Value();
+
+	m_isGeometryFingerprintDirty = false;
+}
+
 MStatus CustomSkinCluster::initialize()
 {
 	MStatus returnStat;
@@ -160,6 +435,7 @@ MStatus CustomSkinCluster::initialize()
 	CHECK_MSTATUS(eAttr.addField("DDM_v5", static_cast<short>(SkinningType::DDM_v5)));
 	CHECK_MSTATUS(addAttribute(customSkinningMethod));
 
+	// the precomputation follows the changes of its inputs while doRecompute is on, and needRebindMesh forces it once
 	doRecompute = nAttr.create("doRecompute", "doRecompute", MFnNumericData::kBoolean, 1, &returnStat);
 	CHECK_MSTATUS(returnStat);
 	CHECK_MSTATUS(addAttribute(doRecompute));
@@ -179,11 +455,97 @@ MStatus CustomSkinCluster::initialize()
 	CHECK_MSTATUS(nAttr.setMin(0));
 	CHECK_MSTATUS(addAttribute(smoothIteration));
 
+	smoothImplicit = nAttr.create("smoothImplicit", "smImpl", MFnNumericData::kBoolean, 0, &returnStat);
+	CHECK_MSTATUS(returnStat);
+	CHECK_MSTATUS(addAttribute(smoothImplicit));
+
+	smoothMatrixFree = nAttr.create("smoothMatrixFree", "smMF", MFnNumericData::kBoolean, 0, &returnStat);
+	CHECK_MSTATUS(returnStat);
+	CHECK_MSTATUS(addAttribute(smoothMatrixFree));
+
+	smoothPruneThreshold = nAttr.create("smoothPruneThreshold", "smPrThr", MFnNumericData::kDouble, 0.0, &returnStat);
+	CHECK_MSTATUS(returnStat);
+	CHECK_MSTATUS(nAttr.setMin(0.0));
+	CHECK_MSTATUS(addAttribute(smoothPruneThreshold));
+
+	smoothPruneRing = nAttr.create("smoothPruneRing", "smPrRing", MFnNumericData::kInt, 0, &returnStat);
+	CHECK_MSTATUS(returnStat);
+	CHECK_MSTATUS(nAttr.setMin(0));
+	CHECK_MSTATUS(addAttribute(smoothPruneRing));
+
+	smoothEigenpairs = nAttr.create("smoothEigenpairs", "smEig", MFnNumericData::kInt, 0, &returnStat);
+	CHECK_MSTATUS(returnStat);
+	CHECK_MSTATUS(nAttr.setMin(0));
+	CHECK_MSTATUS(addAttribute(smoothEigenpairs));
+
+	numThreads = nAttr.create("numThreads", "nthr", MFnNumericData::kInt, 0, &returnStat);
+	CHECK_MSTATUS(returnStat);
+	CHECK_MSTATUS(nAttr.setMin(0));
+	CHECK_MSTATUS(addAttribute(numThreads));
+
+	vectorize = nAttr.create("vectorize", "vec", MFnNumericData::kBoolean, 0, &returnStat);
+	CHECK_MSTATUS(returnStat);
+	CHECK_MSTATUS(addAttribute(vectorize));
+
+	deltaMushFrame = eAttr.create("deltaMushFrame", "dmFrame", 0, &returnStat);
+	CHECK_MSTATUS(returnStat);
+	CHECK_MSTATUS(eAttr.addField("Per Neighbour", static_cast<short>(DeformerDeltaMush::TangentFrame::PerNeighbour)));
+	CHECK_MSTATUS(eAttr.addField("Single", static_cast<short>(DeformerDeltaMush::TangentFrame::Single)));
+	CHECK_MSTATUS(addAttribute(deltaMushFrame));
+
+	deltaMushChebyshevTolerance = nAttr.create("deltaMushChebyshevTolerance", "dmChebTol", MFnNumericData::kDouble, 0.0, &returnStat);
+	CHECK_MSTATUS(returnStat);
+	CHECK_MSTATUS(nAttr.setMin(0.0));
+	CHECK_MSTATUS(nAttr.setSoftMax(0.01));
+	CHECK_MSTATUS(addAttribute(deltaMushChebyshevTolerance));
+
+	vertexOrder = eAttr.create("vertexOrder", "vtxOrd", 0, &returnStat);
+	CHECK_MSTATUS(returnStat);
+	CHECK_MSTATUS(eAttr.addField("Original", static_cast<short>(VertexOrder::Kind::Original)));
+	CHECK_MSTATUS(eAttr.addField("Reverse Cuthill-McKee", static_cast<short>(VertexOrder::Kind::ReverseCuthillMcKee)));
+	CHECK_MSTATUS(eAttr.addField("Morton", static_cast<short>(VertexOrder::Kind::Morton)));
+	CHECK_MSTATUS(addAttribute(vertexOrder));
+
+	pruneWeightThreshold = nAttr.create("pruneWeightThreshold", "prWThr", MFnNumericData::kDouble, 0.0, &returnStat);
+	CHECK_MSTATUS(returnStat);
+	CHECK_MSTATUS(nAttr.setMin(0.0));
+	CHECK_MSTATUS(nAttr.setSoftMax(0.1));
+	CHECK_MSTATUS(addAttribute(pruneWeightThreshold));
+
+	MFnTypedAttribute tAttr;
+	MFnStringData strData;
+	cacheDirectory = tAttr.create("cacheDirectory", "cacheDir", MFnData::kString, strData.create(""), &returnStat);
+	CHECK_MSTATUS(returnStat);
+	CHECK_MSTATUS(tAttr.setUsedAsFilename(true));
+	CHECK_MSTATUS(addAttribute(cacheDirectory));
+
+	warmStartRotations = nAttr.create("warmStartRotations", "wsRot", MFnNumericData::kBoolean, 0, &returnStat);
+	CHECK_MSTATUS(returnStat);
+	CHECK_MSTATUS(addAttribute(warmStartRotations));
+
+	asyncPrecompute = nAttr.create("asyncPrecompute", "async", MFnNumericData::kBoolean, 1, &returnStat);
+	CHECK_MSTATUS(returnStat);
+	CHECK_MSTATUS(addAttribute(asyncPrecompute));
+
 	CHECK_MSTATUS(attributeAffects(customSkinningMethod, outputGeom));
 	CHECK_MSTATUS(attributeAffects(doRecompute, outputGeom));
 	CHECK_MSTATUS(attributeAffects(needRebindMesh, outputGeom));
 	CHECK_MSTATUS(attributeAffects(smoothAmount, outputGeom));
 	CHECK_MSTATUS(attributeAffects(smoothIteration, outputGeom));
+	CHECK_MSTATUS(attributeAffects(smoothImplicit, outputGeom));
+	CHECK_MSTATUS(attributeAffects(smoothMatrixFree, outputGeom));
+	CHECK_MSTATUS(attributeAffects(smoothPruneThreshold, outputGeom));
+	CHECK_MSTATUS(attributeAffects(smoothPruneRing, outputGeom));
+	CHECK_MSTATUS(attributeAffects(smoothEigenpairs, outputGeom));
+	CHECK_MSTATUS(attributeAffects(numThreads, outputGeom));
+	CHECK_MSTATUS(attributeAffects(vectorize, outputGeom));
+	CHECK_MSTATUS(attributeAffects(pruneWeightThreshold, outputGeom));
+	CHECK_MSTATUS(attributeAffects(deltaMushFrame, outputGeom));
+	CHECK_MSTATUS(attributeAffects(deltaMushChebyshevTolerance, outputGeom));
+	CHECK_MSTATUS(attributeAffects(vertexOrder, outputGeom));
+	CHECK_MSTATUS(attributeAffects(cacheDirectory, outputGeom));
+	CHECK_MSTATUS(attributeAffects(warmStartRotations, outputGeom));
+	CHECK_MSTATUS(attributeAffects(asyncPrecompute, outputGeom));
 
 	return MStatus::kSuccess;
 }
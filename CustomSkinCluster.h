@@ -3,14 +3,18 @@
 #include "DeformerLBS.h"
 #include "DeformerDDM.h"
 #include "DeformerDeltaMush.h"
+#include "WeightTable.h"
 #include <maya/MPxSkinCluster.h>
 #include <maya/MDataBlock.h>
 #include <maya/MItGeometry.h>
+#include <maya/MTime.h>
 
 class CustomSkinCluster : public MPxSkinCluster
 {
 public:
 	MStatus deform(MDataBlock& block, MItGeometry& iter, const MMatrix& mat, unsigned int multiIdx) override;
+	MStatus setDependentsDirty(const MPlug& plug, MPlugArray& plugArray) override;
+	MStatus preEvaluation(const MDGContext& context, const MEvaluationNode& evaluationNode) override;
 	static MStatus initialize();
 	static void* creator()
 	{
@@ -34,13 +38,171 @@ public:
 	};
 
 	static MObject customSkinningMethod;
+	/// <summary>
+	/// recompute the DDM and Delta Mush data when their inputs change. Off keeps the current data
+	/// </summary>
 	static MObject doRecompute;
+
+	/// <summary>
+	/// force the next evaluation to rebuild the data from scratch, which is reset after that.
+	/// Changes of the topology are detected without this
+	/// </summary>
 	static MObject needRebindMesh;
 	static MObject smoothAmount;
 	static MObject smoothIteration;
 
+	/// <summary>
+	/// smooth DDM implicitly, B = (I + smoothAmount * L)^-smoothItr, instead of B = (I - smoothAmount * L)^smoothItr.
+	/// Delta Mush is smoothed by a single implicit step with lambda = smoothAmount * smoothItr (see DeformerDeltaMush::SetImplicit)
+	/// </summary>
+	static MObject smoothImplicit;
+
+	/// <summary>
+	/// precompute DDM by diffusing the moment fields of each joint instead of building the explicit smoothing matrix,
+	/// which keeps the memory linear in the # of vertices for high smoothItr. The pruning attributes are ignored
+	/// </summary>
+	static MObject smoothMatrixFree;
+
+	/// <summary>
+	/// magnitude below which the entries of the DDM smoothing matrix are dropped (0 keeps all the entries)
+	/// </summary>
+	static MObject smoothPruneThreshold;
+
+	/// <summary>
+	/// max ring distance of the entries of the DDM smoothing matrix (0 means no limit)
+	/// </summary>
+	static MObject smoothPruneRing;
+
+	/// <summary>
+	/// smooth DDM with the lowest this many eigenpairs of the Laplacian, which are kept in cacheDirectory per topology (0 disables it).
+	/// The precomputation is then linear in the # of vertices for any smoothItr, and smoothMatrixFree and the pruning attributes are ignored
+	/// </summary>
+	static MObject smoothEigenpairs;
+
+	/// <summary>
+	/// # of threads for the CPU deformation (0 means all the available threads)
+	/// </summary>
+	static MObject numThreads;
+
+	/// <summary>
+	/// use the vectorized float kernel (AVX2/AVX-512 if available) for LBS. Off by default, since the positions are
+	/// computed in float and differ from the double path by its rounding error
+	/// </summary>
+	static MObject vectorize;
+
+	/// <summary>
+	/// weights below this are dropped at bind, and the rest are renormalized. The influences are also limited to maxInfluences
+	/// if maintainMaxInfluences is on, which is applied on the next evaluation
+	/// </summary>
+	static MObject pruneWeightThreshold;
+
+	/// <summary>
+	/// frames of the Delta Mush deltas (see DeformerDeltaMush::TangentFrame)
+	/// </summary>
+	static MObject deltaMushFrame;
+
+	/// <summary>
+	/// smooth Delta Mush with the Chebyshev expansion of the smoothItr passes, truncated where its frequency response differs
+	/// by at most this (0 keeps the plain passes)
+	/// </summary>
+	static MObject deltaMushChebyshevTolerance;
+
+	/// <summary>
+	/// order of the vertices DDM and Delta Mush run in, computed at bind so that the neighbours of a vertex are close in memory
+	/// (see VertexOrder::Kind). Only the input and output points are remapped, and the result does not depend on it
+	/// </summary>
+	static MObject vertexOrder;
+
+	/// <summary>
+	/// directory of the DDM precomputation cache. If empty, the environment variable CUSTOM_SKIN_CLUSTER_CACHE_DIR is used,
+	/// and the cache is disabled if both are empty
+	/// </summary>
+	static MObject cacheDirectory;
+
+	/// <summary>
+	/// start the rotation fit of DDM from the rotations of the previous evaluation, which is faster in playback.
+	/// The previous rotations are discarded when the time jumps by more than a frame
+	/// </summary>
+	static MObject warmStartRotations;
+
+	/// <summary>
+	/// run the DDM precomputation on a worker thread in interactive sessions, deforming with the previous result
+	/// (or LBS if there is none) until it completes
+	/// </summary>
+	static MObject asyncPrecompute;
+
+	/// <summary>
+	/// Return the weight table, rebuilding it from the weightList attribute only if it has been changed
+	/// </summary>
+	/// <param name="block"></param>
+	/// <param name="numVertices"># of vertices in the deformed geometry</param>
+	/// <param name="forceRebuild">rebuild even if weightList is not marked as dirty</param>
+	/// <returns></returns>
+	const WeightTable& UpdateWeightTable(MDataBlock& block, unsigned int numVertices, bool forceRebuild = false);
+
 private:
+	/// <summary>
+	/// Content hashes of the inputs a precomputation was made from
+	/// </summary>
+	struct InputFingerprint
+	{
+		uint64_t Topology = 0;
+		uint64_t Points = 0;
+		uint64_t Weights = 0;
+		uint64_t Smoothing = 0;
+
+		bool operator==(const InputFingerprint& other) const
+		{
+			return Topology == other.Topology && Points == other.Points && Weights == other.Weights && Smoothing == other.Smoothing;
+		}
+		bool operator!=(const InputFingerprint& other) const
+		{
+			return !(*this == other);
+		}
+	};
+
+	/// <summary>
+	/// Rehash the topology and the points of originalGeometry if it has been marked as dirty
+	/// </summary>
+	void UpdateGeometryFingerprint(MObject& mesh);
+
+	JointPalette m_palette;
+
+	WeightTable m_weightTable;
+	bool m_isWeightTableDirty = true;
+
+	/// <summary>
+	/// pruning of the current weight table, and its result for the report
+	/// </summary>
+	WeightTable::Conditioning m_weightConditioning;
+	WeightTable::ConditioningStats m_weightStats;
+
+	/// <summary>
+	/// content hashes of the current weight table and originalGeometry
+	/// </summary>
+	uint64_t m_weightsHash = 0;
+	uint64_t m_topologyHash = 0;
+	uint64_t m_pointsHash = 0;
+	bool m_isGeometryFingerprintDirty = true;
+
+	/// <summary>
+	/// inputs of the last precomputation of each deformer
+	/// </summary>
+	InputFingerprint m_ddmFingerprint;
+	InputFingerprint m_dmFingerprint;
+
 	DeformerDDM m_ddmDeformer;
+
+	/// <summary>
+	/// time of the last DDM evaluation, to detect the time jumps for the warm start of the rotation fit
+	/// </summary>
+	MTime m_lastDDMTime;
+	bool m_hasLastDDMTime = false;
 	DeformerLBS m_lbsDeformer;
+
+	/// <summary>
+	/// whether the instruction set of the vectorized kernel has been reported
+	/// </summary>
+	bool m_hasReportedISA = false;
 	DeformerDeltaMush m_dmDeformer;
 };
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include <maya/MOpenCLInfo.h>
 #include <maya/MGlobal.h>
 #include <maya/MFnMatrixData.h>
+#include <maya/MFnDependencyNode.h>
+#include <maya/MEvaluationNode.h>
 
 
 MGPUDeformerRegistrationInfo* CustomSkinClusterGPU::getGPUDeformerInfo()
@@ -44,8 +46,17 @@ MPxGPUDeformer::DeformerStatus CustomSkinClusterGPU::evaluate(
 		return kDeformerFailure;
 	}
 
+	// the weight table is owned by the node, and shared with the CPU deformers
+	CustomSkinCluster* node = static_cast<CustomSkinCluster*>(MFnDependencyNode(evaluationNode.dependencyNode()).userNode());
+	if (node == nullptr)
+	{
+		return kDeformerFailure;
+	}
+	const bool isWeightListDirty = evaluationNode.dirtyPlugExists(MPxSkinCluster::weightList);
+	const WeightTable& weightTable = node->UpdateWeightTable(block, inputPositions.elementCount(), isWeightListDirty);
+
 	// main evaluate process
-	m_lbsDeformer.Evaluate(block, evaluationNode, CustomSkinCluster::pluginPath, inputPositions, outputPositions);
+	m_lbsDeformer.Evaluate(block, evaluationNode, CustomSkinCluster::pluginPath, weightTable, inputPositions, outputPositions);
 
 	// set the results
 	outputData.setBuffer(outputPositions);
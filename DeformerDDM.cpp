@@ -1,202 +1,1164 @@
 #include "DeformerDDM.h"
 #include "MeshLaplacian.h"
 #include "MatrixUtil.h"
+#include "RotationKernel.h"
+#include "ParallelUtil.h"
+#include "PrecomputeCache.h"
+#include "ContentHash.h"
 #include <maya/MPxSkinCluster.h>
 #include <maya/MFnMesh.h>
-#include <maya/MFnMatrixData.h>
 #include <maya/MQuaternion.h>
 #include <maya/MPointArray.h>
+#include <maya/MIntArray.h>
 #include <maya/MStatus.h>
+#include <maya/MGlobal.h>
+#include <maya/MString.h>
+#include <string>
 #include "omp.h"
 
 namespace {
 	inline float QuatDot(const MQuaternion& q1, const MQuaternion& q2) {
 		return q1.x * q2.x + q1.y * q2.y + q1.z * q2.z + q1.w * q2.w;
 	}
+
+	/// <summary>
+	/// entries of the weight table grouped by joint: the entries of joint j are in [Offsets[j], Offsets[j + 1])
+	/// </summary>
+	struct JointEntries
+	{
+		std::vector<unsigned int> Offsets;
+		std::vector<unsigned int> Entries;
+		std::vector<unsigned int> Vertices;
+	};
+
+	JointEntries GroupEntriesByJoint(const WeightTable& weights)
+	{
+		const unsigned int numJoints = weights.NumJoints();
+
+		JointEntries joints;
+		joints.Offsets.assign(numJoints + 1, 0);
+		for (unsigned int eIdx = 0; eIdx < weights.NumEntries(); eIdx++)
+		{
+			joints.Offsets[weights.Joint(eIdx) + 1]++;
+		}
+		for (unsigned int j = 0; j < numJoints; j++)
+		{
+			joints.Offsets[j + 1] += joints.Offsets[j];
+		}
+
+		joints.Entries.resize(weights.NumEntries());
+		joints.Vertices.resize(weights.NumEntries());
+		std::vector<unsigned int> cursors(joints.Offsets.begin(), joints.Offsets.end() - 1);
+		for (unsigned int vIdx = 0; vIdx < weights.NumVertices(); vIdx++)
+		{
+			for (unsigned int eIdx = weights.Begin(vIdx); eIdx < weights.End(vIdx); eIdx++)
+			{
+				const unsigned int pos = cursors[weights.Joint(eIdx)]++;
+				joints.Entries[pos] = eIdx;
+				joints.Vertices[pos] = vIdx;
+			}
+		}
+		return joints;
+	}
 }
 
 
+DeformerDDM::~DeformerDDM()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isWorkerExiting = true;
+		m_queuedJob.reset();
+		m_generation++;
+	}
+	m_condition.notify_all();
+
+	if (m_worker.joinable())
+	{
+		m_worker.join();
+	}
+}
+
 void DeformerDDM::SetSmoothingProperty(const SmoothingProperty& prop)
 {
-	if (m_smoothingProp != prop)
+	m_requestedSmoothingProp = prop;
+}
+
+void DeformerDDM::Precompute(MObject& mesh, const WeightTable& weights, bool needRebindMesh, int numThreads)
+{
+	// the precomputation state is not shared with the worker
+	CancelPrecompute();
+
+	PrecomputeInput input;
+	ReadPrecomputeInput(mesh, weights, needRebindMesh, numThreads, input);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		input.NeedRebindMesh |= m_isRebindPending;
+		m_isRebindPending = false;
+	}
+
+	if (ComputeBindData(input, m_generation.load()))
+	{
+		Publish();
+	}
+}
+
+void DeformerDDM::PrecomputeAsync(
+	MObject& mesh, const WeightTable& weights, bool needRebindMesh, int numThreads, std::function<void()> onPublished)
+{
+	auto input = std::make_unique<PrecomputeInput>();
+	ReadPrecomputeInput(mesh, weights, needRebindMesh, numThreads, *input);
+
 	{
-		m_smoothingProp = prop;
-		m_isSmoothingMatDirty = true;
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		// the rebinding must not be lost if its job is replaced before it completes
+		input->NeedRebindMesh |= m_isRebindPending;
+		m_isRebindPending = input->NeedRebindMesh;
+
+		// nor the topology, which is not read again for the next job
+		if (m_queuedJob && m_queuedJob->HasTopology && !input->HasTopology)
+		{
+			input->Topology = std::move(m_queuedJob->Topology);
+			input->HasTopology = true;
+		}
+
+		// replace the queued job, and make the running one stale
+		m_queuedJob = std::move(input);
+		m_queuedOnPublished = std::move(onPublished);
+		m_generation++;
+
+		if (!m_worker.joinable())
+		{
+			m_worker = std::thread(&DeformerDDM::RunWorker, this);
+		}
+	}
+	m_condition.notify_all();
+}
+
+bool DeformerDDM::UpdateBindData(unsigned int numVertices, unsigned int numJoints)
+{
+	std::vector<std::pair<MString, bool>> messages;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_bind != m_published)
+		{
+			m_bind = m_published;
+
+			// the kept rotations were fitted with the old Psi matrices
+			m_areRotationBasesValid = false;
+		}
+		messages.swap(m_messages);
+	}
+
+	for (const auto& message : messages)
+	{
+		if (message.second)
+		{
+			MGlobal::displayError(message.first);
+		}
+		else
+		{
+			MGlobal::displayInfo(message.first);
+		}
+	}
+
+	// the kernels index the palette with the joints of the bound weights, which may be older than the current ones
+	return m_bind && m_bind->Weights.NumVertices() == numVertices && m_bind->Weights.NumJoints() <= numJoints;
+}
+
+bool DeformerDDM::HasBindData()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_bind || m_published || m_queuedJob || m_isJobRunning;
+}
+
+void DeformerDDM::QueueMessage(const MString& message, bool isError)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_messages.emplace_back(message, isError);
+}
+
+void DeformerDDM::Publish()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_published = m_precomputed;
+}
+
+void DeformerDDM::CancelPrecompute()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (m_queuedJob && m_queuedJob->HasTopology)
+	{
+		m_needsTopology = true;
+	}
+	m_queuedJob.reset();
+	m_queuedOnPublished = nullptr;
+	m_generation++;
+	m_condition.wait(lock, [this]() { return !m_isJobRunning; });
+}
+
+void DeformerDDM::RunWorker()
+{
+	for (;;)
+	{
+		std::unique_ptr<PrecomputeInput> job;
+		std::function<void()> onPublished;
+		uint64_t generation = 0;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait(lock, [this]() { return m_isWorkerExiting || m_queuedJob; });
+			if (m_isWorkerExiting)
+			{
+				return;
+			}
+
+			job = std::move(m_queuedJob);
+			onPublished = std::move(m_queuedOnPublished);
+			generation = m_generation.load();
+			m_isJobRunning = true;
+		}
+
+		const bool isCompleted = ComputeBindData(*job, generation);
+
+		// a result is published only if no request has come since its job started
+		bool isPublished = false;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (isCompleted && generation == m_generation.load())
+			{
+				m_published = m_precomputed;
+				m_isRebindPending = false;
+				isPublished = true;
+			}
+			m_isJobRunning = false;
+		}
+		m_condition.notify_all();
+
+		if (isPublished && onPublished)
+		{
+			onPublished();
+		}
 	}
 }
 
-void DeformerDDM::Precompute(MObject& mesh, MArrayDataHandle& weightListsHandle, bool needRebindMesh)
+void DeformerDDM::ReadPrecomputeInput(
+	MObject& mesh, const WeightTable& weights, bool needRebindMesh, int numThreads, PrecomputeInput& input)
 {
 	MFnMesh meshFn(mesh);
+	meshFn.getPoints(input.RestPoints);
 
-	MPointArray original;
-	meshFn.getPoints(original);
+	// the adjacency is the costly part to read, so the worker keeps its copy until the mesh is rebound,
+	// which includes the changes of the topology, or the vertex order changes
+	if (needRebindMesh || m_needsTopology || m_requestedVertexOrder != m_sentVertexOrder)
+	{
+		input.Topology.Build(mesh, numThreads);
+		input.HasTopology = true;
+		m_needsTopology = false;
+	}
+	m_sentVertexOrder = m_requestedVertexOrder;
+
+	input.Weights = weights;
+	input.NeedRebindMesh = needRebindMesh;
+	input.Smoothing = m_requestedSmoothingProp;
+	input.CacheDirectory = m_cacheDirectory;
+	input.Order = m_requestedVertexOrder;
+	input.NumThreads = numThreads;
+}
 
+bool DeformerDDM::ComputeBindData(PrecomputeInput& input, uint64_t generation)
+{
+	bool needRebindMesh = input.NeedRebindMesh;
+	const int numThreads = input.NumThreads;
+
+	// a new topology is kept in the internal order for the following jobs, which do not carry one
+	if (input.HasTopology)
+	{
+		// the order is only computed at the rebinding, and a new one invalidates everything stored in the previous one
+		if (needRebindMesh || input.Order != m_orderKind || m_orderNumVertices != input.RestPoints.length())
+		{
+			VertexOrder order;
+			order.Compute(input.Order, input.Topology, input.RestPoints);
+			if (order != m_order)
+			{
+				// the Laplacian is also rebuilt by the next call if this one is cancelled
+				needRebindMesh = true;
+				m_laplacian = Eigen::SparseMatrix<double>();
+			}
+			m_order = std::move(order);
+			m_orderKind = input.Order;
+			m_orderNumVertices = input.RestPoints.length();
+		}
+
+		m_topology = std::move(input.Topology);
+		input.HasTopology = false;
+		if (!m_order.IsIdentity())
+		{
+			m_topology.Permute(m_order.NewToOld(), numThreads);
+		}
+		m_isTopologyHashValid = false;
+	}
+
+	// the inputs are read in the order of the mesh, and everything below runs in the internal order
+	if (!m_order.IsIdentity())
+	{
+		// weights of another geometry are not permuted, and no Psi matrices are computed for them below
+		if (input.Weights.NumVertices() == m_order.NewToOld().size())
+		{
+			input.Weights.Permute(m_order.NewToOld());
+		}
+
+		MPointArray restPoints;
+		m_order.Gather(input.RestPoints, restPoints, numThreads);
+		input.RestPoints = restPoints;
+	}
+
+	// topology of the faces for the cache key, which determines the Laplacian and its eigenbasis in the internal order
+	if (!input.CacheDirectory.empty())
+	{
+		if (!m_isTopologyHashValid)
+		{
+			ContentHash hash;
+			m_topology.AddToHash(hash);
+			m_topologyHash = hash.Value();
+			m_isTopologyHashValid = true;
+		}
+		input.TopologyHash = m_topologyHash;
+	}
+
+	const MPointArray& original = input.RestPoints;
+	const WeightTable& weights = input.Weights;
 	const unsigned int numVerts = original.length();
 
+	const std::function<bool()> isCancelled = [this, generation]()
+		{
+			return m_generation.load(std::memory_order_relaxed) != generation;
+		};
+
+	if (m_smoothingProp != input.Smoothing)
+	{
+		m_smoothingProp = input.Smoothing;
+		m_isSmoothingMatDirty = true;
+	}
+
+	// the Psi matrices can only be updated incrementally if they were computed for the same rest pose
+	ContentHash restPoseHash;
+	for (unsigned int i = 0; i < numVerts; i++)
+	{
+		restPoseHash.AddValue(original[i].x);
+		restPoseHash.AddValue(original[i].y);
+		restPoseHash.AddValue(original[i].z);
+	}
+
+	// reuse the results of the same inputs if they are in the cache
+	uint64_t cacheKey = 0;
+	std::string cachePath;
+	if (!input.CacheDirectory.empty())
+	{
+		cacheKey = ComputeCacheKey(input);
+		cachePath = PrecomputeCache::FilePath(input.CacheDirectory, cacheKey);
+
+		auto result = std::make_shared<BindData>();
+		if (PrecomputeCache::Load(cachePath, cacheKey, numVerts, weights.NumEntries(), result->Psi, m_smoothingMat))
+		{
+			// the implicit smoothing has no matrix to cache, so it is factorized again when the Psi matrices are recomputed
+			m_isSmoothingMatDirty = m_smoothingProp.IsImplicit || m_smoothingProp.IsMatrixFree || m_smoothingProp.NumEigenpairs > 0;
+			m_smoothingVersion++;
+
+			// the Laplacian of the new mesh is built when the smoothing matrix needs to be recomputed
+			if (needRebindMesh)
+			{
+				m_laplacian = Eigen::SparseMatrix<double>();
+				m_implicitSmoothing.Clear();
+				m_eigenbasis.Clear();
+			}
+
+			result->Weights = weights;
+			result->Order = m_order;
+			result->RestPoseHash = restPoseHash.Value();
+			result->SmoothingVersion = m_smoothingVersion;
+			m_precomputed = std::move(result);
+			return true;
+		}
+	}
+
 	// recompute laplacian if necessary
-	if (needRebindMesh)
+	if (needRebindMesh || m_laplacian.cols() != static_cast<Eigen::Index>(numVerts))
 	{
-		MeshLaplacian::ComputeLaplacian(MItMeshEdge(mesh), numVerts, m_laplacian);
+		m_topology.ComputeLaplacian(m_laplacian, numThreads);
+		m_eigenbasis.Clear();
 		m_isSmoothingMatDirty = true;
 	}
 
+	if (isCancelled())
+	{
+		return false;
+	}
+
 	// compute the smoothing matrix if necessary
 	if (m_isSmoothingMatDirty)
 	{
-		MeshLaplacian::ComputeSmoothingMatrix(m_laplacian, numVerts,
-			m_smoothingProp.Amount, m_smoothingProp.Iteration, m_smoothingProp.IsImplicit, m_smoothingMat);
+		m_smoothingVersion++;
+		m_smoothingStep = Eigen::SparseMatrix<double>();
+		if (m_smoothingProp.NumEigenpairs > 0)
+		{
+			// B is never formed, and the basis is only computed for a new topology, unless it is in the cache directory
+			m_implicitSmoothing.Clear();
+
+			const unsigned int numEigenpairs = std::min(static_cast<unsigned int>(m_smoothingProp.NumEigenpairs), numVerts > 0 ? numVerts - 1 : 0u);
+			bool isBasisReady = m_eigenbasis.NumVertices() == numVerts && m_eigenbasis.NumEigenpairs() == numEigenpairs;
+			const std::string basisPath = input.CacheDirectory.empty()
+				? std::string() : LaplacianEigenbasis::FilePath(input.CacheDirectory, input.TopologyHash, numEigenpairs);
+			if (!isBasisReady && !basisPath.empty())
+			{
+				isBasisReady = m_eigenbasis.Load(basisPath, input.TopologyHash, numVerts, numEigenpairs);
+			}
+			if (!isBasisReady)
+			{
+				isBasisReady = m_eigenbasis.Compute(m_topology, numEigenpairs);
+				if (isBasisReady && !basisPath.empty())
+				{
+					m_eigenbasis.Save(basisPath, input.TopologyHash);
+				}
+			}
+
+			if (isBasisReady)
+			{
+				m_smoothingMat = Eigen::SparseMatrix<double>(numVerts, numVerts);
+			}
+			else
+			{
+				QueueMessage("DDM: failed to compute the eigenpairs of the Laplacian", true);
+				m_smoothingMat = Eigen::SparseMatrix<double>();
+			}
+		}
+		else if (m_smoothingProp.IsImplicit)
+		{
+			// B is dense, so only the factorization is kept and the fields the Psi matrices need are solved for
+			if (m_implicitSmoothing.Compute(m_laplacian, m_smoothingProp.Amount, m_smoothingProp.Iteration))
+			{
+				m_smoothingMat = Eigen::SparseMatrix<double>(numVerts, numVerts);
+			}
+			else
+			{
+				QueueMessage("DDM: failed to factorize the implicit smoothing", true);
+				m_smoothingMat = Eigen::SparseMatrix<double>();
+			}
+		}
+		else if (m_smoothingProp.IsMatrixFree)
+		{
+			// B is never formed, and the moment fields are diffused step by step with S = I - lambda * L
+			m_implicitSmoothing.Clear();
+
+			Eigen::SparseMatrix<double> Identity(numVerts, numVerts);
+			Identity.setIdentity();
+			m_smoothingStep = Identity - m_smoothingProp.Amount * m_laplacian;
+			m_smoothingStep.makeCompressed();
+			m_smoothingMat = Eigen::SparseMatrix<double>(numVerts, numVerts);
+		}
+		else
+		{
+			m_implicitSmoothing.Clear();
+
+			// apply the smoothing step by step to bound the fill-in of the matrix
+			MeshLaplacian::SmoothingMatrixStats stats;
+			MeshLaplacian::ComputeSmoothingMatrixIteratively(m_laplacian, numVerts, m_smoothingProp.Amount, m_smoothingProp.Iteration,
+				{ m_smoothingProp.PruneThreshold, m_smoothingProp.PruneRing }, numThreads, m_smoothingMat, &stats);
+
+			MString msg = "DDM smoothing matrix: ";
+			msg += std::to_string(stats.NumNonZeros).c_str();
+			msg += " nonzeros, dropped mass per column max ";
+			msg += stats.MaxDroppedMass;
+			msg += " mean ";
+			msg += stats.MeanDroppedMass;
+			QueueMessage(msg, false);
+		}
 
 		m_isSmoothingMatDirty = false;
 	}
 
-	m_psiMats.resize(numVerts);
-	m_jointIdxs.resize(numVerts);
+	// the smoothing matrix is built for another topology until the mesh is rebound, and the weights are read from the deformed
+	// geometry, which may not match the original geometry. The Psi matrices can only be computed when they all agree
+	if (m_smoothingMat.cols() != static_cast<Eigen::Index>(numVerts) || weights.NumVertices() != numVerts)
+	{
+		m_precomputed.reset();
+		return true;
+	}
 
+	if (isCancelled())
+	{
+		return false;
+	}
 
-	for (int vIdx = 0; vIdx < numVerts; vIdx++)
+	// when only some of the weights have been edited since the last precompute, e.g. by painting,
+	// only the Psi matrices depending on them are recomputed and the others are carried over
+	const unsigned int numPacked = MatrixUtil::NumSymmetricElements;
+	const std::shared_ptr<const BindData> previous = m_precomputed;
+	const bool isIncremental = previous && !needRebindMesh
+		&& previous->SmoothingVersion == m_smoothingVersion && previous->RestPoseHash == restPoseHash.Value() && previous->Order == m_order
+		&& previous->Weights.NumVertices() == numVerts
+		&& previous->Psi.size() == static_cast<size_t>(numPacked) * previous->Weights.NumEntries();
+	std::vector<uint32_t> changedVerts;
+	std::vector<uint8_t> isVertChanged;
+	if (isIncremental)
 	{
-		weightListsHandle.jumpToArrayElement(vIdx);
-		MArrayDataHandle weightsHandle = weightListsHandle.inputValue().child(MPxSkinCluster::weights);
+		weights.FindChangedVertices(previous->Weights, changedVerts);
+		isVertChanged.assign(numVerts, 0);
+		for (uint32_t vIdx : changedVerts)
+		{
+			isVertChanged[vIdx] = 1;
+		}
+	}
 
-		unsigned int numWeights = weightsHandle.elementCount(); // # of nonzero weights
-		assert(numWeights <= MaxInfluence);
+	// accumulated in double, and stored in float once all the terms are added
+	std::vector<double> psiAcc(static_cast<size_t>(numPacked) * weights.NumEntries(), 0.0);
 
-		for (unsigned int wIdx = 0; wIdx < MaxInfluence; wIdx++)
-		{
-			MMatrix tmp = MatrixUtil::ZeroMatrix();
+	// the entries of the unchanged vertices are in the same order in both tables
+	if (isIncremental)
+	{
+		ParallelUtil::ForEach(static_cast<int>(numVerts), numThreads, [&](int vIdx)
+			{
+				if (!isVertChanged[vIdx])
+				{
+					std::copy(previous->Psi.begin() + static_cast<size_t>(numPacked) * previous->Weights.Begin(vIdx),
+						previous->Psi.begin() + static_cast<size_t>(numPacked) * previous->Weights.End(vIdx),
+						psiAcc.begin() + static_cast<size_t>(numPacked) * weights.Begin(vIdx));
+				}
+			});
+	}
 
-			if (wIdx < numWeights)
+	if (m_smoothingProp.NumEigenpairs > 0 || m_smoothingProp.IsImplicit || m_smoothingProp.IsMatrixFree)
+	{
+		// Psi_ij only depends on the weights of joint j, so only the joints with edited weights are smoothed again.
+		// All the joints of a changed vertex are included, since the layout of its entries may have changed
+		std::vector<uint8_t> isJointDirty;
+		if (isIncremental)
+		{
+			isJointDirty.assign(std::max(weights.NumJoints(), previous->Weights.NumJoints()), 0);
+			for (uint32_t vIdx : changedVerts)
 			{
-				// svǁASĂ
-				//weightListsHandle.jumpToArrayElement(vIdx);
-				//weightsHandle = weightListsHandle.inputValue().child(MPxSkinCluster::weights);
+				for (unsigned int eIdx = weights.Begin(vIdx); eIdx < weights.End(vIdx); eIdx++)
+				{
+					isJointDirty[weights.Joint(eIdx)] = 1;
+				}
+				for (unsigned int eIdx = previous->Weights.Begin(vIdx); eIdx < previous->Weights.End(vIdx); eIdx++)
+				{
+					isJointDirty[previous->Weights.Joint(eIdx)] = 1;
+				}
+			}
+		}
 
-				weightsHandle.jumpToArrayElement(wIdx); // jump to physical index
-				unsigned int jointIdx = weightsHandle.elementIndex(); // logical index corresponds to the joint index
+		if (m_smoothingProp.NumEigenpairs > 0)
+		{
+			AccumulatePsiSpectrally(original, weights, isJointDirty, isCancelled, numThreads, psiAcc);
+		}
+		else if (m_smoothingProp.IsImplicit)
+		{
+			AccumulatePsiImplicitly(original, weights, isJointDirty, isCancelled, numThreads, psiAcc);
+		}
+		else
+		{
+			AccumulatePsiByDiffusion(original, weights, isJointDirty, isCancelled, numThreads, psiAcc);
+		}
+	}
+	else
+	{
+		// Psi_ij = sum_k B_ki * w_kj * u_k * u_k^t, where only the nonzeros of column i of B contribute.
+		// B is column-major, so they are walked directly and the cost is O(nnz(B) * # of influences).
+		// All the inputs are plain arrays here, and each vertex only writes its own Psi matrices in the fixed order of k,
+		// so the vertices run in parallel without any reduction and the result does not depend on the # of threads
+		auto accumulate = [&](int vIdx)
+			{
+				if (isCancelled())
+				{
+					return;
+				}
 
-				m_jointIdxs[vIdx][wIdx] = jointIdx;
+				const unsigned int begin = weights.Begin(vIdx);
+				const unsigned int end = weights.End(vIdx);
 
-//#pragma omp parallel for
-				for (int k = 0; k < numVerts; k++)
+				for (Eigen::SparseMatrix<double>::InnerIterator it(m_smoothingMat, vIdx); it; ++it)
 				{
-					// first, compute w_kj
-					weightListsHandle.jumpToArrayElement(k);
-					MArrayDataHandle tmpWeightsHandle = weightListsHandle.inputValue().child(MPxSkinCluster::weights);
+					const int k = static_cast<int>(it.row());
+					const double b_ki = it.value();
 
-					double w_kj = 0.0f;
-					for (unsigned int wIdx2 = 0; wIdx2 < tmpWeightsHandle.elementCount(); wIdx2++)
+					const MPoint& pos = original[k];
+
+					for (unsigned int eIdx = begin; eIdx < end; eIdx++)
 					{
-						tmpWeightsHandle.jumpToArrayElement(wIdx2);
+						// w_kj is nonzero only if the joint also influences vertex k
+						const double w_kj = weights.FindWeight(k, weights.Joint(eIdx));
+						assert(w_kj >= 0.0 && w_kj <= 1.0);
+						if (w_kj == 0.0)
+						{
+							continue;
+						}
 
-						unsigned int tmpJointIdx = tmpWeightsHandle.elementIndex();
-						if (tmpJointIdx == jointIdx)
+						// ukuk is symmetric, so only its upper triangle is accumulated
+						MatrixUtil::AccumulateOuterProduct(pos, b_ki * w_kj, &psiAcc[static_cast<size_t>(numPacked) * eIdx]);
+					}
+				}
+			};
+
+		if (isIncremental)
+		{
+			// B has compact support, so an edit at vertex k only affects the vertices i whose column of B has B_ki
+			std::vector<uint8_t> isAffected(numVerts, 0);
+			ParallelUtil::ForEach(static_cast<int>(numVerts), numThreads, [&](int vIdx)
+				{
+					for (Eigen::SparseMatrix<double>::InnerIterator it(m_smoothingMat, vIdx); it; ++it)
+					{
+						if (isVertChanged[it.row()])
 						{
-							w_kj = tmpWeightsHandle.inputValue().asDouble();
+							isAffected[vIdx] = 1;
 							break;
 						}
 					}
-					assert(w_kj >= 0.0 && w_kj <= 1.0);
+				});
 
-					// compute ukuk
-					MPoint pos = original[k];
-					MMatrix ukuk = MatrixUtil::BuildMatrixFromMPoint(pos, pos);
-					tmp += m_smoothingMat.coeff(k, vIdx) * w_kj * ukuk;
+			std::vector<uint32_t> affectedVerts;
+			for (unsigned int vIdx = 0; vIdx < numVerts; vIdx++)
+			{
+				if (isAffected[vIdx] || isVertChanged[vIdx])
+				{
+					affectedVerts.push_back(vIdx);
 				}
 			}
-			else
+
+			ParallelUtil::ForEach(static_cast<int>(affectedVerts.size()), numThreads, [&](int i)
+				{
+					const uint32_t vIdx = affectedVerts[i];
+					std::fill(psiAcc.begin() + static_cast<size_t>(numPacked) * weights.Begin(vIdx),
+						psiAcc.begin() + static_cast<size_t>(numPacked) * weights.End(vIdx), 0.0);
+					accumulate(static_cast<int>(vIdx));
+				});
+		}
+		else
+		{
+			ParallelUtil::ForEach(static_cast<int>(numVerts), numThreads, accumulate);
+		}
+	}
+
+	if (isCancelled())
+	{
+		return false;
+	}
+
+	// keep the weights the Psi matrices are computed from, since the deformation needs the same influences
+	auto result = std::make_shared<BindData>();
+	result->Weights = weights;
+	result->Order = m_order;
+	result->Psi.assign(psiAcc.begin(), psiAcc.end());
+	result->RestPoseHash = restPoseHash.Value();
+	result->SmoothingVersion = m_smoothingVersion;
+
+	if (!cachePath.empty())
+	{
+		PrecomputeCache::Save(cachePath, cacheKey, result->Psi, m_smoothingMat);
+	}
+
+	m_precomputed = std::move(result);
+	return true;
+}
+
+void DeformerDDM::AccumulatePsiImplicitly(const MPointArray& original, const WeightTable& weights, const std::vector<uint8_t>& isJointDirty,
+	const std::function<bool()>& isCancelled, int numThreads, std::vector<double>& psiAcc) const
+{
+	const unsigned int numPacked = MatrixUtil::NumSymmetricElements;
+	const unsigned int numVerts = original.length();
+
+	// the vertices influenced by joint j are both the support of its moment fields and where its Psi matrices are read back
+	const JointEntries joints = GroupEntriesByJoint(weights);
+	const std::vector<unsigned int>& jointEntries = joints.Entries;
+	const std::vector<unsigned int>& jointVerts = joints.Vertices;
+
+	// Psi_ij = sum_k B_ki * w_kj * u_k * u_k^t = (B^t * f_j)_i, where the packed elements of f_j(k) = w_kj * u_k * u_k^t
+	// are numPacked fields over the vertices. They are smoothed joint by joint with the shared factorization,
+	// and each joint only writes its own entries
+	ParallelUtil::ForEachTask(static_cast<int>(weights.NumJoints()), numThreads, [&](int j)
+		{
+			const unsigned int begin = joints.Offsets[j];
+			const unsigned int end = joints.Offsets[j + 1];
+			if (begin == end || (!isJointDirty.empty() && !isJointDirty[j]) || isCancelled())
 			{
-				m_jointIdxs[vIdx][wIdx] = -1;
+				return;
 			}
 
-			m_psiMats[vIdx][wIdx] = tmp;
-		}
+			Eigen::MatrixXd fields = Eigen::MatrixXd::Zero(numVerts, numPacked);
+			for (unsigned int pos = begin; pos < end; pos++)
+			{
+				double packed[MatrixUtil::NumSymmetricElements] = {};
+				MatrixUtil::AccumulateOuterProduct(original[jointVerts[pos]], weights.Weight(jointEntries[pos]), packed);
+				for (unsigned int c = 0; c < numPacked; c++)
+				{
+					fields(jointVerts[pos], c) = packed[c];
+				}
+			}
+
+			m_implicitSmoothing.ApplyTransposed(fields);
+
+			for (unsigned int pos = begin; pos < end; pos++)
+			{
+				double* psi = &psiAcc[static_cast<size_t>(numPacked) * jointEntries[pos]];
+				for (unsigned int c = 0; c < numPacked; c++)
+				{
+					psi[c] = fields(jointVerts[pos], c);
+				}
+			}
+		});
+}
+
+void DeformerDDM::AccumulatePsiSpectrally(const MPointArray& original, const WeightTable& weights, const std::vector<uint8_t>& isJointDirty,
+	const std::function<bool()>& isCancelled, int numThreads, std::vector<double>& psiAcc) const
+{
+	const unsigned int numPacked = MatrixUtil::NumSymmetricElements;
+
+	Eigen::VectorXd response;
+	m_eigenbasis.ComputeResponse(m_smoothingProp.Amount, m_smoothingProp.Iteration, m_smoothingProp.IsImplicit, response);
+
+	// Psi_ij = (B^t * f_j)_i as in AccumulatePsiImplicitly, and f_j is zero outside the vertices influenced by joint j,
+	// which are also the only ones read back. So each joint costs O(# of its vertices * # of eigenpairs), and O(V * k) in total
+	const JointEntries joints = GroupEntriesByJoint(weights);
+	ParallelUtil::ForEachTask(static_cast<int>(weights.NumJoints()), numThreads, [&](int j)
+		{
+			const unsigned int begin = joints.Offsets[j];
+			const unsigned int end = joints.Offsets[j + 1];
+			if (begin == end || (!isJointDirty.empty() && !isJointDirty[j]) || isCancelled())
+			{
+				return;
+			}
+
+			Eigen::MatrixXd fields(end - begin, numPacked);
+			for (unsigned int pos = begin; pos < end; pos++)
+			{
+				double packed[MatrixUtil::NumSymmetricElements] = {};
+				MatrixUtil::AccumulateOuterProduct(original[joints.Vertices[pos]], weights.Weight(joints.Entries[pos]), packed);
+				for (unsigned int c = 0; c < numPacked; c++)
+				{
+					fields(pos - begin, c) = packed[c];
+				}
+			}
+
+			m_eigenbasis.ApplyTransposedOnRows(&joints.Vertices[begin], end - begin, response, fields);
+
+			for (unsigned int pos = begin; pos < end; pos++)
+			{
+				double* psi = &psiAcc[static_cast<size_t>(numPacked) * joints.Entries[pos]];
+				for (unsigned int c = 0; c < numPacked; c++)
+				{
+					psi[c] = fields(pos - begin, c);
+				}
+			}
+		});
+}
+
+void DeformerDDM::AccumulatePsiByDiffusion(const MPointArray& original, const WeightTable& weights, const std::vector<uint8_t>& isJointDirty,
+	const std::function<bool()>& isCancelled, int numThreads, std::vector<double>& psiAcc) const
+{
+	const unsigned int numPacked = MatrixUtil::NumSymmetricElements;
+	const unsigned int numVerts = original.length();
+	const int p = m_smoothingProp.Iteration;
+	const int numRings = p / 2;
+
+	const JointEntries joints = GroupEntriesByJoint(weights);
+
+	// B^t = (S^t)^p, and column i of S = I - lambda * L holds the coefficients of one step of B^t at vertex i,
+	// so the moment fields are smoothed by gathering them from the neighbors
+	const Eigen::SparseMatrix<double>& S = m_smoothingStep;
+	const int* outer = S.outerIndexPtr();
+	const int* inner = S.innerIndexPtr();
+	const double* coeffs = S.valuePtr();
+
+	// local index of each vertex in the region of the current joint (-1 if outside), per thread and reset after each joint
+	std::vector<std::vector<int>> localIndices(ParallelUtil::NumThreads(numThreads));
+
+	// Psi_ij = (B^t * f_j)_i as in AccumulatePsiImplicitly. The fields reach s rings from the support of the joint after s steps,
+	// and only the support is read after the last step, so step s only needs the vertices within min(s, p - s) rings
+	ParallelUtil::ForEachTask(static_cast<int>(weights.NumJoints()), numThreads, [&](int j)
+		{
+			const unsigned int begin = joints.Offsets[j];
+			const unsigned int end = joints.Offsets[j + 1];
+			if (begin == end || (!isJointDirty.empty() && !isJointDirty[j]) || isCancelled())
+			{
+				return;
+			}
+
+			std::vector<int>& localIdx = localIndices[omp_get_thread_num()];
+			if (localIdx.empty())
+			{
+				localIdx.assign(numVerts, -1);
+			}
+
+			// the vertices of the region in the order of the rings, so that the first k rings are a prefix
+			std::vector<unsigned int> region(joints.Vertices.begin() + begin, joints.Vertices.begin() + end);
+			std::vector<size_t> ringEnds(1, region.size());
+			for (size_t idx = 0; idx < region.size(); idx++)
+			{
+				localIdx[region[idx]] = static_cast<int>(idx);
+			}
+			for (int ring = 1; ring <= numRings; ring++)
+			{
+				const size_t prevBegin = ring == 1 ? 0 : ringEnds[ring - 2];
+				const size_t prevEnd = ringEnds[ring - 1];
+				for (size_t idx = prevBegin; idx < prevEnd; idx++)
+				{
+					for (int n = outer[region[idx]]; n < outer[region[idx] + 1]; n++)
+					{
+						if (localIdx[inner[n]] < 0)
+						{
+							localIdx[inner[n]] = static_cast<int>(region.size());
+							region.push_back(inner[n]);
+						}
+					}
+				}
+				ringEnds.push_back(region.size());
+			}
+
+			std::vector<double> current(region.size() * numPacked, 0.0);
+			std::vector<double> next(region.size() * numPacked, 0.0);
+			for (unsigned int pos = begin; pos < end; pos++)
+			{
+				MatrixUtil::AccumulateOuterProduct(
+					original[joints.Vertices[pos]], weights.Weight(joints.Entries[pos]), &current[static_cast<size_t>(numPacked) * (pos - begin)]);
+			}
+
+			for (int step = 1; step <= p; step++)
+			{
+				// the values beyond the rings of the previous step are zero or no longer needed, and are not read
+				const size_t activeEnd = ringEnds[std::min(step, p - step)];
+				const size_t prevActiveEnd = ringEnds[std::min(step - 1, p - step + 1)];
+				for (size_t idx = 0; idx < activeEnd; idx++)
+				{
+					double acc[MatrixUtil::NumSymmetricElements] = {};
+					for (int n = outer[region[idx]]; n < outer[region[idx] + 1]; n++)
+					{
+						const int k = localIdx[inner[n]];
+						if (k < 0 || static_cast<size_t>(k) >= prevActiveEnd)
+						{
+							continue;
+						}
+
+						const double* src = &current[static_cast<size_t>(numPacked) * k];
+						for (unsigned int c = 0; c < numPacked; c++)
+						{
+							acc[c] += coeffs[n] * src[c];
+						}
+					}
+					std::copy(acc, acc + numPacked, &next[static_cast<size_t>(numPacked) * idx]);
+				}
+				current.swap(next);
+			}
+
+			// each joint only writes its own entries
+			for (unsigned int pos = begin; pos < end; pos++)
+			{
+				std::copy_n(&current[static_cast<size_t>(numPacked) * (pos - begin)], numPacked,
+					&psiAcc[static_cast<size_t>(numPacked) * joints.Entries[pos]]);
+			}
+
+			for (unsigned int v : region)
+			{
+				localIdx[v] = -1;
+			}
+		});
+}
+
+void DeformerDDM::SetCacheDirectory(const std::string& directory)
+{
+	m_cacheDirectory = directory;
+}
+
+void DeformerDDM::SetVertexOrder(VertexOrder::Kind kind)
+{
+	m_requestedVertexOrder = kind;
+}
+
+void DeformerDDM::SetWarmStart(bool enabled)
+{
+	if (m_isWarmStartEnabled == enabled)
+	{
+		return;
+	}
+
+	m_isWarmStartEnabled = enabled;
+	if (!enabled)
+	{
+		m_rotationBases = std::vector<double>();
+		m_areRotationBasesValid = false;
 	}
 }
 
-MPoint DeformerDDM::Deform(
-	int vertIdx,
-	const MPoint& pt,
+void DeformerDDM::ResetWarmStart()
+{
+	m_areRotationBasesValid = false;
+}
+
+uint64_t DeformerDDM::ComputeCacheKey(const PrecomputeInput& input) const
+{
+	ContentHash hash;
+
+	// topology, which determines the Laplacian
+	hash.AddValue(input.TopologyHash);
+
+	// rest positions
+	const MPointArray& original = input.RestPoints;
+	hash.AddValue(original.length());
+	for (unsigned int i = 0; i < original.length(); i++)
+	{
+		hash.AddValue(original[i].x);
+		hash.AddValue(original[i].y);
+		hash.AddValue(original[i].z);
+	}
+
+	input.Weights.AddToHash(hash);
+
+	hash.AddValue(input.Smoothing.Amount);
+	hash.AddValue(input.Smoothing.Iteration);
+	hash.AddValue(input.Smoothing.IsImplicit);
+	hash.AddValue(input.Smoothing.IsMatrixFree);
+	hash.AddValue(input.Smoothing.PruneThreshold);
+	hash.AddValue(input.Smoothing.PruneRing);
+	hash.AddValue(input.Smoothing.NumEigenpairs);
+	hash.AddValue(input.Order);
+
+	return hash.Value();
+}
+
+void DeformerDDM::DeformPoints(
+	Variant variant,
+	MPointArray& points,
 	const MMatrix& worldToLocal,
-	MArrayDataHandle& transformsHandle,
-	MArrayDataHandle& bindHandle,
-	MArrayDataHandle& weightsHandle,
-	MStatus* ptrStat) const
+	const JointPalette& palette,
+	int numThreads)
 {
-	MPoint skinned;
+	if (!m_bind || m_bind->Weights.NumVertices() != points.length())
+	{
+		return;
+	}
 
-	MMatrix PsiM = MatrixUtil::ZeroMatrix();
+	// the rotations of the last call are reused only for the same vertices
+	double* rotationBases = nullptr;
+	bool warmStart = false;
+	if (m_isWarmStartEnabled && variant == Variant::v0)
+	{
+		const size_t basesSize = static_cast<size_t>(RotationBasisSize) * points.length();
+		if (m_rotationBases.size() != basesSize)
+		{
+			m_rotationBases.assign(basesSize, 0.0);
+			m_areRotationBasesValid = false;
+		}
+
+		rotationBases = m_rotationBases.data();
+		warmStart = m_areRotationBasesValid;
+	}
 
-	for (size_t idx = 0; idx < MaxInfluence; idx++)
+	// the kernels run on the points in the internal order of the Psi matrices
+	const VertexOrder& order = m_bind->Order;
+	MPointArray& internalPoints = order.IsIdentity() ? points : m_orderedPoints;
+	if (!order.IsIdentity())
 	{
-		// joint index
-		const int j = m_jointIdxs[vertIdx][idx];
-		if (j < 0)
+		order.Gather(points, m_orderedPoints, numThreads);
+	}
+
+	// the variant is resolved once here, so that the per-vertex loop has no dispatch
+	switch (variant)
+	{
+	case Variant::v0:
+		DeformBatches(numThreads, [&](auto numInfluencesTag, const uint32_t* vertIdxs, unsigned int numBatchVerts)
+			{
+				Deform<decltype(numInfluencesTag)::value>(
+					vertIdxs, numBatchVerts, internalPoints, worldToLocal, palette, rotationBases, warmStart);
+			});
+		break;
+	case Variant::v1:
+		DeformBuckets(internalPoints, numThreads, [&](auto numInfluencesTag, int vertIdx, const MPoint& pt)
+			{
+				return Deform_v1<decltype(numInfluencesTag)::value>(vertIdx, pt, worldToLocal, palette);
+			});
+		break;
+	case Variant::v2:
+		DeformBuckets(internalPoints, numThreads, [&](auto numInfluencesTag, int vertIdx, const MPoint& pt)
+			{
+				return Deform_v2<decltype(numInfluencesTag)::value>(vertIdx, pt, worldToLocal, palette);
+			});
+		break;
+	case Variant::v3:
+		DeformBuckets(internalPoints, numThreads, [&](auto numInfluencesTag, int vertIdx, const MPoint& pt)
+			{
+				return Deform_v3<decltype(numInfluencesTag)::value>(vertIdx, pt, worldToLocal, palette);
+			});
+		break;
+	case Variant::v4:
+		DeformBuckets(internalPoints, numThreads, [&](auto numInfluencesTag, int vertIdx, const MPoint& pt)
+			{
+				return Deform_v4<decltype(numInfluencesTag)::value>(vertIdx, pt, worldToLocal, palette);
+			});
+		break;
+	case Variant::v5:
+		DeformBuckets(internalPoints, numThreads, [&](auto numInfluencesTag, int vertIdx, const MPoint& pt)
+			{
+				return Deform_v5<decltype(numInfluencesTag)::value>(vertIdx, pt, worldToLocal, palette);
+			});
+		break;
+	default:
+		break;
+	}
+
+	if (!order.IsIdentity())
+	{
+		order.Scatter(m_orderedPoints, points, numThreads);
+	}
+
+	m_areRotationBasesValid = rotationBases != nullptr;
+}
+
+template <typename Kernel>
+void DeformerDDM::DeformBuckets(MPointArray& points, int numThreads, Kernel&& kernel) const
+{
+	m_bind->Weights.ForEachBucket([&](auto numInfluencesTag, const uint32_t* vertIdxs, unsigned int numBucketVerts)
+		{
+			ParallelUtil::ForEach(static_cast<int>(numBucketVerts), numThreads, [&](int i)
+				{
+					const int vertIdx = static_cast<int>(vertIdxs[i]);
+					points[vertIdx] = kernel(numInfluencesTag, vertIdx, points[vertIdx]);
+				});
+		});
+}
+
+template <typename Kernel>
+void DeformerDDM::DeformBatches(int numThreads, Kernel&& kernel) const
+{
+	m_bind->Weights.ForEachBucket([&](auto numInfluencesTag, const uint32_t* vertIdxs, unsigned int numBucketVerts)
 		{
-			continue;
+			ParallelUtil::ForEachChunk(static_cast<int>(numBucketVerts), numThreads, [&](int begin, int end)
+				{
+					for (int batchBegin = begin; batchBegin < end; batchBegin += RotationBatchSize)
+					{
+						const unsigned int numBatchVerts = std::min<unsigned int>(RotationBatchSize, end - batchBegin);
+						kernel(numInfluencesTag, vertIdxs + batchBegin, numBatchVerts);
+					}
+				});
+		});
+}
+
+template <unsigned int NumInfluences>
+void DeformerDDM::Deform(
+	const uint32_t* vertIdxs,
+	unsigned int numBatchVerts,
+	MPointArray& points,
+	const MMatrix& worldToLocal,
+	const JointPalette& palette,
+	double* rotationBases,
+	bool warmStart) const
+{
+	// 3x3 parts of Qpq in the layout of RotationKernel::ExtractRotations
+	double Qpqs[9 * RotationBatchSize];
+	double rotations[9 * RotationBatchSize];
+	double bases[RotationBasisSize * RotationBatchSize];
+	MPoint pis[RotationBatchSize];
+	MPoint qis[RotationBatchSize];
+
+	for (unsigned int i = 0; i < numBatchVerts; i++)
+	{
+		const int vertIdx = static_cast<int>(vertIdxs[i]);
+
+		MMatrix PsiM = MatrixUtil::ZeroMatrix();
+
+		const unsigned int numInfluences = NumInfluences > 0 ? NumInfluences : m_bind->Weights.NumInfluences(vertIdx);
+		const unsigned int begin = m_bind->Weights.Begin(vertIdx);
+		for (unsigned int idx = 0; idx < numInfluences; idx++)
+		{
+			// joint index
+			const uint32_t j = m_bind->Weights.Joint(begin + idx);
+
+			const MMatrix jointMat = palette.GetMMatrix(j);
+
+			const MMatrix Psi_ij = MatrixUtil::UnpackSymmetricMatrix(PackedPsi(begin + idx));
+			PsiM += Psi_ij * jointMat;
 		}
 
-		transformsHandle.jumpToElement(j); // jump to logical index
-		MMatrix jointMat = MFnMatrixData(transformsHandle.inputValue().data()).matrix();
+		MMatrix Qi = PsiM;
+		MPoint qi = PsiM[3];
+		qi.w = 0.0;
+		MPoint pi = (PsiM.transpose())[3];
+		pi.w = 0.0;
+		MMatrix Qpq = Qi - MatrixUtil::BuildMatrixFromMPoint(pi, qi); // Ă邯ǋt?
 
-		bindHandle.jumpToElement(j); // jump to logical index
-		MMatrix preBindMatrix = MFnMatrixData(bindHandle.inputValue().data()).matrix();
-		jointMat = preBindMatrix * jointMat;
+		for (unsigned int r = 0; r < 3; r++)
+		{
+			for (unsigned int c = 0; c < 3; c++)
+			{
+				Qpqs[(3 * r + c) * RotationBatchSize + i] = Qpq[r][c];
+			}
+		}
 
-		PsiM += m_psiMats[vertIdx][idx] * jointMat;
+		qi.w = 1.0;
+		pi.w = 1.0;
+		pis[i] = pi;
+		qis[i] = qi;
+
+		if (rotationBases)
+		{
+			for (unsigned int k = 0; k < RotationBasisSize; k++)
+			{
+				bases[k * RotationBatchSize + i] = rotationBases[RotationBasisSize * vertIdx + k];
+			}
+		}
 	}
 
+	// the closest rotation R to Qpq, in the row vector convention of MMatrix
+	RotationKernel::ExtractRotations(Qpqs, RotationBatchSize, numBatchVerts, rotations, rotationBases ? bases : nullptr, warmStart);
 
-	MMatrix Qi = PsiM;
-	MPoint qi = PsiM[3];
-	qi.w = 0.0;
-	MPoint pi = (PsiM.transpose())[3];
-	pi.w = 0.0;
-	MMatrix Qpq = Qi - MatrixUtil::BuildMatrixFromMPoint(pi, qi); // Ă邯ǋt?
-	
-	MMatrix u, vt;
-	MatrixUtil::SingularValueDecomposition(Qpq.transpose(), u, vt);
+	for (unsigned int i = 0; i < numBatchVerts; i++)
+	{
+		const int vertIdx = static_cast<int>(vertIdxs[i]);
 
-	u[3][3] = 1.0;
-	vt[3][3] = 1.0;
-	qi.w = 1.0;
-	pi.w = 1.0;
+		MMatrix R;
+		for (unsigned int r = 0; r < 3; r++)
+		{
+			for (unsigned int c = 0; c < 3; c++)
+			{
+				R[r][c] = rotations[(3 * r + c) * RotationBatchSize + i];
+			}
+		}
 
-	MMatrix R = vt.transpose() * u.transpose(); // tA]uKv
-	MPoint t = qi - pi * R;
-	t.w = 1.0;
+		MPoint t = qis[i] - pis[i] * R;
+		t.w = 1.0;
 
-	skinned = pt * R + t;
+		const MPoint skinned = points[vertIdx] * R + t;
+		points[vertIdx] = skinned * worldToLocal;
 
-	return skinned * worldToLocal;
+		if (rotationBases)
+		{
+			for (unsigned int k = 0; k < RotationBasisSize; k++)
+			{
+				rotationBases[RotationBasisSize * vertIdx + k] = bases[k * RotationBatchSize + i];
+			}
+		}
+	}
 }
 
-MPoint DeformerDDM::Deform_v1(int vertIdx, const MPoint& pt, const MMatrix& worldToLocal, MArrayDataHandle& transformsHandle, MArrayDataHandle& bindHandle, MArrayDataHandle& weightsHandle, MStatus* ptrStat) const
+template <unsigned int NumInfluences>
+MPoint DeformerDDM::Deform_v1(int vertIdx, const MPoint& pt, const MMatrix& worldToLocal, const JointPalette& palette) const
 {
 	MPoint skinned;
 
 	MMatrix PsiM = MatrixUtil::ZeroMatrix();
 	MMatrix Psi = MatrixUtil::ZeroMatrix();
 
-	for (size_t idx = 0; idx < MaxInfluence; idx++)
+	const unsigned int numInfluences = NumInfluences > 0 ? NumInfluences : m_bind->Weights.NumInfluences(vertIdx);
+	const unsigned int begin = m_bind->Weights.Begin(vertIdx);
+	for (unsigned int idx = 0; idx < numInfluences; idx++)
 	{
 		// joint index
-		const int j = m_jointIdxs[vertIdx][idx];
-		if (j < 0)
-		{
-			continue;
-		}
+		const uint32_t j = m_bind->Weights.Joint(begin + idx);
 
-		transformsHandle.jumpToElement(j); // jump to logical index
-		MMatrix jointMat = MFnMatrixData(transformsHandle.inputValue().data()).matrix();
+		const MMatrix jointMat = palette.GetMMatrix(j);
 
-		bindHandle.jumpToElement(j); // jump to logical index
-		MMatrix preBindMatrix = MFnMatrixData(bindHandle.inputValue().data()).matrix();
-		jointMat = preBindMatrix * jointMat;
+		const MMatrix Psi_ij = MatrixUtil::UnpackSymmetricMatrix(PackedPsi(begin + idx));
+		PsiM += Psi_ij * jointMat;
 
-		PsiM += m_psiMats[vertIdx][idx] * jointMat;
-
-		Psi += m_psiMats[vertIdx][idx];
+		Psi += Psi_ij;
 	}
 
 
@@ -223,7 +1185,8 @@ MPoint DeformerDDM::Deform_v1(int vertIdx, const MPoint& pt, const MMatrix& worl
 	return skinned * worldToLocal;
 }
 
-MPoint DeformerDDM::Deform_v2(int vertIdx, const MPoint& pt, const MMatrix& worldToLocal, MArrayDataHandle& transformsHandle, MArrayDataHandle& bindHandle, MArrayDataHandle& weightsHandle, MStatus* ptrStat) const
+template <unsigned int NumInfluences>
+MPoint DeformerDDM::Deform_v2(int vertIdx, const MPoint& pt, const MMatrix& worldToLocal, const JointPalette& palette) const
 {
 	MPoint skinned;
 
@@ -232,24 +1195,18 @@ MPoint DeformerDDM::Deform_v2(int vertIdx, const MPoint& pt, const MMatrix& worl
 	MPoint chi_omegaM;
 	MPoint chi;
 
-	for (size_t idx = 0; idx < MaxInfluence; idx++)
+	const unsigned int numInfluences = NumInfluences > 0 ? NumInfluences : m_bind->Weights.NumInfluences(vertIdx);
+	const unsigned int begin = m_bind->Weights.Begin(vertIdx);
+	for (unsigned int idx = 0; idx < numInfluences; idx++)
 	{
 		// joint index
-		const int j = m_jointIdxs[vertIdx][idx];
-		if (j < 0)
-		{
-			continue;
-		}
-
-		transformsHandle.jumpToElement(j); // jump to logical index
-		MMatrix jointMat = MFnMatrixData(transformsHandle.inputValue().data()).matrix();
+		const uint32_t j = m_bind->Weights.Joint(begin + idx);
 
-		bindHandle.jumpToElement(j); // jump to logical index
-		MMatrix preBindMatrix = MFnMatrixData(bindHandle.inputValue().data()).matrix();
-		jointMat = preBindMatrix * jointMat;
+		const MMatrix jointMat = palette.GetMMatrix(j);
 
-		const MMatrix& Psi_ij = m_psiMats[vertIdx][idx];
-		const float psi_ij = Psi_ij[3][3];
+		// psi_ij and chi_ij are the last row of Psi_ij, so the rest of the packed matrix is not read
+		const float* Psi_ij = PackedPsi(begin + idx);
+		const float psi_ij = Psi_ij[PackedPsi33];
 
 		const auto Mq_ij = psi_ij * MatrixUtil::MatrixToQuaternion(psi_ij * jointMat);
 		if (base.isEquivalent(MQuaternion(0,0,0,0)))
@@ -266,7 +1223,7 @@ MPoint DeformerDDM::Deform_v2(int vertIdx, const MPoint& pt, const MMatrix& worl
 			psiQ = psiQ + Mq_ij;
 		}
 
-		const MPoint chi_ij = Psi_ij[3];
+		const MPoint chi_ij(Psi_ij[PackedPsi03], Psi_ij[PackedPsi13], Psi_ij[PackedPsi23], Psi_ij[PackedPsi33]);
 		chi_omegaM += chi_ij * jointMat;
 		chi += chi_ij;
 	}
@@ -282,7 +1239,8 @@ MPoint DeformerDDM::Deform_v2(int vertIdx, const MPoint& pt, const MMatrix& worl
 	return skinned * worldToLocal;
 }
 
-MPoint DeformerDDM::Deform_v3(int vertIdx, const MPoint& pt, const MMatrix& worldToLocal, MArrayDataHandle& transformsHandle, MArrayDataHandle& bindHandle, MArrayDataHandle& weightsHandle, MStatus* ptrStat) const
+template <unsigned int NumInfluences>
+MPoint DeformerDDM::Deform_v3(int vertIdx, const MPoint& pt, const MMatrix& worldToLocal, const JointPalette& palette) const
 {
 	MPoint skinned;
 
@@ -290,27 +1248,21 @@ MPoint DeformerDDM::Deform_v3(int vertIdx, const MPoint& pt, const MMatrix& worl
 	MPoint chi_omegaM;
 	MPoint chi;
 
-	for (size_t idx = 0; idx < MaxInfluence; idx++)
+	const unsigned int numInfluences = NumInfluences > 0 ? NumInfluences : m_bind->Weights.NumInfluences(vertIdx);
+	const unsigned int begin = m_bind->Weights.Begin(vertIdx);
+	for (unsigned int idx = 0; idx < numInfluences; idx++)
 	{
 		// joint index
-		const int j = m_jointIdxs[vertIdx][idx];
-		if (j < 0)
-		{
-			continue;
-		}
-
-		transformsHandle.jumpToElement(j); // jump to logical index
-		MMatrix jointMat = MFnMatrixData(transformsHandle.inputValue().data()).matrix();
+		const uint32_t j = m_bind->Weights.Joint(begin + idx);
 
-		bindHandle.jumpToElement(j); // jump to logical index
-		MMatrix preBindMatrix = MFnMatrixData(bindHandle.inputValue().data()).matrix();
-		jointMat = preBindMatrix * jointMat;
+		const MMatrix jointMat = palette.GetMMatrix(j);
 
-		const MMatrix& Psi_ij = m_psiMats[vertIdx][idx];
-		const float psi_ij = Psi_ij[3][3];
+		// psi_ij and chi_ij are the last row of Psi_ij, so the rest of the packed matrix is not read
+		const float* Psi_ij = PackedPsi(begin + idx);
+		const float psi_ij = Psi_ij[PackedPsi33];
 		psiM += psi_ij * jointMat;
 
-		const MPoint chi_ij = Psi_ij[3];
+		const MPoint chi_ij(Psi_ij[PackedPsi03], Psi_ij[PackedPsi13], Psi_ij[PackedPsi23], Psi_ij[PackedPsi33]);
 		chi_omegaM += chi_ij * jointMat;
 		chi += chi_ij;
 	}
@@ -328,7 +1280,8 @@ MPoint DeformerDDM::Deform_v3(int vertIdx, const MPoint& pt, const MMatrix& worl
 	return skinned * worldToLocal;
 }
 
-MPoint DeformerDDM::Deform_v4(int vertIdx, const MPoint& pt, const MMatrix& worldToLocal, MArrayDataHandle& transformsHandle, MArrayDataHandle& bindHandle, MArrayDataHandle& weightsHandle, MStatus* ptrStat) const
+template <unsigned int NumInfluences>
+MPoint DeformerDDM::Deform_v4(int vertIdx, const MPoint& pt, const MMatrix& worldToLocal, const JointPalette& palette) const
 {
 	MPoint skinned;
 
@@ -337,24 +1290,18 @@ MPoint DeformerDDM::Deform_v4(int vertIdx, const MPoint& pt, const MMatrix& worl
 	MMatrix omegaM = MatrixUtil::ZeroMatrix();
 	MPoint pi;
 
-	for (size_t idx = 0; idx < MaxInfluence; idx++)
+	const unsigned int numInfluences = NumInfluences > 0 ? NumInfluences : m_bind->Weights.NumInfluences(vertIdx);
+	const unsigned int begin = m_bind->Weights.Begin(vertIdx);
+	for (unsigned int idx = 0; idx < numInfluences; idx++)
 	{
 		// joint index
-		const int j = m_jointIdxs[vertIdx][idx];
-		if (j < 0)
-		{
-			continue;
-		}
-
-		transformsHandle.jumpToElement(j); // jump to logical index
-		MMatrix jointMat = MFnMatrixData(transformsHandle.inputValue().data()).matrix();
+		const uint32_t j = m_bind->Weights.Joint(begin + idx);
 
-		bindHandle.jumpToElement(j); // jump to logical index
-		MMatrix preBindMatrix = MFnMatrixData(bindHandle.inputValue().data()).matrix();
-		jointMat = preBindMatrix * jointMat;
+		const MMatrix jointMat = palette.GetMMatrix(j);
 
-		const MMatrix& Psi_ij = m_psiMats[vertIdx][idx];
-		const float psi_ij = Psi_ij[3][3];
+		// psi_ij and chi_ij are the last row of Psi_ij, so the rest of the packed matrix is not read
+		const float* Psi_ij = PackedPsi(begin + idx);
+		const float psi_ij = Psi_ij[PackedPsi33];
 
 		const auto Mq_ij = psi_ij * MatrixUtil::MatrixToQuaternion(psi_ij * jointMat);
 		if (base.isEquivalent(MQuaternion(0, 0, 0, 0)))
@@ -372,7 +1319,7 @@ MPoint DeformerDDM::Deform_v4(int vertIdx, const MPoint& pt, const MMatrix& worl
 		}
 
 		omegaM += psi_ij * jointMat;
-		const MPoint chi_ij = Psi_ij[3];
+		const MPoint chi_ij(Psi_ij[PackedPsi03], Psi_ij[PackedPsi13], Psi_ij[PackedPsi23], Psi_ij[PackedPsi33]);
 		pi += chi_ij;
 	}
 
@@ -387,28 +1334,23 @@ MPoint DeformerDDM::Deform_v4(int vertIdx, const MPoint& pt, const MMatrix& worl
 	return skinned * worldToLocal;
 }
 
-MPoint DeformerDDM::Deform_v5(int vertIdx, const MPoint& pt, const MMatrix& worldToLocal, MArrayDataHandle& transformsHandle, MArrayDataHandle& bindHandle, MArrayDataHandle& weightsHandle, MStatus* ptrStat) const
+template <unsigned int NumInfluences>
+MPoint DeformerDDM::Deform_v5(int vertIdx, const MPoint& pt, const MMatrix& worldToLocal, const JointPalette& palette) const
 {
 	MPoint skinned;
 
-	for (size_t idx = 0; idx < MaxInfluence; idx++)
+	const unsigned int numInfluences = NumInfluences > 0 ? NumInfluences : m_bind->Weights.NumInfluences(vertIdx);
+	const unsigned int begin = m_bind->Weights.Begin(vertIdx);
+	for (unsigned int idx = 0; idx < numInfluences; idx++)
 	{
 		// joint index
-		const int j = m_jointIdxs[vertIdx][idx];
-		if (j < 0)
-		{
-			continue;
-		}
-
-		transformsHandle.jumpToElement(j); // jump to logical index
-		MMatrix jointMat = MFnMatrixData(transformsHandle.inputValue().data()).matrix();
+		const uint32_t j = m_bind->Weights.Joint(begin + idx);
 
-		bindHandle.jumpToElement(j); // jump to logical index
-		MMatrix preBindMatrix = MFnMatrixData(bindHandle.inputValue().data()).matrix();
-		jointMat = preBindMatrix * jointMat;
+		const MMatrix jointMat = palette.GetMMatrix(j);
 
-		const MMatrix& Psi_ij = m_psiMats[vertIdx][idx];
-		const float psi_ij = Psi_ij[3][3];
+		// psi_ij and chi_ij are the last row of Psi_ij, so the rest of the packed matrix is not read
+		const float* Psi_ij = PackedPsi(begin + idx);
+		const float psi_ij = Psi_ij[PackedPsi33];
 
 		skinned += (pt * jointMat) * psi_ij;
 	}
@@ -1,18 +1,39 @@
 #pragma once
+#include "JointPalette.h"
+#include "WeightTable.h"
+#include "MatrixUtil.h"
+#include "MeshLaplacian.h"
+#include "MeshTopology.h"
+#include "LaplacianEigenbasis.h"
+#include "VertexOrder.h"
 #include <maya/MMatrix.h>
 #include <maya/MPoint.h>
+#include <maya/MPointArray.h>
 #include <maya/MArrayDataHandle.h>
+#include <maya/MFnMesh.h>
+#include <maya/MString.h>
 #include <Eigen/Sparse>
 #include <Eigen/Core>
 #include <vector>
-#include <array>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <utility>
 
 
 class DeformerDDM
 {
 public:
 	DeformerDDM() = default;
-	~DeformerDDM() = default;
+
+	/// <summary>
+	/// cancels the background precomputation and waits for the worker thread
+	/// </summary>
+	~DeformerDDM();
 
 	struct SmoothingProperty
 	{
@@ -20,9 +41,33 @@ public:
 		int Iteration {0};
 		bool IsImplicit {false};
 
+		/// <summary>
+		/// entries of the smoothing matrix below this magnitude are dropped after each iteration (explicit smoothing only)
+		/// </summary>
+		double PruneThreshold {0.0};
+
+		/// <summary>
+		/// entries farther than this many rings from the vertex are dropped, zero means no limit (explicit smoothing only)
+		/// </summary>
+		int PruneRing {0};
+
+		/// <summary>
+		/// diffuse the moment fields of each joint over the mesh instead of building the smoothing matrix
+		/// (explicit smoothing only, and the pruning is not applied)
+		/// </summary>
+		bool IsMatrixFree {false};
+
+		/// <summary>
+		/// smooth with the lowest this many eigenpairs of the Laplacian instead of the smoothing matrix, zero disables it.
+		/// It applies to both the explicit and the implicit smoothing, and takes precedence over IsMatrixFree and the pruning
+		/// </summary>
+		int NumEigenpairs {0};
+
 		friend bool operator==(const SmoothingProperty& a, const SmoothingProperty& b)
 		{
-			return a.Amount == b.Amount && a.Iteration == b.Iteration && a.IsImplicit == b.IsImplicit;
+			return a.Amount == b.Amount && a.Iteration == b.Iteration && a.IsImplicit == b.IsImplicit
+				&& a.PruneThreshold == b.PruneThreshold && a.PruneRing == b.PruneRing && a.IsMatrixFree == b.IsMatrixFree
+				&& a.NumEigenpairs == b.NumEigenpairs;
 		}
 
 		friend bool operator!=(const SmoothingProperty& a, const SmoothingProperty& b)
@@ -35,73 +80,354 @@ public:
 	SmoothingProperty GetSmoothingProperty() const;
 
 	/// <summary>
-	/// Compute Psi matrices array
+	/// Directory of the precomputation cache files. Empty disables the cache.
 	/// </summary>
-	void Precompute(MObject& mesh, MArrayDataHandle& weightListsHandle, bool needRebindMesh);
+	void SetCacheDirectory(const std::string& directory);
 
-	MPoint Deform(
-		int vertIdx,
-		const MPoint& pt,
-		const MMatrix& worldToLocal,
-		MArrayDataHandle& transformsHandle,
-		MArrayDataHandle& bindHandle,
-		MArrayDataHandle& weightsHandle,
-		MStatus* ptrStat) const;
-
-	MPoint Deform_v1(
-		int vertIdx,
-		const MPoint& pt,
-		const MMatrix& worldToLocal,
-		MArrayDataHandle& transformsHandle,
-		MArrayDataHandle& bindHandle,
-		MArrayDataHandle& weightsHandle,
-		MStatus* ptrStat) const;
-
-	MPoint Deform_v2(
-		int vertIdx,
-		const MPoint& pt,
-		const MMatrix& worldToLocal,
-		MArrayDataHandle& transformsHandle,
-		MArrayDataHandle& bindHandle,
-		MArrayDataHandle& weightsHandle,
-		MStatus* ptrStat) const;
-
-	MPoint Deform_v3(
-		int vertIdx,
-		const MPoint& pt,
-		const MMatrix& worldToLocal,
-		MArrayDataHandle& transformsHandle,
-		MArrayDataHandle& bindHandle,
-		MArrayDataHandle& weightsHandle,
-		MStatus* ptrStat) const;
-
-	MPoint Deform_v4(
-		int vertIdx,
-		const MPoint& pt,
-		const MMatrix& worldToLocal,
-		MArrayDataHandle& transformsHandle,
-		MArrayDataHandle& bindHandle,
-		MArrayDataHandle& weightsHandle,
-		MStatus* ptrStat) const;
-
-	MPoint Deform_v5(
-		int vertIdx,
-		const MPoint& pt,
+	/// <summary>
+	/// Order of the vertices the precomputation and the deformation run in, which is computed at the next rebinding.
+	/// The Laplacian, the weights and the Psi matrices are stored in it, and DeformPoints only remaps the points on the input and the output
+	/// </summary>
+	void SetVertexOrder(VertexOrder::Kind kind);
+
+	/// <summary>
+	/// Keep the rotation fitted to each vertex by DDM (v0) for the next DeformPoints, and start the next fit from it.
+	/// The fit converges in fewer iterations when the pose changes only slightly, as in playback.
+	/// Disabling it releases the kept rotations.
+	/// </summary>
+	void SetWarmStart(bool enabled);
+
+	/// <summary>
+	/// Discard the kept rotations, so that the next DeformPoints fits them from scratch.
+	/// Call this when the pose may have jumped, e.g. the time has changed by more than a frame.
+	/// </summary>
+	void ResetWarmStart();
+
+	/// <summary>
+	/// Variants of the deformation, corresponding to DDM, DDM_v1, ..., DDM_v5 of the skinning method
+	/// </summary>
+	enum class Variant : int8_t
+	{
+		v0 = 0,
+		v1,
+		v2,
+		v3,
+		v4,
+		v5,
+	};
+
+	/// <summary>
+	/// Compute Psi matrices array, and publish them to DeformPoints right away.
+	/// A running background precomputation is cancelled first.
+	/// </summary>
+	/// <param name="mesh"></param>
+	/// <param name="weights"></param>
+	/// <param name="needRebindMesh"></param>
+	/// <param name="numThreads">zero means all the available threads</param>
+	void Precompute(MObject& mesh, const WeightTable& weights, bool needRebindMesh, int numThreads);
+
+	/// <summary>
+	/// Start computing the Psi matrices on the background worker, and return immediately.
+	/// The mesh is read here, so the worker does not touch Maya data, and a new request cancels the running one.
+	/// DeformPoints keeps using the previous Psi matrices until the new ones are published, and onPublished is called
+	/// on the worker thread right after that.
+	/// </summary>
+	/// <param name="mesh"></param>
+	/// <param name="weights"></param>
+	/// <param name="needRebindMesh"></param>
+	/// <param name="numThreads">zero means all the available threads</param>
+	/// <param name="onPublished">e.g. to mark the node dirty. It must be thread-safe</param>
+	void PrecomputeAsync(MObject& mesh, const WeightTable& weights, bool needRebindMesh, int numThreads, std::function<void()> onPublished);
+
+	/// <summary>
+	/// Swap in the latest published Psi matrices. Call this before DeformPoints.
+	/// </summary>
+	/// <param name="numVertices"># of vertices of the deformed geometry</param>
+	/// <param name="numJoints"># of entries of the palette passed to DeformPoints</param>
+	/// <returns>
+	/// true if Psi matrices for numVertices vertices are available, and every joint of the weights they were bound with is in the palette
+	/// </returns>
+	bool UpdateBindData(unsigned int numVertices, unsigned int numJoints);
+
+	/// <summary>
+	/// Whether there are Psi matrices to deform with, or a precomputation that will publish them is queued or running
+	/// </summary>
+	bool HasBindData();
+
+	/// <summary>
+	/// Deform all the points. Vertices are processed per bucket of the same # of influences,
+	/// so that each bucket runs the kernel unrolled for its influence count.
+	/// Points are left as they are if the Psi matrices have not been computed for this geometry.
+	/// </summary>
+	/// <param name="variant"></param>
+	/// <param name="points">[in, out] the array index must be the vertex index</param>
+	/// <param name="worldToLocal"></param>
+	/// <param name="palette"></param>
+	/// <param name="numThreads">zero means all the available threads</param>
+	void DeformPoints(
+		Variant variant,
+		MPointArray& points,
 		const MMatrix& worldToLocal,
-		MArrayDataHandle& transformsHandle,
-		MArrayDataHandle& bindHandle,
-		MArrayDataHandle& weightsHandle,
-		MStatus* ptrStat) const;
+		const JointPalette& palette,
+		int numThreads);
 
 private:
+	/// <summary>
+	/// # of vertices whose rotations are extracted together by Deform
+	/// </summary>
+	static constexpr unsigned int RotationBatchSize = 64;
+
+	/// <summary>
+	/// Kernel of DDM (v0) for a batch of at most RotationBatchSize vertices with NumInfluences influences.
+	/// The matrices to fit the rotations to are gathered for the whole batch and passed to RotationKernel::ExtractRotations at once.
+	/// </summary>
+	/// <param name="rotationBases">[in, out] RotationBasisSize elements per vertex for the warm start, or nullptr</param>
+	/// <param name="warmStart">start the fit from rotationBases</param>
+	template <unsigned int NumInfluences>
+	void Deform(
+		const uint32_t* vertIdxs,
+		unsigned int numBatchVerts,
+		MPointArray& points,
+		const MMatrix& worldToLocal,
+		const JointPalette& palette,
+		double* rotationBases,
+		bool warmStart) const;
+
+	/// <summary>
+	/// Kernels for the vertices with NumInfluences influences. NumInfluences = 0 reads the count at runtime.
+	/// </summary>
+	template <unsigned int NumInfluences>
+	MPoint Deform_v1(int vertIdx, const MPoint& pt, const MMatrix& worldToLocal, const JointPalette& palette) const;
+
+	template <unsigned int NumInfluences>
+	MPoint Deform_v2(int vertIdx, const MPoint& pt, const MMatrix& worldToLocal, const JointPalette& palette) const;
+
+	template <unsigned int NumInfluences>
+	MPoint Deform_v3(int vertIdx, const MPoint& pt, const MMatrix& worldToLocal, const JointPalette& palette) const;
+
+	template <unsigned int NumInfluences>
+	MPoint Deform_v4(int vertIdx, const MPoint& pt, const MMatrix& worldToLocal, const JointPalette& palette) const;
+
+	template <unsigned int NumInfluences>
+	MPoint Deform_v5(int vertIdx, const MPoint& pt, const MMatrix& worldToLocal, const JointPalette& palette) const;
+
+	/// <summary>
+	/// Run kernel(numInfluencesTag, vertIdx, pt) on all the points bucket by bucket
+	/// </summary>
+	template <typename Kernel>
+	void DeformBuckets(MPointArray& points, int numThreads, Kernel&& kernel) const;
+
+	/// <summary>
+	/// Run kernel(numInfluencesTag, vertIdxs, numBatchVerts) on the batches of at most RotationBatchSize vertices of each bucket
+	/// </summary>
+	template <typename Kernel>
+	void DeformBatches(int numThreads, Kernel&& kernel) const;
+
+	/// <summary>
+	/// Result of a precomputation, which is never modified once published, so that the worker and DeformPoints can share it
+	/// </summary>
+	struct BindData
+	{
+		/// <summary>
+		/// weights used to compute the Psi matrices. Its influence buckets decide the kernel run for each vertex.
+		/// </summary>
+		WeightTable Weights;
+
+		/// <summary>
+		/// Psi matrix of each influence, in the same CSR layout as Weights.
+		/// Psi is symmetric, so only its upper triangle is stored as MatrixUtil::NumSymmetricElements floats.
+		/// </summary>
+		std::vector<float> Psi;
+
+		/// <summary>
+		/// internal order of the vertices Weights and Psi are stored in
+		/// </summary>
+		VertexOrder Order;
+
+		/// <summary>
+		/// hash of the rest positions and the version of the smoothing the Psi matrices are computed with,
+		/// which have to be the same for the incremental update
+		/// </summary>
+		uint64_t RestPoseHash {0};
+		uint64_t SmoothingVersion {0};
+	};
+
+	/// <summary>
+	/// Psi matrices DeformPoints uses, only accessed from the thread calling DeformPoints
+	/// </summary>
+	std::shared_ptr<const BindData> m_bind;
+
+	/// <summary>
+	/// indices of the last row of Psi in the packed matrix
+	/// </summary>
+	static constexpr unsigned int PackedPsi03 = 3;
+	static constexpr unsigned int PackedPsi13 = 6;
+	static constexpr unsigned int PackedPsi23 = 8;
+	static constexpr unsigned int PackedPsi33 = 9;
+
+	const float* PackedPsi(unsigned int entryIdx) const
+	{
+		return &m_bind->Psi[MatrixUtil::NumSymmetricElements * entryIdx];
+	}
+
+	/// <summary>
+	/// quaternion of the basis of each vertex the rotation is fitted in (see RotationKernel::ExtractRotations), kept for the warm start
+	/// </summary>
+	static constexpr unsigned int RotationBasisSize = 4;
+	std::vector<double> m_rotationBases;
+
+	/// <summary>
+	/// points in the internal order of m_bind, kept to avoid the allocations on every frame
+	/// </summary>
+	MPointArray m_orderedPoints;
+
+	bool m_isWarmStartEnabled = false;
+
+	/// <summary>
+	/// m_rotationBases holds the result of the last DeformPoints for the current Psi matrices
+	/// </summary>
+	bool m_areRotationBasesValid = false;
+
+	/// <summary>
+	/// Inputs of a precomputation, read from Maya on the calling thread so that it can run on the worker
+	/// </summary>
+	struct PrecomputeInput
+	{
+		MPointArray RestPoints;
+
+		/// <summary>
+		/// polygons and adjacency in the order of the mesh, only read if HasTopology is set
+		/// </summary>
+		MeshTopology Topology;
+
+		/// <summary>
+		/// whether Topology has been read for this job. Otherwise the worker keeps using the topology of the previous jobs
+		/// </summary>
+		bool HasTopology = false;
+
+		/// <summary>
+		/// hash of the face-vertex connectivity in the internal order, only set by ComputeBindData if the cache is enabled
+		/// </summary>
+		uint64_t TopologyHash = 0;
+
+		VertexOrder::Kind Order = VertexOrder::Kind::Original;
+
+		WeightTable Weights;
+		bool NeedRebindMesh = false;
+		SmoothingProperty Smoothing;
+		std::string CacheDirectory;
+		int NumThreads = 0;
+	};
+
+	/// <summary>
+	/// read the inputs of the precomputation from the mesh. The topology is only read if the worker needs a new copy of it
+	/// </summary>
+	void ReadPrecomputeInput(
+		MObject& mesh, const WeightTable& weights, bool needRebindMesh, int numThreads, PrecomputeInput& input);
+
+	/// <summary>
+	/// Compute the Psi matrices into m_precomputed, only accessed by one thread at a time (the worker, or Precompute after stopping it)
+	/// </summary>
+	/// <param name="input">reordered in place into the internal order</param>
+	/// <param name="generation">the computation stops as soon as m_generation is incremented from this</param>
+	/// <returns>false if cancelled or failed, in which case m_precomputed is not updated</returns>
+	bool ComputeBindData(PrecomputeInput& input, uint64_t generation);
+
+	/// <summary>
+	/// make m_precomputed the Psi matrices the next UpdateBindData swaps in
+	/// </summary>
+	void Publish();
+
+	/// <summary>
+	/// Queue a message of the precomputation, which UpdateBindData displays on the main thread since the Maya API is not thread safe
+	/// </summary>
+	void QueueMessage(const MString& message, bool isError);
+
+	/// <summary>
+	/// Stop the running job and discard the queued one, and wait until the worker becomes idle
+	/// </summary>
+	void CancelPrecompute();
+
+	/// <summary>
+	/// worker thread, which runs the queued job one at a time
+	/// </summary>
+	void RunWorker();
+
+	/// <summary>
+	/// the smoothing property and the cache directory for the next precomputation
+	/// </summary>
+	SmoothingProperty m_requestedSmoothingProp;
+	std::string m_cacheDirectory;
+	VertexOrder::Kind m_requestedVertexOrder = VertexOrder::Kind::Original;
+
+	/// <summary>
+	/// the next job has to carry the topology, since no job has or a discarded one did. The vertex order of the last job tells
+	/// when the worker has to reorder the topology. Both are only accessed from the thread calling Precompute and PrecomputeAsync
+	/// </summary>
+	bool m_needsTopology = true;
+	VertexOrder::Kind m_sentVertexOrder = VertexOrder::Kind::Original;
+
+	/// <summary>
+	/// the last result of ComputeBindData, which the next one is updated incrementally from
+	/// </summary>
+	std::shared_ptr<const BindData> m_precomputed;
+
+	/// <summary>
+	/// the latest result for UpdateBindData, guarded by m_mutex
+	/// </summary>
+	std::shared_ptr<const BindData> m_published;
+
+	std::thread m_worker;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
 
-	static constexpr size_t MaxInfluence = 8;
+	/// <summary>
+	/// the next job of the worker and its callback, guarded by m_mutex
+	/// </summary>
+	std::unique_ptr<PrecomputeInput> m_queuedJob;
+	std::function<void()> m_queuedOnPublished;
+	bool m_isJobRunning = false;
+	bool m_isWorkerExiting = false;
 
-	std::vector<std::array<MMatrix, MaxInfluence>> m_psiMats;
-	std::vector<std::array<int32_t, MaxInfluence>> m_jointIdxs;
+	/// <summary>
+	/// a requested rebinding has not been published yet, guarded by m_mutex
+	/// </summary>
+	bool m_isRebindPending = false;
 
+	/// <summary>
+	/// messages of QueueMessage and whether they are errors, guarded by m_mutex
+	/// </summary>
+	std::vector<std::pair<MString, bool>> m_messages;
+
+	/// <summary>
+	/// incremented by every request, so that the running job can tell it is stale
+	/// </summary>
+	std::atomic<uint64_t> m_generation {0};
+
+	/// <summary>
+	/// Everything below is the state of the precomputation, only accessed in ComputeBindData
+	/// </summary>
 	SmoothingProperty m_smoothingProp;
 
+	/// <summary>
+	/// internal order of the vertices, computed at the rebinding, and the kind and the # of vertices it was computed for
+	/// </summary>
+	VertexOrder m_order;
+	VertexOrder::Kind m_orderKind = VertexOrder::Kind::Original;
+	unsigned int m_orderNumVertices = 0;
+
+	/// <summary>
+	/// topology of the mesh in the internal order, taken from the last job that carried one, and its hash for the cache
+	/// </summary>
+	MeshTopology m_topology;
+	uint64_t m_topologyHash = 0;
+	bool m_isTopologyHashValid = false;
+
+	/// <summary>
+	/// Hash of all the inputs of Precompute: topology, rest positions, weights and the smoothing property
+	/// </summary>
+	uint64_t ComputeCacheKey(const PrecomputeInput& input) const;
+
 	/// <summary>
 	/// Laplacian matrix, which is determined by the mesh topology
 	/// </summary>
@@ -112,8 +438,53 @@ private:
 	/// </summary>
 	Eigen::SparseMatrix<double> m_smoothingMat;
 
+	/// <summary>
+	/// Factorization of the implicit smoothing, which is used instead of the smoothing matrix when SmoothingProperty::IsImplicit is set.
+	/// m_smoothingMat is then kept empty with the size of the mesh.
+	/// </summary>
+	ImplicitSmoothing m_implicitSmoothing;
+
+	/// <summary>
+	/// Compute the Psi matrices of the implicit smoothing by smoothing the moment fields w_kj * u_k * u_k^t of each joint j
+	/// </summary>
+	/// <param name="isJointDirty">the joints whose entries are computed, empty for all the joints. The other entries are left as they are</param>
+	void AccumulatePsiImplicitly(const MPointArray& original, const WeightTable& weights, const std::vector<uint8_t>& isJointDirty,
+		const std::function<bool()>& isCancelled, int numThreads, std::vector<double>& psiAcc) const;
+
+	/// <summary>
+	/// One step of the explicit smoothing I - lambda * L, which is used instead of the smoothing matrix when SmoothingProperty::IsMatrixFree is set
+	/// </summary>
+	Eigen::SparseMatrix<double> m_smoothingStep;
+
+	/// <summary>
+	/// Compute the Psi matrices of the explicit smoothing by diffusing the moment fields of each joint with m_smoothingStep,
+	/// within the rings of its influence the result depends on
+	/// </summary>
+	/// <param name="isJointDirty">the joints whose entries are computed, empty for all the joints. The other entries are left as they are</param>
+	void AccumulatePsiByDiffusion(const MPointArray& original, const WeightTable& weights, const std::vector<uint8_t>& isJointDirty,
+		const std::function<bool()>& isCancelled, int numThreads, std::vector<double>& psiAcc) const;
+
+	/// <summary>
+	/// Lowest eigenpairs of the Laplacian, which are used instead of the smoothing matrix when SmoothingProperty::NumEigenpairs is set.
+	/// They only depend on the topology, so they are kept in the cache directory apart from the Psi matrices
+	/// </summary>
+	LaplacianEigenbasis m_eigenbasis;
+
+	/// <summary>
+	/// Compute the Psi matrices of the low-rank smoothing by projecting the moment fields of each joint onto m_eigenbasis,
+	/// which only touches the vertices of its influence
+	/// </summary>
+	/// <param name="isJointDirty">the joints whose entries are computed, empty for all the joints. The other entries are left as they are</param>
+	void AccumulatePsiSpectrally(const MPointArray& original, const WeightTable& weights, const std::vector<uint8_t>& isJointDirty,
+		const std::function<bool()>& isCancelled, int numThreads, std::vector<double>& psiAcc) const;
+
 	/// <summary>
 	/// dirty flag for recoputation of the smoothing matrix
 	/// </summary>
 	bool m_isSmoothingMatDirty = true;
+
+	/// <summary>
+	/// incremented whenever the smoothing is recomputed or loaded from the cache
+	/// </summary>
+	uint64_t m_smoothingVersion = 0;
 };
\ No newline at end of file
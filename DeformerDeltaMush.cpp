@@ -2,8 +2,17 @@
 #include <maya/MFnMatrixData.h>
 #include <maya/MFnMesh.h>
 #include <maya/MDataHandle.h>
-#include <maya/MItMeshVertex.h>
+#include "ParallelUtil.h"
 #include <assert.h>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define DELTA_MUSH_SSE 1
+#include <emmintrin.h>
+#endif
 
 DeformerDeltaMush::DeformerDeltaMush()
 	: targetPos()
@@ -18,25 +27,12 @@ MStatus DeformerDeltaMush::InitializeData(MObject& mesh)
 	MStatus stat;
 
 	// _Ƃ̃f[^z
-	dataPoints.clear();
+	dataPoints = std::vector<PointData>();
 
 	// _̗אڏi[
-	MItMeshVertex iter(mesh);
-	for (iter.reset(); !iter.isDone(); iter.next())
-	{
-		PointData pd;
-		
-		// אڒ_CfbNX擾
-		iter.getConnectedVertices(pd.NeighbourIndices);
-
-		// אڒ_
-		pd.NeighbourNum = pd.NeighbourIndices.length();
-
-		// אڒ_Ƃ delta ێz
-		pd.Delta.setLength(pd.NeighbourNum);
-
-		dataPoints.push_back(std::move(pd));
-	}
+	// the neighbours around each vertex, so that consecutive ones share a face for the tangent matrices
+	stat = topology.Build(mesh);
+	CHECK_MSTATUS_AND_RETURN_IT(stat);
 
 	MFnMesh meshFn(mesh);
 
@@ -44,12 +40,105 @@ MStatus DeformerDeltaMush::InitializeData(MObject& mesh)
 	MPointArray posOriginal;
 	meshFn.getPoints(posOriginal, MSpace::kObject);
 
+	// everything below is computed in the internal order, and only the inputs and outputs of ApplyDeltaMush are remapped
+	vertexOrder.Compute(vertexOrderKind, topology, posOriginal);
+	if (!vertexOrder.IsIdentity())
+	{
+		topology.Permute(vertexOrder.NewToOld());
+		MPointArray posInternal;
+		vertexOrder.Gather(posOriginal, posInternal);
+		posOriginal = posInternal;
+	}
+
+	topology.GetNeighboursAroundVertices(adjacencyIndices);
+
+	const uint32_t numTopologyVerts = topology.NumVertices();
+	inverseDegrees.resize(numTopologyVerts);
+	for (uint32_t vertIdx = 0; vertIdx < numTopologyVerts; vertIdx++)
+	{
+		const uint32_t degree = topology.Degree(vertIdx);
+		inverseDegrees[vertIdx] = degree > 0 ? 1.0f / degree : 0.0f;
+	}
+
+	// the single frame only keeps the fixed-size FrameData of each vertex
+	if (tangentFrame == TangentFrame::PerNeighbour)
+	{
+		dataPoints.resize(numTopologyVerts);
+		for (uint32_t vertIdx = 0; vertIdx < numTopologyVerts; vertIdx++)
+		{
+			PointData& pd = dataPoints[vertIdx];
+
+			// אڒ_
+			pd.NeighbourNum = topology.Degree(vertIdx);
+
+			// אڒ_Ƃ delta ێz
+			pd.Delta.setLength(pd.NeighbourNum);
+		}
+	}
+
 	// Smoothing  (posSmoothed vZ)
+	using Clock = std::chrono::steady_clock;
+	smoothingReport = SmoothingReport();
+	chebyshevCoeffs.clear();
+	implicitSmoothing.Clear();
+	if (isImplicit && smoothingData.Iter > 0)
+	{
+		// (I + lambda * L) only depends on the topology, so it is factorized once here
+		const Clock::time_point start = Clock::now();
+		Eigen::SparseMatrix<double> laplacian;
+		topology.ComputeLaplacian(laplacian);
+		smoothingReport.IsImplicit = implicitSmoothing.Compute(laplacian, smoothingData.Amount * smoothingData.Iter, 1);
+		smoothingReport.FactorizationTime = std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	if (smoothingReport.IsImplicit)
+	{
+		smoothingReport.NumPasses = 1;
+	}
+	else
+	{
+		FitChebyshev(smoothingData.Iter, smoothingData.Amount, chebyshevTolerance, chebyshevCoeffs, smoothingReport.ResponseError);
+		smoothingReport.NumPasses = chebyshevCoeffs.empty() ? smoothingData.Iter : static_cast<uint32_t>(chebyshevCoeffs.size() - 1);
+	}
+
 	MPointArray posSmoothed;
+	Clock::time_point start = Clock::now();
 	ComputeSmoothedPoints(posOriginal, posSmoothed);
+	smoothingReport.SmoothingTime = std::chrono::duration<double>(Clock::now() - start).count();
+	smoothingReport.PlainSmoothingTime = smoothingReport.SmoothingTime;
+
+	// deviation of the chosen engine from the plain iteration at the rest pose, relative to the size of the mesh
+	if (smoothingReport.IsImplicit || !chebyshevCoeffs.empty())
+	{
+		MPointArray posPlain;
+		start = Clock::now();
+		ComputeSmoothedPoints(posOriginal, posPlain, 0, true);
+		smoothingReport.PlainSmoothingTime = std::chrono::duration<double>(Clock::now() - start).count();
+
+		MPoint lower = posOriginal.length() > 0 ? posOriginal[0] : MPoint();
+		MPoint upper = lower;
+		for (unsigned int vertIdx = 0; vertIdx < posOriginal.length(); vertIdx++)
+		{
+			const MPoint& p = posOriginal[vertIdx];
+			lower = MPoint(std::min(lower.x, p.x), std::min(lower.y, p.y), std::min(lower.z, p.z));
+			upper = MPoint(std::max(upper.x, p.x), std::max(upper.y, p.y), std::max(upper.z, p.z));
+			smoothingReport.MaxDeviation = std::max(smoothingReport.MaxDeviation, (posSmoothed[vertIdx] - posPlain[vertIdx]).length());
+		}
+		const double diagonal = (upper - lower).length();
+		smoothingReport.MaxDeviation = diagonal > 0.0 ? smoothingReport.MaxDeviation / diagonal : 0.0;
+	}
 
 	// Delta vZ dataPoints Ɋi[
-	ComputeDelta(posOriginal, posSmoothed);
+	if (tangentFrame == TangentFrame::Single)
+	{
+		ComputeFrameDelta(posOriginal, posSmoothed, 0);
+	}
+	else
+	{
+		frameData = std::vector<FrameData>();
+
+		ComputeDelta(posOriginal, posSmoothed);
+	}
 
 	isInitialized = true;
 
@@ -62,7 +151,20 @@ MStatus DeformerDeltaMush::InitializeData(MObject& mesh, uint32_t smoothingIter,
 	return InitializeData(mesh);
 }
 
-void DeformerDeltaMush::ApplyDeltaMush(const MPointArray& skinned, MPointArray& deformed) const
+void DeformerDeltaMush::ApplyDeltaMush(const MPointArray& skinned, MPointArray& deformed, int numThreads) const
+{
+	if (vertexOrder.IsIdentity())
+	{
+		ApplyDeltaMushInOrder(skinned, deformed, numThreads);
+		return;
+	}
+
+	vertexOrder.Gather(skinned, orderedSkinned, numThreads);
+	ApplyDeltaMushInOrder(orderedSkinned, orderedDeformed, numThreads);
+	vertexOrder.Scatter(orderedDeformed, deformed, numThreads);
+}
+
+void DeformerDeltaMush::ApplyDeltaMushInOrder(const MPointArray& skinned, MPointArray& deformed, int numThreads) const
 {
 	// NOTE: skinned ̓[hWnł̒_ʒuƑz
 
@@ -73,39 +175,97 @@ void DeformerDeltaMush::ApplyDeltaMush(const MPointArray& skinned, MPointArray&
 
 	const uint32_t numVerts = skinned.length();
 	deformed.setLength(numVerts);
+	const std::vector<uint32_t>& adjacencyOffsets = topology.AdjacencyOffsets();
 
 	// compute mush
 	MPointArray mushed;
-	ComputeSmoothedPoints(skinned, mushed);
+	ComputeSmoothedPoints(skinned, mushed, numThreads);
 
-	// apply delta to mush
-	for (uint32_t vertIdx = 0; vertIdx < numVerts; vertIdx++)
+	if (tangentFrame == TangentFrame::Single)
 	{
-		const PointData& pointData = dataPoints[vertIdx];
+		std::vector<MVector> faceNormals;
+		ComputeFaceNormals(mushed, faceNormals, numThreads);
 
-		// compute delta in animated pose
-		MVector delta = MVector::zero;
+		// rotate the delta by the frame of the mushed positions. The frame is orthonormal, so the length is kept
+		ParallelUtil::ForEach(static_cast<int>(numVerts), numThreads, [&](int vertIdx)
+			{
+				const FrameData& data = frameData[vertIdx];
 
-		// looping the neighbours
-		for (uint32_t neighborIdx = 0; neighborIdx < pointData.NeighbourNum - 1; neighborIdx++)
+				MVector t, b, n;
+				ComputeVertexFrame(vertIdx, data.TangentNeighbour, mushed, faceNormals, t, b, n);
+				const MVector delta = t * data.Delta.x + b * data.Delta.y + n * data.Delta.z;
+
+				const MPoint deltaMushed = mushed[vertIdx] + delta * applyDelta;
+				deformed[vertIdx] = skinned[vertIdx] + envelope * (deltaMushed - skinned[vertIdx]);
+			});
+		return;
+	}
+
+	// apply delta to mush. Each vertex only writes its own position
+	ParallelUtil::ForEach(static_cast<int>(numVerts), numThreads, [&](int vertIdx)
 		{
-			MMatrix mat = ComputeTangentMatrix(
-				mushed[vertIdx],
-				mushed[pointData.NeighbourIndices[neighborIdx]],
-				mushed[pointData.NeighbourIndices[neighborIdx + 1]]);
+			const PointData& pointData = dataPoints[vertIdx];
+			const uint32_t* neighbourIndices = &adjacencyIndices[adjacencyOffsets[vertIdx]];
 
-			delta += (pointData.Delta[neighborIdx] * mat);
-		}
-		delta /= static_cast<double>(pointData.NeighbourNum);
+			// compute delta in animated pose
+			MVector delta = MVector::zero;
+
+			// looping the neighbours
+			for (uint32_t neighborIdx = 0; neighborIdx < pointData.NeighbourNum - 1; neighborIdx++)
+			{
+				MMatrix mat = ComputeTangentMatrix(
+					mushed[vertIdx],
+					mushed[neighbourIndices[neighborIdx]],
+					mushed[neighbourIndices[neighborIdx + 1]]);
+
+				delta += (pointData.Delta[neighborIdx] * mat);
+			}
+			delta /= static_cast<double>(pointData.NeighbourNum);
 
-		// delta ̒킹
-		delta = delta.normal() * pointData.DeltaLength;
+			// delta ̒킹
+			delta = delta.normal() * pointData.DeltaLength;
 
-		// add delta to mush
-		MPoint deltaMushed = mushed[vertIdx] + delta * applyDelta;
+			// add delta to mush
+			MPoint deltaMushed = mushed[vertIdx] + delta * applyDelta;
 
-		// envelope l
-		deformed[vertIdx] = skinned[vertIdx] + envelope * (deltaMushed - skinned[vertIdx]);
+			// envelope l
+			deformed[vertIdx] = skinned[vertIdx] + envelope * (deltaMushed - skinned[vertIdx]);
+		});
+}
+
+void DeformerDeltaMush::SetTangentFrame(TangentFrame frame)
+{
+	if (tangentFrame != frame)
+	{
+		tangentFrame = frame;
+		isInitialized = false;
+	}
+}
+
+void DeformerDeltaMush::SetChebyshevTolerance(double tolerance)
+{
+	if (chebyshevTolerance != tolerance)
+	{
+		chebyshevTolerance = tolerance;
+		isInitialized = false;
+	}
+}
+
+void DeformerDeltaMush::SetImplicit(bool implicit)
+{
+	if (isImplicit != implicit)
+	{
+		isImplicit = implicit;
+		isInitialized = false;
+	}
+}
+
+void DeformerDeltaMush::SetVertexOrder(VertexOrder::Kind kind)
+{
+	if (vertexOrderKind != kind)
+	{
+		vertexOrderKind = kind;
+		isInitialized = false;
 	}
 }
 
@@ -117,38 +277,227 @@ void DeformerDeltaMush::SetSmoothingData(uint32_t iter, double amount)
 	isInitialized = false;
 }
 
-void DeformerDeltaMush::ComputeSmoothedPoints(const MPointArray& src, MPointArray& smoothed) const
+void DeformerDeltaMush::ComputeSmoothedPoints(const MPointArray& src, MPointArray& smoothed, int numThreads, bool isPlain) const
 {
 	const uint32_t numVerts = src.length();
 	smoothed.setLength(numVerts);
 
-	MPointArray srcCopy;
-	srcCopy.copy(src);
+	if (!isPlain && implicitSmoothing.NumVertices() == static_cast<Eigen::Index>(numVerts) && numVerts > 0)
+	{
+		// one forward and back substitution per coordinate with the factorization of bind
+		implicitFields.resize(numVerts, 3);
+		ParallelUtil::ForEach(static_cast<int>(numVerts), numThreads, [&](int vertIdx)
+			{
+				implicitFields(vertIdx, 0) = src[vertIdx].x;
+				implicitFields(vertIdx, 1) = src[vertIdx].y;
+				implicitFields(vertIdx, 2) = src[vertIdx].z;
+			});
+
+		implicitSmoothing.ApplyTransposed(implicitFields);
+
+		// the normalized Laplacian scales isolated vertices by 1 / (1 + lambda), but they stay in place as in the passes
+		ParallelUtil::ForEach(static_cast<int>(numVerts), numThreads, [&](int vertIdx)
+			{
+				smoothed[vertIdx] = inverseDegrees[vertIdx] > 0.0f
+					? MPoint(implicitFields(vertIdx, 0), implicitFields(vertIdx, 1), implicitFields(vertIdx, 2))
+					: src[vertIdx];
+			});
+		return;
+	}
 
-	for (uint32_t itr = 0; itr < smoothingData.Iter; itr++)
+	for (std::vector<float>& buffer : smoothingBuffers)
 	{
-		for (uint32_t vertIdx = 0; vertIdx < numVerts; vertIdx++)
+		buffer.resize(static_cast<size_t>(BufferStride) * numVerts);
+	}
+	std::vector<float>* current = &smoothingBuffers[0];
+	std::vector<float>* next = &smoothingBuffers[1];
+
+	ParallelUtil::ForEach(static_cast<int>(numVerts), numThreads, [&](int vertIdx)
 		{
-			const PointData& pointData = dataPoints[vertIdx];
+			float* dst = current->data() + static_cast<size_t>(BufferStride) * vertIdx;
+			dst[0] = static_cast<float>(src[vertIdx].x);
+			dst[1] = static_cast<float>(src[vertIdx].y);
+			dst[2] = static_cast<float>(src[vertIdx].z);
+			dst[3] = 0.0f;
+		});
+
+	const std::vector<float>* result = current;
+	if (isPlain || chebyshevCoeffs.empty())
+	{
+		// move each vertex toward the average of its neighbours: x' = (1 - amount) * x + amount * M * x
+		const float amount = static_cast<float>(smoothingData.Amount);
+		for (uint32_t itr = 0; itr < smoothingData.Iter; itr++)
+		{
+			SmoothingStep(current->data(), nullptr, next->data(), nullptr, amount, 1.0f - amount, 0.0f, 0.0f, numThreads);
+			std::swap(current, next);
+		}
+		result = current;
+	}
+	else
+	{
+		// sum of c_k * T_k(L - I) * x, where T_k(L - I) = T_k(-M) follows T_k+1 = -2 * M * T_k - T_k-1
+		std::vector<float>* previous = &smoothingBuffers[2];
+		std::vector<float>* accumulated = &smoothingBuffers[3];
+
+		const float c0 = static_cast<float>(chebyshevCoeffs[0]);
+		ParallelUtil::ForEach(static_cast<int>(numVerts) * BufferStride, numThreads, [&](int idx)
+			{
+				(*accumulated)[idx] = c0 * (*current)[idx];
+			});
+
+		for (size_t k = 1; k < chebyshevCoeffs.size(); k++)
+		{
+			const float coeff = static_cast<float>(chebyshevCoeffs[k]);
+			if (k == 1)
+			{
+				SmoothingStep(current->data(), nullptr, next->data(), accumulated->data(), -1.0f, 0.0f, 0.0f, coeff, numThreads);
+			}
+			else
+			{
+				SmoothingStep(current->data(), previous->data(), next->data(), accumulated->data(), -2.0f, 0.0f, -1.0f, coeff, numThreads);
+			}
+
+			// rotate T_k-1 <- T_k <- T_k+1
+			std::swap(previous, current);
+			std::swap(current, next);
+		}
+		result = accumulated;
+	}
 
-			// אڒ_̕ςƂăX[WO
-			MVector smoothedPos = MVector::zero;
-			for (const int neighbourIdx : pointData.NeighbourIndices)
+	ParallelUtil::ForEach(static_cast<int>(numVerts), numThreads, [&](int vertIdx)
+		{
+			const float* pos = result->data() + static_cast<size_t>(BufferStride) * vertIdx;
+			smoothed[vertIdx] = MPoint(pos[0], pos[1], pos[2]);
+		});
+}
+
+void DeformerDeltaMush::SmoothingStep(
+	const float* cur, const float* prev, float* next, float* accumulated,
+	float alpha, float beta, float gamma, float coeff, int numThreads) const
+{
+	const uint32_t numVerts = static_cast<uint32_t>(inverseDegrees.size());
+	const std::vector<uint32_t>& adjacencyOffsets = topology.AdjacencyOffsets();
+
+	// Each step only reads the buffers of the previous steps
+	ParallelUtil::ForEachChunk(static_cast<int>(numVerts), numThreads, [&](int begin, int end)
+		{
+			for (int vertIdx = begin; vertIdx < end; vertIdx++)
 			{
-				smoothedPos += srcCopy[neighbourIdx];
+				const size_t offset = static_cast<size_t>(BufferStride) * vertIdx;
+				const float* pos = cur + offset;
+				float* dst = next + offset;
+				const uint32_t adjBegin = adjacencyOffsets[vertIdx];
+				const uint32_t adjEnd = adjacencyOffsets[vertIdx + 1];
+
+#if defined(DELTA_MUSH_SSE)
+				// average of the neighbours, or the vertex itself if it is isolated
+				const __m128 p = _mm_loadu_ps(pos);
+				__m128 average = p;
+				if (adjBegin != adjEnd)
+				{
+					__m128 sum = _mm_setzero_ps();
+					for (uint32_t aIdx = adjBegin; aIdx < adjEnd; aIdx++)
+					{
+						sum = _mm_add_ps(sum, _mm_loadu_ps(cur + static_cast<size_t>(BufferStride) * adjacencyIndices[aIdx]));
+					}
+					average = _mm_mul_ps(sum, _mm_set1_ps(inverseDegrees[vertIdx]));
+				}
+
+				__m128 result = _mm_add_ps(_mm_mul_ps(average, _mm_set1_ps(alpha)), _mm_mul_ps(p, _mm_set1_ps(beta)));
+				if (prev)
+				{
+					result = _mm_add_ps(result, _mm_mul_ps(_mm_loadu_ps(prev + offset), _mm_set1_ps(gamma)));
+				}
+				_mm_storeu_ps(dst, result);
+
+				if (accumulated)
+				{
+					float* acc = accumulated + offset;
+					_mm_storeu_ps(acc, _mm_add_ps(_mm_loadu_ps(acc), _mm_mul_ps(result, _mm_set1_ps(coeff))));
+				}
+#else
+				float average[BufferStride];
+				std::copy(pos, pos + BufferStride, average);
+				if (adjBegin != adjEnd)
+				{
+					std::fill(average, average + BufferStride, 0.0f);
+					for (uint32_t aIdx = adjBegin; aIdx < adjEnd; aIdx++)
+					{
+						const float* neighbour = cur + static_cast<size_t>(BufferStride) * adjacencyIndices[aIdx];
+						for (unsigned int c = 0; c < BufferStride; c++)
+						{
+							average[c] += neighbour[c];
+						}
+					}
+					for (unsigned int c = 0; c < BufferStride; c++)
+					{
+						average[c] *= inverseDegrees[vertIdx];
+					}
+				}
+
+				for (unsigned int c = 0; c < BufferStride; c++)
+				{
+					dst[c] = alpha * average[c] + beta * pos[c] + (prev ? gamma * prev[offset + c] : 0.0f);
+					if (accumulated)
+					{
+						accumulated[offset + c] += coeff * dst[c];
+					}
+				}
+#endif
 			}
-			smoothedPos *= 1.0 / double(pointData.NeighbourNum);
+		});
+}
 
-			smoothed[vertIdx] = srcCopy[vertIdx] + (smoothedPos - srcCopy[vertIdx]) * smoothingData.Amount;
+void DeformerDeltaMush::FitChebyshev(uint32_t iter, double amount, double tolerance, std::vector<double>& coeffs, double& responseError)
+{
+	coeffs.clear();
+	responseError = 0.0;
+
+	// the plain iteration is (I - amount * L)^iter, whose eigenvalues are g(t) = (1 - amount * (t + 1))^iter for the eigenvalues t + 1 of L in [0, 2].
+	// g is a polynomial of degree iter, so the Chebyshev-Gauss quadrature with more nodes gives its expansion exactly
+	const unsigned int numNodes = std::max(2 * iter + 2, 64u);
+	std::vector<double> all(iter + 1, 0.0);
+	for (unsigned int j = 0; j < numNodes; j++)
+	{
+		const double theta = (j + 0.5) * 3.14159265358979323846 / numNodes;
+		const double g = std::pow(1.0 - amount * (std::cos(theta) + 1.0), static_cast<double>(iter));
+		for (uint32_t k = 0; k <= iter; k++)
+		{
+			all[k] += 2.0 / numNodes * g * std::cos(k * theta);
 		}
+	}
+	all[0] *= 0.5;
+
+	// truncate at the lowest degree whose dropped terms are within the tolerance, since |T_k| <= 1 on the spectrum.
+	// The constant term is corrected below by at most the same amount, hence the factor 2
+	double tail = 0.0;
+	uint32_t degree = iter;
+	while (degree > 1 && 2.0 * (tail + std::abs(all[degree])) <= tolerance)
+	{
+		tail += std::abs(all[degree]);
+		degree--;
+	}
+
+	// use the plain iteration unless the truncation saves passes
+	if (degree < iter)
+	{
+		coeffs.assign(all.begin(), all.begin() + degree + 1);
 
-		srcCopy.copy(smoothed);
+		// keep the response to the constant field (t = -1) exactly 1 as the plain iteration, so that the smoothing does not move the mesh as a whole
+		double response = 0.0;
+		for (uint32_t k = 0; k <= degree; k++)
+		{
+			response += (k % 2 == 0) ? coeffs[k] : -coeffs[k];
+		}
+		coeffs[0] += 1.0 - response;
+		responseError = 2.0 * tail;
 	}
 }
 
 void DeformerDeltaMush::ComputeDelta(const MPointArray& src, const MPointArray& smoothed)
 {
 	const uint32_t numVerts = src.length();
+	const std::vector<uint32_t>& adjacencyOffsets = topology.AdjacencyOffsets();
 
 	// e_ƂɃf^vZ
 	for (uint32_t vertIdx = 0; vertIdx < numVerts; vertIdx++)
@@ -163,8 +512,8 @@ void DeformerDeltaMush::ComputeDelta(const MPointArray& src, const MPointArray&
 		{
 			MMatrix mat = ComputeTangentMatrix(
 				smoothed[vertIdx],
-				smoothed[pointData.NeighbourIndices[neighborIdx]],
-				smoothed[pointData.NeighbourIndices[neighborIdx + 1]]);
+				smoothed[adjacencyIndices[adjacencyOffsets[vertIdx] + neighborIdx]],
+				smoothed[adjacencyIndices[adjacencyOffsets[vertIdx] + neighborIdx + 1]]);
 
 			// _ tangent space coordinate Ńf^ێ
 			pointData.Delta[neighborIdx] = delta * mat.inverse();
@@ -172,6 +521,122 @@ void DeformerDeltaMush::ComputeDelta(const MPointArray& src, const MPointArray&
 	}
 }
 
+void DeformerDeltaMush::ComputeFaceNormals(const MPointArray& pos, std::vector<MVector>& faceNormals, int numThreads) const
+{
+	const std::vector<uint32_t>& faceOffsets = topology.FaceOffsets();
+	const std::vector<uint32_t>& faceVertices = topology.FaceVertices();
+	const int numFaces = static_cast<int>(topology.NumFaces());
+	faceNormals.resize(numFaces);
+
+	ParallelUtil::ForEach(numFaces, numThreads, [&](int faceIdx)
+		{
+			const uint32_t begin = faceOffsets[faceIdx];
+			const uint32_t end = faceOffsets[faceIdx + 1];
+
+			MVector normal = MVector::zero;
+			for (uint32_t fvIdx = begin; fvIdx < end; fvIdx++)
+			{
+				const MPoint& p0 = pos[faceVertices[fvIdx]];
+				const MPoint& p1 = pos[faceVertices[fvIdx + 1 < end ? fvIdx + 1 : begin]];
+				normal.x += (p0.y - p1.y) * (p0.z + p1.z);
+				normal.y += (p0.z - p1.z) * (p0.x + p1.x);
+				normal.z += (p0.x - p1.x) * (p0.y + p1.y);
+			}
+			faceNormals[faceIdx] = normal;
+		});
+}
+
+bool DeformerDeltaMush::ComputeVertexFrame(
+	uint32_t vertIdx,
+	uint32_t tangentNeighbour,
+	const MPointArray& pos,
+	const std::vector<MVector>& faceNormals,
+	MVector& tangent,
+	MVector& binormal,
+	MVector& normal) const
+{
+	const std::vector<uint32_t>& vertexFaceOffsets = topology.VertexFaceOffsets();
+	const std::vector<uint32_t>& vertexFaces = topology.VertexFaces();
+
+	// area-weighted normal, since the face normals are proportional to their areas
+	normal = MVector::zero;
+	for (uint32_t vfIdx = vertexFaceOffsets[vertIdx]; vfIdx < vertexFaceOffsets[vertIdx + 1]; vfIdx++)
+	{
+		normal += faceNormals[vertexFaces[vfIdx]];
+	}
+
+	const double normalLength = normal.length();
+	if (normalLength <= 1e-12)
+	{
+		tangent = MVector(1.0, 0.0, 0.0);
+		binormal = MVector(0.0, 1.0, 0.0);
+		normal = MVector(0.0, 0.0, 1.0);
+		return false;
+	}
+	normal /= normalLength;
+
+	// the edge to the neighbour projected onto the tangent plane
+	tangent = pos[tangentNeighbour] - pos[vertIdx];
+	tangent -= normal * (tangent * normal);
+	const double tangentLength = tangent.length();
+	if (tangentLength <= 1e-12)
+	{
+		// the edge is parallel to the normal, so any direction on the tangent plane will do
+		tangent = std::abs(normal.x) < 0.9 ? MVector(1.0, 0.0, 0.0) : MVector(0.0, 1.0, 0.0);
+		tangent -= normal * (tangent * normal);
+		tangent.normalize();
+	}
+	else
+	{
+		tangent /= tangentLength;
+	}
+
+	binormal = normal ^ tangent;
+	return true;
+}
+
+void DeformerDeltaMush::ComputeFrameDelta(const MPointArray& src, const MPointArray& smoothed, int numThreads)
+{
+	const uint32_t numVerts = src.length();
+	const std::vector<uint32_t>& adjacencyOffsets = topology.AdjacencyOffsets();
+	frameData.resize(numVerts);
+
+	std::vector<MVector> faceNormals;
+	ComputeFaceNormals(smoothed, faceNormals, numThreads);
+
+	ParallelUtil::ForEach(static_cast<int>(numVerts), numThreads, [&](int vertIdx)
+		{
+			FrameData& data = frameData[vertIdx];
+			data.TangentNeighbour = vertIdx;
+
+			// the neighbour whose edge is the farthest from the normal gives the most stable tangent
+			MVector t, b, n;
+			ComputeVertexFrame(vertIdx, vertIdx, smoothed, faceNormals, t, b, n);
+			double bestSine = -1.0;
+			for (uint32_t aIdx = adjacencyOffsets[vertIdx]; aIdx < adjacencyOffsets[vertIdx + 1]; aIdx++)
+			{
+				const MVector edge = smoothed[adjacencyIndices[aIdx]] - smoothed[vertIdx];
+				const double edgeLength = edge.length();
+				if (edgeLength <= 0.0)
+				{
+					continue;
+				}
+				const double cosine = (edge * n) / edgeLength;
+				const double sine = std::sqrt(std::max(0.0, 1.0 - cosine * cosine));
+				if (sine > bestSine)
+				{
+					bestSine = sine;
+					data.TangentNeighbour = adjacencyIndices[aIdx];
+				}
+			}
+
+			// the frame is orthonormal, so its inverse is the transpose, i.e. the dot products with the axes
+			ComputeVertexFrame(vertIdx, data.TangentNeighbour, smoothed, faceNormals, t, b, n);
+			const MVector delta = src[vertIdx] - smoothed[vertIdx];
+			data.Delta = MVector(delta * t, delta * b, delta * n);
+		});
+}
+
 MMatrix DeformerDeltaMush::ComputeTangentMatrix(const MPoint& pos, const MPoint& posNeighbor0, const MPoint& posNeighbor1) const
 {
 	// ڂĂ钸_Ɨאڒ_̍Op`|SlāAtangent matrix 
@@ -3,10 +3,15 @@
 #include <maya/MIntArray.h>
 #include <maya/MVectorArray.h>
 #include <maya/MPointArray.h>
+#include <maya/MVector.h>
 #include <maya/MMatrix.h>
 #include <maya/MArrayDataHandle.h>
 #include <maya/MStatus.h>
+#include "MeshLaplacian.h"
+#include "MeshTopology.h"
+#include "VertexOrder.h"
 #include <vector>
+#include <cstdint>
 
 class DeformerDeltaMush
 {
@@ -22,20 +27,125 @@ public:
 	/// </summary>
 	/// <param name="deformed">[out]</param>
 	/// <param name="skinned">[in]</param>
+	/// <param name="numThreads">zero means all the available threads</param>
 	void ApplyDeltaMush(
 		const MPointArray& skinned,
-		MPointArray& deformed) const;
+		MPointArray& deformed,
+		int numThreads = 0) const;
 
 	void SetSmoothingData(uint32_t iter, double amount);
 
+	/// <summary>
+	/// whether InitializeData has been called since the last change of the settings
+	/// </summary>
+	bool IsInitialized() const
+	{
+		return isInitialized;
+	}
+
+	/// <summary>
+	/// Frames the deltas are stored in
+	/// </summary>
+	enum class TangentFrame : int8_t
+	{
+		/// <summary>
+		/// one frame per pair of consecutive neighbours, whose transformed deltas are averaged
+		/// </summary>
+		PerNeighbour = 0,
+
+		/// <summary>
+		/// one orthonormal frame per vertex from the area-weighted normal and the edge to one neighbour
+		/// </summary>
+		Single,
+	};
+
+	/// <summary>
+	/// Choose the frames of the deltas, which takes effect on the next InitializeData
+	/// </summary>
+	void SetTangentFrame(TangentFrame frame);
+
+	/// <summary>
+	/// Replace the plain smoothing passes by the Chebyshev expansion of the same frequency response, truncated at the lowest degree
+	/// whose response differs by at most the tolerance (zero keeps the plain iteration). It takes effect on the next InitializeData
+	/// </summary>
+	void SetChebyshevTolerance(double tolerance);
+
+	/// <summary>
+	/// Replace the smoothing passes by a single implicit step x' = (I + lambda * L)^-1 * x with lambda = amount * iter, which diffuses
+	/// as far as the passes. The system is factorized by InitializeData, and each smoothing is a forward and back substitution
+	/// for the 3 coordinates. It takes precedence over the Chebyshev expansion, and takes effect on the next InitializeData
+	/// </summary>
+	void SetImplicit(bool isImplicit);
+
+	/// <summary>
+	/// Choose the order of the vertices the smoothing and the deltas are stored in, which is computed by the next InitializeData.
+	/// The neighbours of a vertex are then close in memory, and the points are only remapped on the input and the output of ApplyDeltaMush
+	/// </summary>
+	void SetVertexOrder(VertexOrder::Kind kind);
+
+	/// <summary>
+	/// Result of the choice of the smoothing engine by InitializeData
+	/// </summary>
+	struct SmoothingReport {
+		/// <summary>
+		/// # of passes over the mesh per smoothing, which is the iteration count of the plain iteration
+		/// </summary>
+		uint32_t NumPasses = 0;
+
+		/// <summary>
+		/// bound of the difference of the frequency response from the plain iteration
+		/// </summary>
+		double ResponseError = 0.0;
+
+		/// <summary>
+		/// largest distance between the smoothed rest positions of the two engines, relative to the bounding box diagonal
+		/// </summary>
+		double MaxDeviation = 0.0;
+
+		/// <summary>
+		/// whether the implicit step is used, in which case NumPasses is 1 and ResponseError is not bounded
+		/// </summary>
+		bool IsImplicit = false;
+
+		/// <summary>
+		/// seconds to factorize the implicit system at bind
+		/// </summary>
+		double FactorizationTime = 0.0;
+
+		/// <summary>
+		/// seconds of a smoothing of the rest pose by the chosen engine and by the plain iteration, measured at bind
+		/// </summary>
+		double SmoothingTime = 0.0;
+		double PlainSmoothingTime = 0.0;
+	};
+
+	const SmoothingReport& GetSmoothingReport() const
+	{
+		return smoothingReport;
+	}
+
 	struct PointData {
 		// ł std::vector ɕύXfobO₷
-		MIntArray NeighbourIndices;
 		MVectorArray Delta;
 		uint32_t NeighbourNum;
 		double DeltaLength;
 	};
 
+	/// <summary>
+	/// Delta of a vertex in TangentFrame::Single
+	/// </summary>
+	struct FrameData {
+		/// <summary>
+		/// delta in the (tangent, binormal, normal) frame of the smoothed rest positions
+		/// </summary>
+		MVector Delta;
+
+		/// <summary>
+		/// the neighbour whose edge gives the tangent, chosen as the one farthest from the normal at bind
+		/// </summary>
+		uint32_t TangentNeighbour;
+	};
+
 	struct SmoothingData {
 		uint32_t Iter = 0;
 		double Amount = 1.0;
@@ -43,12 +153,115 @@ public:
 
 private:
 	MPointArray targetPos;
+	/// <summary>
+	/// deltas of TangentFrame::PerNeighbour, empty in TangentFrame::Single
+	/// </summary>
 	std::vector<PointData> dataPoints;
 	bool isInitialized;
 
 	SmoothingData smoothingData;
 
-	void ComputeSmoothedPoints(const MPointArray& src, MPointArray& smoothed) const;
+	/// <summary>
+	/// polygons, the faces around each vertex and the adjacency of the mesh
+	/// </summary>
+	MeshTopology topology;
+
+	/// <summary>
+	/// neighbours of vertex v are adjacencyIndices[offsets[v]] ... adjacencyIndices[offsets[v + 1] - 1] with the offsets of
+	/// topology.AdjacencyOffsets, in the order around the vertex (see MeshTopology::GetNeighboursAroundVertices)
+	/// </summary>
+	std::vector<uint32_t> adjacencyIndices;
+
+	/// <summary>
+	/// 1 / # of neighbours of each vertex, or zero for isolated vertices
+	/// </summary>
+	std::vector<float> inverseDegrees;
+
+	/// <summary>
+	/// Positions of the current and the next smoothing step as 4 floats per vertex (xyz and padding), which are swapped
+	/// after every step. They are kept to avoid the allocations on every frame.
+	/// </summary>
+	static constexpr unsigned int BufferStride = 4;
+	mutable std::vector<float> smoothingBuffers[4];
+
+	/// <summary>
+	/// Smooth the positions by the implicit step, the Chebyshev expansion or the plain iteration, whichever has been prepared
+	/// </summary>
+	/// <param name="isPlain">use the plain iteration regardless of the engine</param>
+	void ComputeSmoothedPoints(const MPointArray& src, MPointArray& smoothed, int numThreads = 0, bool isPlain = false) const;
+
+	/// <summary>
+	/// next = alpha * M * cur + beta * cur + gamma * prev, and accumulated += coeff * next,
+	/// where M averages the neighbours. prev and accumulated can be null.
+	/// </summary>
+	void SmoothingStep(
+		const float* cur, const float* prev, float* next, float* accumulated,
+		float alpha, float beta, float gamma, float coeff, int numThreads) const;
+
+	/// <summary>
+	/// Chebyshev coefficients of the response of the plain iteration, truncated by the tolerance
+	/// </summary>
+	/// <param name="coeffs">[out] empty if the plain iteration needs no more passes</param>
+	/// <param name="responseError">[out] bound of the truncation error of the response</param>
+	static void FitChebyshev(uint32_t iter, double amount, double tolerance, std::vector<double>& coeffs, double& responseError);
+
+	double chebyshevTolerance = 0.0;
+	std::vector<double> chebyshevCoeffs;
+	SmoothingReport smoothingReport;
+
+	bool isImplicit = false;
+
+	/// <summary>
+	/// factorization of the implicit step, empty unless it is used
+	/// </summary>
+	ImplicitSmoothing implicitSmoothing;
+
+	/// <summary>
+	/// # of vertices x 3 coordinates solved by the implicit step, kept to avoid the allocations on every frame
+	/// </summary>
+	mutable Eigen::MatrixXd implicitFields;
+
+	VertexOrder::Kind vertexOrderKind = VertexOrder::Kind::Original;
+
+	/// <summary>
+	/// internal order of the vertices, which all the per-vertex data above and below are stored in
+	/// </summary>
+	VertexOrder vertexOrder;
+
+	/// <summary>
+	/// inputs and outputs of ApplyDeltaMush in the internal order, kept to avoid the allocations on every frame
+	/// </summary>
+	mutable MPointArray orderedSkinned;
+	mutable MPointArray orderedDeformed;
+
+	/// <summary>
+	/// ApplyDeltaMush on the points in the internal order
+	/// </summary>
+	void ApplyDeltaMushInOrder(const MPointArray& skinned, MPointArray& deformed, int numThreads) const;
+
+	TangentFrame tangentFrame = TangentFrame::PerNeighbour;
+
+	std::vector<FrameData> frameData;
+
+	/// <summary>
+	/// Compute the unnormalized normal of each face, whose length is twice the area of the face (Newell's method)
+	/// </summary>
+	void ComputeFaceNormals(const MPointArray& pos, std::vector<MVector>& faceNormals, int numThreads) const;
+
+	/// <summary>
+	/// Compute the orthonormal frame of the vertex for TangentFrame::Single
+	/// </summary>
+	/// <returns>false if the frame is degenerate, in which case the world axes are returned</returns>
+	bool ComputeVertexFrame(
+		uint32_t vertIdx,
+		uint32_t tangentNeighbour,
+		const MPointArray& pos,
+		const std::vector<MVector>& faceNormals,
+		MVector& tangent,
+		MVector& binormal,
+		MVector& normal) const;
+
+	void ComputeFrameDelta(const MPointArray& src, const MPointArray& smoothed, int numThreads);
 
 	void ComputeDelta(const MPointArray& src, const MPointArray& smoothed);
 
@@ -1,50 +1,205 @@
 #include "DeformerLBS.h"
-#include <maya/MFnMatrixData.h>
+#include "ParallelUtil.h"
 #include <maya/MDataHandle.h>
 #include <maya/MOpenCLInfo.h>
 #include <maya/MGlobal.h>
 #include <maya/MPxSkinCluster.h>
+#include <algorithm>
 
 
+template <unsigned int NumInfluences>
 MPoint DeformerLBS::Deform(
 	int vertIdx,
 	const MPoint& pt,
 	const MMatrix& worldToLocal,
-	MArrayDataHandle& transformsHandle,
-	MArrayDataHandle& bindHandle,
-	MArrayDataHandle& weightsHandle,
-	MStatus* ptrStat) const
+	const JointPalette& palette,
+	const WeightTable& weights) const
 {
-	MPoint skinned;
+	double skinned[3] = { 0.0, 0.0, 0.0 };
 
 	// compute influences from each joint
-	unsigned int numWeights = weightsHandle.elementCount(); // # of nonzero weights
-	for (unsigned int wIdx = 0; wIdx < numWeights; wIdx++)
+	const unsigned int numInfluences = NumInfluences > 0 ? NumInfluences : weights.NumInfluences(vertIdx);
+	const unsigned int begin = weights.Begin(vertIdx);
+	for (unsigned int idx = 0; idx < numInfluences; idx++)
 	{
-		weightsHandle.jumpToArrayElement(wIdx); // jump to physical index
-		double w = weightsHandle.inputValue().asDouble();
+		palette.AccumulateTransformed(weights.Joint(begin + idx), weights.Weight(begin + idx), pt, skinned);
+	}
+
+	return MPoint(skinned[0], skinned[1], skinned[2]) * worldToLocal;
+}
+
+void DeformerLBS::DeformPoints(
+	MPointArray& points,
+	const MMatrix& worldToLocal,
+	const JointPalette& palette,
+	const WeightTable& weights,
+	int numThreads) const
+{
+	const unsigned int numVerts = points.length();
+	weights.ForEachBucket([&](auto numInfluencesTag, const uint32_t* vertIdxs, unsigned int numBucketVerts)
+		{
+			ParallelUtil::ForEach(static_cast<int>(numBucketVerts), numThreads, [&](int i)
+				{
+					const unsigned int vertIdx = vertIdxs[i];
+					if (vertIdx < numVerts)
+					{
+						points[vertIdx] = Deform<decltype(numInfluencesTag)::value>(vertIdx, points[vertIdx], worldToLocal, palette, weights);
+					}
+				});
+		});
+}
+
+void DeformerLBS::DeformVectorized(
+	MPointArray& points,
+	const MMatrix& worldToLocal,
+	const JointPalette& palette,
+	const WeightTable& weights,
+	int numThreads)
+{
+	if (m_weightsVersion != weights.Version())
+	{
+		BuildPaddedInfluences(weights);
+	}
+
+	// fold worldToLocal into the skinning matrices, since sum_j w_j * (p * M_j) * W = sum_j w_j * p * (M_j * W)
+	const unsigned int numJoints = palette.NumJoints();
+	m_matrices.resize(12 * numJoints);
+	for (unsigned int jointIdx = 0; jointIdx < numJoints; jointIdx++)
+	{
+		const MMatrix mat = palette.GetMMatrix(jointIdx) * worldToLocal;
+		float* m4x3 = &m_matrices[12 * jointIdx];
+		for (unsigned int c = 0; c < 3; c++)
+		{
+			for (unsigned int r = 0; r < 4; r++)
+			{
+				m4x3[4 * c + r] = static_cast<float>(mat(r, c));
+			}
+		}
+	}
+
+	const size_t numPadded = m_paddedVertIdxs.size();
+	m_posX.resize(numPadded);
+	m_posY.resize(numPadded);
+	m_posZ.resize(numPadded);
+
+	const unsigned int numVerts = points.length();
+	for (const PaddedBucket& bucket : m_paddedBuckets)
+	{
+		const uint32_t* vertIdxs = &m_paddedVertIdxs[bucket.VertexOffset];
+
+		// vertices without any influence have nothing to blend
+		if (bucket.Width == 0)
+		{
+			const MPoint origin = MPoint::origin * worldToLocal;
+			for (unsigned int i = 0; i < bucket.NumVertices; i++)
+			{
+				if (vertIdxs[i] < numVerts)
+				{
+					points[vertIdxs[i]] = origin;
+				}
+			}
+			continue;
+		}
 
-		// logical index corresponds to the joint index
-		unsigned int jointIdx = weightsHandle.elementIndex(ptrStat);
+		LBSKernel::Args args;
+		args.Matrices = m_matrices.data();
+		args.Joints = m_paddedJoints.data() + bucket.SlotOffset;
+		args.Weights = m_paddedWeights.data() + bucket.SlotOffset;
+		args.Width = bucket.Width;
+		args.Stride = bucket.Stride;
+		args.InX = args.OutX = m_posX.data() + bucket.VertexOffset;
+		args.InY = args.OutY = m_posY.data() + bucket.VertexOffset;
+		args.InZ = args.OutZ = m_posZ.data() + bucket.VertexOffset;
+
+		// each chunk gathers its points to SoA in the bucket order, runs the kernel in place, and scatters them back
+		const int numBlocks = static_cast<int>(bucket.Stride / LBSKernel::BlockSize);
+		ParallelUtil::ForEachChunk(numBlocks, numThreads, [&](int beginBlock, int endBlock)
+			{
+				const unsigned int begin = beginBlock * LBSKernel::BlockSize;
+				const unsigned int end = endBlock * LBSKernel::BlockSize;
+				const unsigned int endVert = std::min(end, bucket.NumVertices);
+
+				for (unsigned int i = begin; i < endVert; i++)
+				{
+					if (vertIdxs[i] < numVerts)
+					{
+						const MPoint& pt = points[vertIdxs[i]];
+						args.OutX[i] = static_cast<float>(pt.x);
+						args.OutY[i] = static_cast<float>(pt.y);
+						args.OutZ[i] = static_cast<float>(pt.z);
+					}
+				}
+
+				LBSKernel::Run(m_isa, args, begin, end);
+
+				for (unsigned int i = begin; i < endVert; i++)
+				{
+					if (vertIdxs[i] < numVerts)
+					{
+						points[vertIdxs[i]] = MPoint(args.OutX[i], args.OutY[i], args.OutZ[i]);
+					}
+				}
+			});
+	}
+}
 
-		transformsHandle.jumpToElement(jointIdx); // jump to logical index
-		MMatrix jointMat = MFnMatrixData(transformsHandle.inputValue().data()).matrix();
+void DeformerLBS::BuildPaddedInfluences(const WeightTable& weights)
+{
+	// one segment per influence bucket, each padded to a multiple of the block size
+	m_paddedBuckets.clear();
+	unsigned int vertexOffset = 0;
+	size_t slotOffset = 0;
+	for (unsigned int numInfluences = 0; numInfluences <= weights.MaxInfluences(); numInfluences++)
+	{
+		PaddedBucket bucket;
+		bucket.Width = numInfluences;
+		bucket.NumVertices = weights.BucketEnd(numInfluences) - weights.BucketBegin(numInfluences);
+		if (bucket.NumVertices == 0)
+		{
+			continue;
+		}
+		bucket.Stride = (bucket.NumVertices + LBSKernel::BlockSize - 1) / LBSKernel::BlockSize * LBSKernel::BlockSize;
+		bucket.VertexOffset = vertexOffset;
+		bucket.SlotOffset = slotOffset;
+		m_paddedBuckets.push_back(bucket);
+
+		vertexOffset += bucket.Stride;
+		slotOffset += static_cast<size_t>(bucket.Width) * bucket.Stride;
+	}
 
-		bindHandle.jumpToElement(jointIdx); // jump to logical index
-		MMatrix preBindMatrix = MFnMatrixData(bindHandle.inputValue().data()).matrix();
-		jointMat = preBindMatrix * jointMat;
+	// padded vertices refer to joint 0 with zero weight, and their results are discarded
+	m_paddedVertIdxs.assign(vertexOffset, 0);
+	m_paddedJoints.assign(slotOffset, 0);
+	m_paddedWeights.assign(slotOffset, 0.0f);
+	for (const PaddedBucket& bucket : m_paddedBuckets)
+	{
+		const uint32_t* bucketVertIdxs = &weights.BucketVertices()[weights.BucketBegin(bucket.Width)];
+		for (unsigned int i = 0; i < bucket.NumVertices; i++)
+		{
+			const uint32_t vertIdx = bucketVertIdxs[i];
+			m_paddedVertIdxs[bucket.VertexOffset + i] = vertIdx;
 
-		skinned += (pt * jointMat) * w;
+			const unsigned int begin = weights.Begin(vertIdx);
+			for (unsigned int slot = 0; slot < bucket.Width; slot++)
+			{
+				const size_t slotIdx = bucket.SlotOffset + static_cast<size_t>(slot) * bucket.Stride + i;
+				m_paddedJoints[slotIdx] = static_cast<int32_t>(weights.Joint(begin + slot));
+				m_paddedWeights[slotIdx] = static_cast<float>(weights.Weight(begin + slot));
+			}
+		}
 	}
 
-	return skinned * worldToLocal;
+	m_weightsVersion = weights.Version();
 }
 
 void GPUDeformerLBS::Terminate()
 {
 	m_weightsBuffer.reset();
 	m_influencesBuffer.reset();
+	m_offsetsBuffer.reset();
 	m_transformMatricesBuffer.reset();
+	m_transformMatricesSize = 0;
+	m_weightsVersion = 0;
 
 	MOpenCLInfo::releaseOpenCLKernel(m_kernel);
 	m_kernel.reset();
@@ -54,6 +209,7 @@ MPxGPUDeformer::DeformerStatus GPUDeformerLBS::Evaluate(
 	MDataBlock& block,
 	const MEvaluationNode& evaluationNode,
 	const MString& pluginPath,
+	const WeightTable& weights,
 	const MGPUDeformerBuffer& inputPositions,
 	MGPUDeformerBuffer& outputPositions)
 {
@@ -71,8 +227,8 @@ MPxGPUDeformer::DeformerStatus GPUDeformerLBS::Evaluate(
 	}
 
 	// Load weights and transform matrices onto OpenCL buffer
-	ExtractTransformMatrices(block, evaluationNode);
-	ExtractWeights(block, evaluationNode);
+	ExtractTransformMatrices(block, evaluationNode, weights.NumJoints());
+	ExtractWeights(weights);
 
 	cl_int err = CL_SUCCESS;
 	// set all of our kernel parameters
@@ -85,6 +241,8 @@ MPxGPUDeformer::DeformerStatus GPUDeformerLBS::Evaluate(
 	MOpenCLInfo::checkCLErrorStatus(err);
 	err = clSetKernelArg(m_kernel.get(), parameterId++, sizeof(cl_mem), (void*)m_influencesBuffer.getReadOnlyRef());
 	MOpenCLInfo::checkCLErrorStatus(err);
+	err = clSetKernelArg(m_kernel.get(), parameterId++, sizeof(cl_mem), (void*)m_offsetsBuffer.getReadOnlyRef());
+	MOpenCLInfo::checkCLErrorStatus(err);
 	err = clSetKernelArg(m_kernel.get(), parameterId++, sizeof(cl_mem), (void*)m_transformMatricesBuffer.getReadOnlyRef());
 	MOpenCLInfo::checkCLErrorStatus(err);
 	err = clSetKernelArg(m_kernel.get(), parameterId++, sizeof(cl_uint), (void*)&numVertices);
@@ -168,128 +326,79 @@ MPxGPUDeformer::DeformerStatus GPUDeformerLBS::SetWorkSize(uint32_t numVertices)
 	return MPxGPUDeformer::kDeformerSuccess;
 }
 
-MStatus GPUDeformerLBS::ExtractWeights(MDataBlock& block, const MEvaluationNode& evaluationNode)
+MStatus GPUDeformerLBS::ExtractWeights(const WeightTable& weights)
 {
 	MStatus status;
-	const bool needUpdate = m_weightsBuffer.isNull() || m_influencesBuffer.isNull() || evaluationNode.dirtyPlugExists(MPxSkinCluster::weightList, &status);
+	const bool needUpdate = m_weightsBuffer.isNull() || m_influencesBuffer.isNull() || m_offsetsBuffer.isNull() || m_weightsVersion != weights.Version();
 	if (!needUpdate)
 	{
 		return status;
 	}
 
-	std::vector<float> weightsContainer;
-	std::vector<uint32_t> influencesContainer;
-
-	MArrayDataHandle weightListsHandle = block.inputArrayValue(MPxSkinCluster::weightList, &status);
-
-	weightListsHandle.jumpToArrayElement(0);
-	for (uint32_t vIdx = 0; vIdx < m_numVertices; vIdx++)
-	{
-		MArrayDataHandle weightsHandle = weightListsHandle.inputValue(&status).child(MPxSkinCluster::weights);
-
-		const uint32_t numWeights = weightsHandle.elementCount(); // # of nonzero weights
-		for (uint32_t wIdx = 0; wIdx < numWeights; wIdx++) {
-			weightsHandle.jumpToArrayElement(wIdx); // jump to physical index
-
-			const double w = weightsHandle.inputValue().asDouble();
-			weightsContainer.push_back(static_cast<float>(w));
-
-			const uint32_t jointIdx = weightsHandle.elementIndex(&status); // logical index corresponds to joint index
-			influencesContainer.push_back(jointIdx);
-		}
-
-		// advance the weight list handle
-		CHECK_MSTATUS(weightListsHandle.next());
-	}
+	// the WeightTable is already in the CSR layout, so only the weights need to be converted to float
+	const std::vector<double>& weightsDouble = weights.Weights();
+	std::vector<float> weightsContainer(weightsDouble.begin(), weightsDouble.end());
+	const std::vector<uint32_t>& influencesContainer = weights.Joints();
+	const std::vector<uint32_t>& offsetsContainer = weights.Offsets();
 
+	// # of entries may change when the weights are edited, so the buffers are always recreated
 	cl_int err = CL_SUCCESS;
-	if (!m_weightsBuffer.get())
-	{
-		m_weightsBuffer.attach(
-			clCreateBuffer(MOpenCLInfo::getOpenCLContext(),
-				CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY,
-				weightsContainer.size() * sizeof(float),
-				(void*)weightsContainer.data(),
-				&err)
-		);
-	}
-	else
-	{
-		err = clEnqueueWriteBuffer(
-			MOpenCLInfo::getMayaDefaultOpenCLCommandQueue(),
-			m_weightsBuffer.get(),
-			CL_TRUE,
-			0,
-			weightsContainer.size() * sizeof(float),
+	m_weightsBuffer.reset();
+	m_weightsBuffer.attach(
+		clCreateBuffer(MOpenCLInfo::getOpenCLContext(),
+			CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY,
+			std::max<size_t>(weightsContainer.size(), 1) * sizeof(float),
 			(void*)weightsContainer.data(),
-			0,
-			nullptr,
-			nullptr);
-	}
+			&err)
+	);
+	MOpenCLInfo::checkCLErrorStatus(err);
 
-	if (!m_influencesBuffer.get())
-	{
-		m_influencesBuffer.attach(
-			clCreateBuffer(MOpenCLInfo::getOpenCLContext(),
-				CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY,
-				influencesContainer.size() * sizeof(uint32_t),
-				(void*)influencesContainer.data(),
-				&err)
-		);
-	}
-	else
-	{
-		err = clEnqueueWriteBuffer(
-			MOpenCLInfo::getMayaDefaultOpenCLCommandQueue(),
-			m_influencesBuffer.get(),
-			CL_TRUE,
-			0,
-			influencesContainer.size() * sizeof(float),
+	m_influencesBuffer.reset();
+	m_influencesBuffer.attach(
+		clCreateBuffer(MOpenCLInfo::getOpenCLContext(),
+			CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY,
+			std::max<size_t>(influencesContainer.size(), 1) * sizeof(uint32_t),
 			(void*)influencesContainer.data(),
-			0,
-			nullptr,
-			nullptr);
-	}
+			&err)
+	);
+	MOpenCLInfo::checkCLErrorStatus(err);
+
+	m_offsetsBuffer.reset();
+	m_offsetsBuffer.attach(
+		clCreateBuffer(MOpenCLInfo::getOpenCLContext(),
+			CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY,
+			offsetsContainer.size() * sizeof(uint32_t),
+			(void*)offsetsContainer.data(),
+			&err)
+	);
+	MOpenCLInfo::checkCLErrorStatus(err);
+
+	m_weightsVersion = weights.Version();
 
 	return status;
 }
 
-MStatus GPUDeformerLBS::ExtractTransformMatrices(MDataBlock& block, const MEvaluationNode& evaluationNode)
+MStatus GPUDeformerLBS::ExtractTransformMatrices(MDataBlock& block, const MEvaluationNode& evaluationNode, unsigned int numJoints)
 {
 	MStatus status;
-	if (!m_transformMatricesBuffer.isNull() && !evaluationNode.dirtyPlugExists(MPxSkinCluster::matrix, &status))
+	if (!m_transformMatricesBuffer.isNull() && m_palette.NumJoints() >= numJoints && !evaluationNode.dirtyPlugExists(MPxSkinCluster::matrix, &status))
 	{
 		return status;
 	}
 
-	std::vector<float> matricesContainer;
-
 	MArrayDataHandle bindHandle = block.inputArrayValue(MPxSkinCluster::bindPreMatrix, &status);
 	MArrayDataHandle transformsHandle = block.inputArrayValue(MPxSkinCluster::matrix, &status);
-	uint32_t numJoints = transformsHandle.elementCount();
-
-	for (uint32_t jIdx = 0; jIdx < numJoints; jIdx++)
-	{
-		MMatrix jointMat = MFnMatrixData(transformsHandle.inputValue().data()).matrix();
-		MMatrix preBindMatrix = MFnMatrixData(bindHandle.inputValue().data()).matrix();
-		jointMat = preBindMatrix * jointMat;
+	CHECK_MSTATUS(m_palette.Build(transformsHandle, bindHandle, numJoints));
 
-		// send as 4x3 matrix to GPU
-		for (uint32_t c = 0; c < 3; c++)
-		{
-			for (uint32_t r = 0; r < 4; r++)
-			{
-				matricesContainer.push_back(static_cast<float>(jointMat(r, c)));
-			}
-		}
-
-		transformsHandle.next();
-		bindHandle.next();
-	}
+	// send as 4x3 matrix to GPU
+	const std::vector<float>& matricesContainer = m_palette.Matrices4x3();
 
+	// the buffer is recreated when the # of joints changes
 	cl_int err = CL_SUCCESS;
-	if (!m_transformMatricesBuffer.get())
+	if (!m_transformMatricesBuffer.get() || m_transformMatricesSize != matricesContainer.size())
 	{
+		m_transformMatricesSize = matricesContainer.size();
+		m_transformMatricesBuffer.reset();
 		m_transformMatricesBuffer.attach(
 			clCreateBuffer(MOpenCLInfo::getOpenCLContext(),
 				CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY,
@@ -1,5 +1,9 @@
 #pragma once
+#include "JointPalette.h"
+#include "WeightTable.h"
+#include "LBSKernel.h"
 #include <maya/MPoint.h>
+#include <maya/MPointArray.h>
 #include <maya/MMatrix.h>
 #include <maya/MArrayDataHandle.h>
 #include <maya/MStatus.h>
@@ -11,14 +15,107 @@ public:
 	DeformerLBS() = default;
 	~DeformerLBS() = default;
 
+	/// <summary>
+	/// Deform all the points in double precision. Vertices are processed per bucket of the same # of influences,
+	/// so that each bucket runs the kernel unrolled for its influence count.
+	/// </summary>
+	/// <param name="points">[in, out] the array index must be the vertex index</param>
+	/// <param name="worldToLocal"></param>
+	/// <param name="palette"></param>
+	/// <param name="weights"></param>
+	/// <param name="numThreads">zero means all the available threads</param>
+	void DeformPoints(
+		MPointArray& points,
+		const MMatrix& worldToLocal,
+		const JointPalette& palette,
+		const WeightTable& weights,
+		int numThreads) const;
+
+	/// <summary>
+	/// Deform all the points at once with the vectorized float kernel for the running CPU
+	/// </summary>
+	/// <param name="points">[in, out] the array index must be the vertex index</param>
+	/// <param name="worldToLocal"></param>
+	/// <param name="palette"></param>
+	/// <param name="weights"></param>
+	/// <param name="numThreads">zero means all the available threads</param>
+	void DeformVectorized(
+		MPointArray& points,
+		const MMatrix& worldToLocal,
+		const JointPalette& palette,
+		const WeightTable& weights,
+		int numThreads);
+
+	/// <summary>
+	/// Instruction set of the vectorized kernel
+	/// </summary>
+	LBSKernel::ISA ISA() const { return m_isa; }
+
+private:
+	/// <summary>
+	/// Kernel for the vertices with NumInfluences influences. NumInfluences = 0 reads the count at runtime.
+	/// </summary>
+	template <unsigned int NumInfluences>
 	MPoint Deform(
 		int vertIdx,
 		const MPoint& pt,
 		const MMatrix& worldToLocal,
-		MArrayDataHandle& transformsHandle,
-		MArrayDataHandle& bindHandle,
-		MArrayDataHandle& weightsHandle,
-		MStatus* ptrStat) const;
+		const JointPalette& palette,
+		const WeightTable& weights) const;
+
+	/// <summary>
+	/// instruction set of the vectorized kernel, selected at runtime
+	/// </summary>
+	LBSKernel::ISA m_isa = LBSKernel::DetectISA();
+
+	/// <summary>
+	/// Range of an influence bucket in the padded arrays. The vertices of a bucket have exactly Width influences,
+	/// so only the vertex range is padded to a multiple of the block size (see LBSKernel::Args).
+	/// </summary>
+	struct PaddedBucket
+	{
+		unsigned int Width = 0;
+		unsigned int NumVertices = 0;
+		unsigned int Stride = 0;
+
+		/// <summary>
+		/// first element of the bucket in m_paddedVertIdxs and the SoA positions
+		/// </summary>
+		unsigned int VertexOffset = 0;
+
+		/// <summary>
+		/// first element of the bucket in m_paddedJoints and m_paddedWeights
+		/// </summary>
+		size_t SlotOffset = 0;
+	};
+
+	std::vector<PaddedBucket> m_paddedBuckets;
+
+	/// <summary>
+	/// vertex index of each element of the SoA positions, in the bucket order
+	/// </summary>
+	std::vector<uint32_t> m_paddedVertIdxs;
+	std::vector<int32_t> m_paddedJoints;
+	std::vector<float> m_paddedWeights;
+
+	/// <summary>
+	/// version of the WeightTable the padded influences are built from
+	/// </summary>
+	uint64_t m_weightsVersion = 0;
+
+	/// <summary>
+	/// skinning matrices premultiplied by worldToLocal, as 4x3 float matrices
+	/// </summary>
+	std::vector<float> m_matrices;
+
+	/// <summary>
+	/// positions in the structure-of-arrays layout
+	/// </summary>
+	std::vector<float> m_posX;
+	std::vector<float> m_posY;
+	std::vector<float> m_posZ;
+
+	void BuildPaddedInfluences(const WeightTable& weights);
 };
 
 class GPUDeformerLBS
@@ -33,6 +130,7 @@ public:
 		MDataBlock& block,
 		const MEvaluationNode& evaluationNode,
 		const MString& pluginPath,
+		const WeightTable& weights,
 		const MGPUDeformerBuffer& inputPositions,
 		MGPUDeformerBuffer& outputPositions);
 
@@ -44,11 +142,20 @@ private:
 
 	MAutoCLMem m_weightsBuffer;
 	MAutoCLMem m_influencesBuffer;
+	MAutoCLMem m_offsetsBuffer;
 	MAutoCLMem m_transformMatricesBuffer;
+	size_t m_transformMatricesSize = 0;
+
+	/// <summary>
+	/// version of the WeightTable uploaded to the weight buffers
+	/// </summary>
+	uint64_t m_weightsVersion = 0;
+
+	JointPalette m_palette;
 
 	MPxGPUDeformer::DeformerStatus SetupKernel(const MString& pluginPath, uint32_t numVertices);
 	MPxGPUDeformer::DeformerStatus SetWorkSize(uint32_t numVertices);
 
-	MStatus ExtractWeights(MDataBlock& block, const MEvaluationNode& evaluationNode);
-	MStatus ExtractTransformMatrices(MDataBlock& block, const MEvaluationNode& evaluationNode);
+	MStatus ExtractWeights(const WeightTable& weights);
+	MStatus ExtractTransformMatrices(MDataBlock& block, const MEvaluationNode& evaluationNode, unsigned int numJoints);
 };
@@ -0,0 +1,69 @@
+#include "JointPalette.h"
+#include <maya/MFnMatrixData.h>
+#include <maya/MDataHandle.h>
+#include <algorithm>
+
+
+MStatus JointPalette::Build(MArrayDataHandle& transformsHandle, MArrayDataHandle& bindHandle, unsigned int minNumJoints)
+{
+	MStatus status;
+
+	// the logical indices of the matrix attribute may be sparse, so the palette covers [0, max logical index]
+	const unsigned int numElements = transformsHandle.elementCount(&status);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+
+	unsigned int numJoints = minNumJoints;
+	for (unsigned int eIdx = 0; eIdx < numElements; eIdx++)
+	{
+		transformsHandle.jumpToArrayElement(eIdx); // jump to physical index
+		numJoints = std::max(numJoints, transformsHandle.elementIndex() + 1);
+	}
+
+	// unused entries are left as identity
+	m_numJoints = numJoints;
+	m_matrices.assign(16 * numJoints, 0.0);
+	m_matrices4x3.assign(12 * numJoints, 0.0f);
+	for (unsigned int jointIdx = 0; jointIdx < numJoints; jointIdx++)
+	{
+		double* m = &m_matrices[16 * jointIdx];
+		m[0] = m[5] = m[10] = m[15] = 1.0;
+
+		float* m4x3 = &m_matrices4x3[12 * jointIdx];
+		m4x3[0] = m4x3[5] = m4x3[10] = 1.0f;
+	}
+
+	for (unsigned int eIdx = 0; eIdx < numElements; eIdx++)
+	{
+		transformsHandle.jumpToArrayElement(eIdx); // jump to physical index
+		const unsigned int jointIdx = transformsHandle.elementIndex(&status); // logical index corresponds to the joint index
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+
+		MMatrix jointMat = MFnMatrixData(transformsHandle.inputValue().data()).matrix();
+		if (bindHandle.jumpToElement(jointIdx)) // jump to logical index
+		{
+			const MMatrix preBindMatrix = MFnMatrixData(bindHandle.inputValue().data()).matrix();
+			jointMat = preBindMatrix * jointMat;
+		}
+
+		double* m = &m_matrices[16 * jointIdx];
+		for (unsigned int r = 0; r < 4; r++)
+		{
+			for (unsigned int c = 0; c < 4; c++)
+			{
+				m[4 * r + c] = jointMat(r, c);
+			}
+		}
+
+		// 4x3 matrix for the float kernels
+		float* m4x3 = &m_matrices4x3[12 * jointIdx];
+		for (unsigned int c = 0; c < 3; c++)
+		{
+			for (unsigned int r = 0; r < 4; r++)
+			{
+				m4x3[4 * c + r] = static_cast<float>(jointMat(r, c));
+			}
+		}
+	}
+
+	return status;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <maya/MMatrix.h>
+#include <maya/MPoint.h>
+#include <maya/MArrayDataHandle.h>
+#include <maya/MStatus.h>
+#include <vector>
+
+
+/// <summary>
+/// Skinning matrices (bindPreMatrix * matrix) of all the joints, built once per evaluation.
+/// Entries are indexed by the logical index of the matrix attribute, i.e. the joint index used in weightList.
+/// </summary>
+class JointPalette
+{
+public:
+	JointPalette() = default;
+	~JointPalette() = default;
+
+	/// <summary>
+	/// Build the palette from the matrix and bindPreMatrix attributes
+	/// </summary>
+	/// <param name="transformsHandle">matrix attribute</param>
+	/// <param name="bindHandle">bindPreMatrix attribute</param>
+	/// <param name="minNumJoints">minimum # of entries, so that every joint index in the weights is valid</param>
+	/// <returns></returns>
+	MStatus Build(MArrayDataHandle& transformsHandle, MArrayDataHandle& bindHandle, unsigned int minNumJoints = 0);
+
+	/// <summary>
+	/// # of entries in the palette (= the largest joint index + 1)
+	/// </summary>
+	unsigned int NumJoints() const
+	{
+		return m_numJoints;
+	}
+
+	/// <summary>
+	/// Skinning matrix of the joint as 16 doubles in the same (row-major) layout as MMatrix
+	/// </summary>
+	const double* Matrix(unsigned int jointIdx) const
+	{
+		return &m_matrices[16 * jointIdx];
+	}
+
+	/// <summary>
+	/// Skinning matrix of the joint as MMatrix
+	/// </summary>
+	MMatrix GetMMatrix(unsigned int jointIdx) const
+	{
+		return MMatrix(reinterpret_cast<const double(*)[4]>(Matrix(jointIdx)));
+	}
+
+	/// <summary>
+	/// Skinning matrices of all the joints as 4x3 float matrices (3 columns of float4), which is the layout of the OpenCL kernel
+	/// </summary>
+	const std::vector<float>& Matrices4x3() const
+	{
+		return m_matrices4x3;
+	}
+
+	/// <summary>
+	/// Transform the point by the skinning matrix of the joint, and accumulate it with the given weight
+	/// </summary>
+	/// <param name="jointIdx"></param>
+	/// <param name="weight"></param>
+	/// <param name="pt">point to be transformed (w is assumed to be 1)</param>
+	/// <param name="acc">[in, out] xyz of the accumulated point</param>
+	void AccumulateTransformed(unsigned int jointIdx, double weight, const MPoint& pt, double acc[3]) const
+	{
+		const double* m = Matrix(jointIdx);
+		acc[0] += weight * (pt.x * m[0] + pt.y * m[4] + pt.z * m[8] + m[12]);
+		acc[1] += weight * (pt.x * m[1] + pt.y * m[5] + pt.z * m[9] + m[13]);
+		acc[2] += weight * (pt.x * m[2] + pt.y * m[6] + pt.z * m[10] + m[14]);
+	}
+
+private:
+	unsigned int m_numJoints = 0;
+
+	/// <summary>
+	/// 4x4 double matrices, 16 elements per joint
+	/// </summary>
+	std::vector<double> m_matrices;
+
+	/// <summary>
+	/// 4x3 float matrices, 12 elements per joint
+	/// </summary>
+	std::vector<float> m_matrices4x3;
+};
@@ -0,0 +1,260 @@
+#include "LBSKernel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define LBS_KERNEL_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC accepts AVX intrinsics in any function, while GCC/Clang need the target attribute on the functions using them
+#if defined(LBS_KERNEL_X86) && !defined(_MSC_VER)
+#define LBS_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define LBS_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define LBS_TARGET_AVX2
+#define LBS_TARGET_AVX512
+#endif
+
+
+namespace {
+#if defined(LBS_KERNEL_X86)
+	/// <summary>
+	/// Transform 8 points by column c of their 4x3 matrices
+	/// </summary>
+	LBS_TARGET_AVX2 inline __m256 TransformColumnAVX2(const float* column, __m256i matIdx, __m256 x, __m256 y, __m256 z)
+	{
+		const __m256 m0 = _mm256_i32gather_ps(column + 0, matIdx, 4);
+		const __m256 m1 = _mm256_i32gather_ps(column + 1, matIdx, 4);
+		const __m256 m2 = _mm256_i32gather_ps(column + 2, matIdx, 4);
+		const __m256 m3 = _mm256_i32gather_ps(column + 3, matIdx, 4);
+		return _mm256_fmadd_ps(x, m0, _mm256_fmadd_ps(y, m1, _mm256_fmadd_ps(z, m2, m3)));
+	}
+
+	/// <summary>
+	/// Transform 16 points by column c of their 4x3 matrices
+	/// </summary>
+	LBS_TARGET_AVX512 inline __m512 TransformColumnAVX512(const float* column, __m512i matIdx, __m512 x, __m512 y, __m512 z)
+	{
+		const __m512 m0 = _mm512_i32gather_ps(matIdx, column + 0, 4);
+		const __m512 m1 = _mm512_i32gather_ps(matIdx, column + 1, 4);
+		const __m512 m2 = _mm512_i32gather_ps(matIdx, column + 2, 4);
+		const __m512 m3 = _mm512_i32gather_ps(matIdx, column + 3, 4);
+		return _mm512_fmadd_ps(x, m0, _mm512_fmadd_ps(y, m1, _mm512_fmadd_ps(z, m2, m3)));
+	}
+#endif
+}
+
+
+LBSKernel::ISA LBSKernel::DetectISA()
+{
+#if defined(LBS_KERNEL_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	const int maxLeaf = info[0];
+	if (maxLeaf < 7)
+	{
+		return ISA::Scalar;
+	}
+
+	__cpuidex(info, 1, 0);
+	const bool hasFMA = (info[2] & (1 << 12)) != 0;
+	const bool hasOSXSAVE = (info[2] & (1 << 27)) != 0;
+	const bool hasAVX = (info[2] & (1 << 28)) != 0;
+	if (!hasFMA || !hasOSXSAVE || !hasAVX)
+	{
+		return ISA::Scalar;
+	}
+
+	// the OS must save the YMM (and ZMM) registers on context switches
+	const unsigned long long xcr0 = _xgetbv(0);
+	const bool hasYMMState = (xcr0 & 0x06) == 0x06;
+	const bool hasZMMState = (xcr0 & 0xe6) == 0xe6;
+
+	__cpuidex(info, 7, 0);
+	const bool hasAVX2 = (info[1] & (1 << 5)) != 0;
+	const bool hasAVX512F = (info[1] & (1 << 16)) != 0;
+
+	if (hasAVX512F && hasZMMState)
+	{
+		return ISA::AVX512;
+	}
+	if (hasAVX2 && hasYMMState)
+	{
+		return ISA::AVX2;
+	}
+	return ISA::Scalar;
+#elif defined(LBS_KERNEL_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+	{
+		return ISA::AVX512;
+	}
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+	{
+		return ISA::AVX2;
+	}
+	return ISA::Scalar;
+#else
+	return ISA::Scalar;
+#endif
+}
+
+const char* LBSKernel::ISAName(ISA isa)
+{
+	switch (isa)
+	{
+	case ISA::AVX2:
+		return "AVX2";
+	case ISA::AVX512:
+		return "AVX-512";
+	default:
+		return "Scalar";
+	}
+}
+
+void LBSKernel::Run(ISA isa, const Args& args, unsigned int begin, unsigned int end)
+{
+	switch (args.Width)
+	{
+	case 1: RunWidth<1>(isa, args, begin, end); break;
+	case 2: RunWidth<2>(isa, args, begin, end); break;
+	case 3: RunWidth<3>(isa, args, begin, end); break;
+	case 4: RunWidth<4>(isa, args, begin, end); break;
+	case 5: RunWidth<5>(isa, args, begin, end); break;
+	case 6: RunWidth<6>(isa, args, begin, end); break;
+	case 7: RunWidth<7>(isa, args, begin, end); break;
+	case 8: RunWidth<8>(isa, args, begin, end); break;
+	default: RunWidth<0>(isa, args, begin, end); break;
+	}
+	static_assert(MaxUnrolledWidth == 8, "update the cases above");
+}
+
+template <unsigned int Width>
+void LBSKernel::RunWidth(ISA isa, const Args& args, unsigned int begin, unsigned int end)
+{
+	switch (isa)
+	{
+#if defined(LBS_KERNEL_X86)
+	case ISA::AVX512:
+		RunAVX512<Width>(args, begin, end);
+		break;
+	case ISA::AVX2:
+		RunAVX2<Width>(args, begin, end);
+		break;
+#endif
+	default:
+		RunScalar<Width>(args, begin, end);
+		break;
+	}
+}
+
+template <unsigned int Width>
+void LBSKernel::RunScalar(const Args& args, unsigned int begin, unsigned int end)
+{
+	const unsigned int width = Width > 0 ? Width : args.Width;
+
+	for (unsigned int v = begin; v < end; v++)
+	{
+		const float x = args.InX[v];
+		const float y = args.InY[v];
+		const float z = args.InZ[v];
+
+		float out[3] = { 0.0f, 0.0f, 0.0f };
+		for (unsigned int s = 0; s < width; s++)
+		{
+			const unsigned int slot = s * args.Stride + v;
+			const float w = args.Weights[slot];
+			const float* m = args.Matrices + 12 * args.Joints[slot];
+			for (unsigned int c = 0; c < 3; c++)
+			{
+				out[c] += w * (x * m[4 * c + 0] + y * m[4 * c + 1] + z * m[4 * c + 2] + m[4 * c + 3]);
+			}
+		}
+
+		args.OutX[v] = out[0];
+		args.OutY[v] = out[1];
+		args.OutZ[v] = out[2];
+	}
+}
+
+#if defined(LBS_KERNEL_X86)
+template <unsigned int Width>
+LBS_TARGET_AVX2 void LBSKernel::RunAVX2(const Args& args, unsigned int begin, unsigned int end)
+{
+	const unsigned int width = Width > 0 ? Width : args.Width;
+	const __m256i matSize = _mm256_set1_epi32(12);
+
+	for (unsigned int v = begin; v < end; v += 8)
+	{
+		const __m256 x = _mm256_loadu_ps(args.InX + v);
+		const __m256 y = _mm256_loadu_ps(args.InY + v);
+		const __m256 z = _mm256_loadu_ps(args.InZ + v);
+
+		__m256 outX = _mm256_setzero_ps();
+		__m256 outY = _mm256_setzero_ps();
+		__m256 outZ = _mm256_setzero_ps();
+		for (unsigned int s = 0; s < width; s++)
+		{
+			const unsigned int slot = s * args.Stride + v;
+			const __m256 w = _mm256_loadu_ps(args.Weights + slot);
+			const __m256i joints = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(args.Joints + slot));
+			const __m256i matIdx = _mm256_mullo_epi32(joints, matSize);
+
+			outX = _mm256_fmadd_ps(w, TransformColumnAVX2(args.Matrices + 0, matIdx, x, y, z), outX);
+			outY = _mm256_fmadd_ps(w, TransformColumnAVX2(args.Matrices + 4, matIdx, x, y, z), outY);
+			outZ = _mm256_fmadd_ps(w, TransformColumnAVX2(args.Matrices + 8, matIdx, x, y, z), outZ);
+		}
+
+		_mm256_storeu_ps(args.OutX + v, outX);
+		_mm256_storeu_ps(args.OutY + v, outY);
+		_mm256_storeu_ps(args.OutZ + v, outZ);
+	}
+}
+
+template <unsigned int Width>
+LBS_TARGET_AVX512 void LBSKernel::RunAVX512(const Args& args, unsigned int begin, unsigned int end)
+{
+	const unsigned int width = Width > 0 ? Width : args.Width;
+	const __m512i matSize = _mm512_set1_epi32(12);
+
+	for (unsigned int v = begin; v < end; v += 16)
+	{
+		const __m512 x = _mm512_loadu_ps(args.InX + v);
+		const __m512 y = _mm512_loadu_ps(args.InY + v);
+		const __m512 z = _mm512_loadu_ps(args.InZ + v);
+
+		__m512 outX = _mm512_setzero_ps();
+		__m512 outY = _mm512_setzero_ps();
+		__m512 outZ = _mm512_setzero_ps();
+		for (unsigned int s = 0; s < width; s++)
+		{
+			const unsigned int slot = s * args.Stride + v;
+			const __m512 w = _mm512_loadu_ps(args.Weights + slot);
+			const __m512i joints = _mm512_loadu_si512(args.Joints + slot);
+			const __m512i matIdx = _mm512_mullo_epi32(joints, matSize);
+
+			outX = _mm512_fmadd_ps(w, TransformColumnAVX512(args.Matrices + 0, matIdx, x, y, z), outX);
+			outY = _mm512_fmadd_ps(w, TransformColumnAVX512(args.Matrices + 4, matIdx, x, y, z), outY);
+			outZ = _mm512_fmadd_ps(w, TransformColumnAVX512(args.Matrices + 8, matIdx, x, y, z), outZ);
+		}
+
+		_mm512_storeu_ps(args.OutX + v, outX);
+		_mm512_storeu_ps(args.OutY + v, outY);
+		_mm512_storeu_ps(args.OutZ + v, outZ);
+	}
+}
+#else
+template <unsigned int Width>
+void LBSKernel::RunAVX2(const Args& args, unsigned int begin, unsigned int end)
+{
+	RunScalar<Width>(args, begin, end);
+}
+
+template <unsigned int Width>
+void LBSKernel::RunAVX512(const Args& args, unsigned int begin, unsigned int end)
+{
+	RunScalar<Width>(args, begin, end);
+}
+#endif
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+
+
+/// <summary>
+/// Vectorized Linear Blend Skinning kernels over structure-of-arrays float positions.
+/// Scalar, AVX2 and AVX-512 versions are built into the same binary and selected at runtime.
+/// </summary>
+class LBSKernel
+{
+public:
+	enum class ISA : int8_t
+	{
+		Scalar = 0,
+		AVX2,
+		AVX512,
+	};
+
+	/// <summary>
+	/// # of vertices processed at once by the widest kernel. Vertex ranges passed to Run must be aligned to this.
+	/// </summary>
+	static constexpr unsigned int BlockSize = 16;
+
+	/// <summary>
+	/// Largest width with its own kernel instantiation
+	/// </summary>
+	static constexpr unsigned int MaxUnrolledWidth = 8;
+
+	struct Args
+	{
+		/// <summary>
+		/// skinning matrices as 4x3 matrices (3 columns of float4), 12 floats per joint
+		/// </summary>
+		const float* Matrices = nullptr;
+
+		/// <summary>
+		/// joint index of slot s of vertex v is Joints[s * Stride + v]. Unused slots have zero weight and a valid joint index.
+		/// </summary>
+		const int32_t* Joints = nullptr;
+
+		/// <summary>
+		/// weight of slot s of vertex v is Weights[s * Stride + v]
+		/// </summary>
+		const float* Weights = nullptr;
+
+		/// <summary>
+		/// # of influence slots per vertex. Widths up to MaxUnrolledWidth run kernels unrolled for that width.
+		/// </summary>
+		unsigned int Width = 0;
+
+		/// <summary>
+		/// distance between the slots in Joints and Weights (a multiple of BlockSize)
+		/// </summary>
+		unsigned int Stride = 0;
+
+		const float* InX = nullptr;
+		const float* InY = nullptr;
+		const float* InZ = nullptr;
+
+		/// <summary>
+		/// output positions, which may be the same arrays as the input
+		/// </summary>
+		float* OutX = nullptr;
+		float* OutY = nullptr;
+		float* OutZ = nullptr;
+	};
+
+	/// <summary>
+	/// The widest instruction set supported by the running CPU
+	/// </summary>
+	static ISA DetectISA();
+
+	static const char* ISAName(ISA isa);
+
+	/// <summary>
+	/// Skin the vertices in [begin, end) with the kernel for the given instruction set
+	/// </summary>
+	/// <param name="isa"></param>
+	/// <param name="args"></param>
+	/// <param name="begin">multiple of BlockSize</param>
+	/// <param name="end">multiple of BlockSize</param>
+	static void Run(ISA isa, const Args& args, unsigned int begin, unsigned int end);
+
+private:
+	/// <summary>
+	/// Width = 0 reads the width from Args at runtime
+	/// </summary>
+	template <unsigned int Width>
+	static void RunWidth(ISA isa, const Args& args, unsigned int begin, unsigned int end);
+
+	template <unsigned int Width>
+	static void RunScalar(const Args& args, unsigned int begin, unsigned int end);
+	template <unsigned int Width>
+	static void RunAVX2(const Args& args, unsigned int begin, unsigned int end);
+	template <unsigned int Width>
+	static void RunAVX512(const Args& args, unsigned int begin, unsigned int end);
+};
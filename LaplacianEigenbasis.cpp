@@ -0,0 +1,244 @@
+#include "LaplacianEigenbasis.h"
+#include "ContentHash.h"
+#include <Eigen/Sparse>
+#include <Spectra/SymEigsShiftSolver.h>
+#include <Spectra/MatOp/SparseSymShiftSolve.h>
+#include <filesystem>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstring>
+
+namespace {
+	const char BasisMagic[8] = { 'L', 'A', 'P', 'E', 'I', 'G', 'E', 'N' };
+
+	/// <summary>
+	/// shift of the shift-invert iteration, slightly below the lowest eigenvalue 0 so that L_sym - sigma * I is positive definite
+	/// </summary>
+	const double EigenShift = -1e-3;
+}
+
+
+std::string LaplacianEigenbasis::FilePath(const std::string& directory, uint64_t topologyHash, unsigned int numEigenpairs)
+{
+	return (std::filesystem::path(directory) / (ContentHash::ToHex(topologyHash) + "_" + std::to_string(numEigenpairs) + ".lapeig")).string();
+}
+
+bool LaplacianEigenbasis::Compute(const MeshTopology& topology, unsigned int numEigenpairs)
+{
+	Clear();
+
+	const unsigned int numVertices = topology.NumVertices();
+	numEigenpairs = std::min(numEigenpairs, numVertices > 0 ? numVertices - 1 : 0);
+	if (numEigenpairs == 0)
+	{
+		return false;
+	}
+
+	// an isolated vertex has the degree 1 here, which makes its row of L_sym the identity as its column of L
+	const std::vector<uint32_t>& offsets = topology.AdjacencyOffsets();
+	const std::vector<uint32_t>& indices = topology.AdjacencyIndices();
+	m_ownedSqrtDegrees.resize(numVertices);
+	for (unsigned int vertIdx = 0; vertIdx < numVertices; vertIdx++)
+	{
+		m_ownedSqrtDegrees[vertIdx] = std::sqrt(static_cast<double>(std::max(topology.Degree(vertIdx), 1u)));
+	}
+
+	// L_sym, with the same pattern as the adjacency plus the diagonal
+	Eigen::SparseMatrix<double> laplacian(numVertices, numVertices);
+	std::vector<Eigen::Triplet<double>> tripletVec;
+	tripletVec.reserve(indices.size() + numVertices);
+	for (unsigned int vertIdx = 0; vertIdx < numVertices; vertIdx++)
+	{
+		tripletVec.emplace_back(vertIdx, vertIdx, 1.0);
+		for (uint32_t aIdx = offsets[vertIdx]; aIdx < offsets[vertIdx + 1]; aIdx++)
+		{
+			const uint32_t neighbour = indices[aIdx];
+			tripletVec.emplace_back(neighbour, vertIdx, -1.0 / (m_ownedSqrtDegrees[vertIdx] * m_ownedSqrtDegrees[neighbour]));
+		}
+	}
+	laplacian.setFromTriplets(tripletVec.begin(), tripletVec.end());
+
+	// the lowest eigenvalues of L_sym are the largest of (L_sym - sigma * I)^-1, which converge in a few iterations
+	Spectra::SparseSymShiftSolve<double> op(laplacian);
+	const unsigned int numLanczos = std::min(numVertices, std::max(2 * numEigenpairs + 1, numEigenpairs + 20));
+	Spectra::SymEigsShiftSolver<Spectra::SparseSymShiftSolve<double>> solver(op, numEigenpairs, numLanczos, EigenShift);
+	solver.init();
+	solver.compute(Spectra::SortRule::LargestMagn);
+	if (solver.info() != Spectra::CompInfo::Successful)
+	{
+		Clear();
+		return false;
+	}
+
+	const Eigen::VectorXd eigenvalues = solver.eigenvalues();
+	const Eigen::MatrixXd eigenvectors = solver.eigenvectors();
+
+	std::vector<unsigned int> order(numEigenpairs);
+	std::iota(order.begin(), order.end(), 0u);
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return eigenvalues[a] < eigenvalues[b]; });
+
+	m_ownedEigenvalues.resize(numEigenpairs);
+	m_ownedEigenvectors.resize(static_cast<size_t>(numVertices) * numEigenpairs);
+	for (unsigned int m = 0; m < numEigenpairs; m++)
+	{
+		m_ownedEigenvalues[m] = eigenvalues[order[m]];
+		for (unsigned int vertIdx = 0; vertIdx < numVertices; vertIdx++)
+		{
+			m_ownedEigenvectors[static_cast<size_t>(numEigenpairs) * vertIdx + m] = static_cast<float>(eigenvectors(vertIdx, order[m]));
+		}
+	}
+
+	m_numVertices = numVertices;
+	m_numEigenpairs = numEigenpairs;
+	m_eigenvalues = m_ownedEigenvalues.data();
+	m_sqrtDegrees = m_ownedSqrtDegrees.data();
+	m_eigenvectors = m_ownedEigenvectors.data();
+	return true;
+}
+
+bool LaplacianEigenbasis::Load(const std::string& path, uint64_t topologyHash, unsigned int numVertices, unsigned int numEigenpairs)
+{
+	Clear();
+
+	if (!m_file.Open(path) || m_file.Size() < sizeof(Header))
+	{
+		Clear();
+		return false;
+	}
+
+	Header header;
+	std::memcpy(&header, m_file.Data(), sizeof(Header));
+	if (std::memcmp(header.Magic, BasisMagic, sizeof(BasisMagic)) != 0
+		|| header.Version != FormatVersion
+		|| header.HeaderSize != sizeof(Header)
+		|| header.TopologyHash != topologyHash
+		|| header.NumVertices != numVertices
+		|| header.NumEigenpairs != numEigenpairs)
+	{
+		Clear();
+		return false;
+	}
+
+	// the size must match exactly, which also rejects truncated files
+	const size_t eigenvaluesSize = header.NumEigenpairs * sizeof(double);
+	const size_t degreesSize = header.NumVertices * sizeof(double);
+	const size_t eigenvectorsSize = header.NumVertices * header.NumEigenpairs * sizeof(float);
+	if (m_file.Size() != sizeof(Header) + eigenvaluesSize + degreesSize + eigenvectorsSize)
+	{
+		Clear();
+		return false;
+	}
+
+	// the doubles come first right after the header, so all the arrays are aligned in the mapping
+	const uint8_t* cursor = m_file.Data() + sizeof(Header);
+	m_eigenvalues = reinterpret_cast<const double*>(cursor);
+	cursor += eigenvaluesSize;
+	m_sqrtDegrees = reinterpret_cast<const double*>(cursor);
+	cursor += degreesSize;
+	m_eigenvectors = reinterpret_cast<const float*>(cursor);
+
+	m_numVertices = numVertices;
+	m_numEigenpairs = numEigenpairs;
+	return true;
+}
+
+bool LaplacianEigenbasis::Save(const std::string& path, uint64_t topologyHash) const
+{
+	if (m_numEigenpairs == 0)
+	{
+		return false;
+	}
+
+	std::error_code err;
+	const std::filesystem::path filePath(path);
+	std::filesystem::create_directories(filePath.parent_path(), err);
+
+	Header header;
+	std::memcpy(header.Magic, BasisMagic, sizeof(BasisMagic));
+	header.Version = FormatVersion;
+	header.HeaderSize = sizeof(Header);
+	header.TopologyHash = topologyHash;
+	header.NumVertices = m_numVertices;
+	header.NumEigenpairs = m_numEigenpairs;
+
+	// write to a temporary file first, and rename it so that other processes see either nothing or the whole file
+	const uint64_t suffix = static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count())
+		^ std::hash<std::thread::id>()(std::this_thread::get_id());
+	const std::filesystem::path tmpPath = filePath.string() + "." + ContentHash::ToHex(suffix) + ".tmp";
+	{
+		std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			return false;
+		}
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+		file.write(reinterpret_cast<const char*>(m_eigenvalues), header.NumEigenpairs * sizeof(double));
+		file.write(reinterpret_cast<const char*>(m_sqrtDegrees), header.NumVertices * sizeof(double));
+		file.write(reinterpret_cast<const char*>(m_eigenvectors), header.NumVertices * header.NumEigenpairs * sizeof(float));
+
+		if (!file)
+		{
+			file.close();
+			std::filesystem::remove(tmpPath, err);
+			return false;
+		}
+	}
+
+	std::filesystem::rename(tmpPath, filePath, err);
+	if (err)
+	{
+		std::filesystem::remove(tmpPath, err);
+		return false;
+	}
+
+	return true;
+}
+
+void LaplacianEigenbasis::Clear()
+{
+	m_numVertices = 0;
+	m_numEigenpairs = 0;
+	m_eigenvalues = nullptr;
+	m_sqrtDegrees = nullptr;
+	m_eigenvectors = nullptr;
+	m_ownedEigenvalues = std::vector<double>();
+	m_ownedSqrtDegrees = std::vector<double>();
+	m_ownedEigenvectors = std::vector<float>();
+	m_file.Close();
+}
+
+void LaplacianEigenbasis::ComputeResponse(double amount, int p, bool isImplicit, Eigen::VectorXd& response) const
+{
+	response.resize(m_numEigenpairs);
+	for (unsigned int m = 0; m < m_numEigenpairs; m++)
+	{
+		response[m] = isImplicit
+			? std::pow(1.0 + amount * m_eigenvalues[m], -static_cast<double>(p))
+			: std::pow(1.0 - amount * m_eigenvalues[m], static_cast<double>(p));
+	}
+}
+
+void LaplacianEigenbasis::ApplyTransposedOnRows(
+	const unsigned int* rows, size_t numRows, const Eigen::VectorXd& response, Eigen::MatrixXd& fields) const
+{
+	const Eigen::Index numRowsIdx = static_cast<Eigen::Index>(numRows);
+	const Eigen::Index numEigenpairs = static_cast<Eigen::Index>(m_numEigenpairs);
+
+	// B^t = D^-1/2 * V * f(Lambda) * V^t * D^1/2, and only the rows of V on the support are needed on both sides
+	Eigen::MatrixXd basis(numRowsIdx, numEigenpairs);
+	Eigen::VectorXd sqrtDegrees(numRowsIdx);
+	for (Eigen::Index r = 0; r < numRowsIdx; r++)
+	{
+		basis.row(r) = Eigen::Map<const Eigen::RowVectorXf>(m_eigenvectors + static_cast<size_t>(m_numEigenpairs) * rows[r], numEigenpairs).cast<double>();
+		sqrtDegrees[r] = m_sqrtDegrees[rows[r]];
+	}
+
+	const Eigen::MatrixXd coeffs = response.asDiagonal() * (basis.transpose() * (sqrtDegrees.asDiagonal() * fields));
+	fields = sqrtDegrees.cwiseInverse().asDiagonal() * (basis * coeffs);
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include "MeshTopology.h"
+#include "MappedFile.h"
+#include <Eigen/Core>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+
+/// <summary>
+/// Lowest eigenpairs of the symmetric normalized Laplacian L_sym = I - D^-1/2 * A * D^-1/2 of a mesh.
+/// The normalized Laplacian L = I - A * D^-1 is D^1/2 * L_sym * D^-1/2, so a smoothing f(L) is approximated by the low-rank
+/// D^1/2 * V * f(Lambda) * V^t * D^-1/2, which drops the high frequencies the smoothing damps anyway.
+/// The basis only depends on the topology and is kept in a binary file named by the topology hash, whose arrays are used
+/// in place in the memory mapping.
+/// </summary>
+class LaplacianEigenbasis
+{
+public:
+	LaplacianEigenbasis() = default;
+	~LaplacianEigenbasis() = default;
+
+	LaplacianEigenbasis(const LaplacianEigenbasis&) = delete;
+	LaplacianEigenbasis& operator=(const LaplacianEigenbasis&) = delete;
+
+	/// <summary>
+	/// Path of the basis file of the topology with the # of eigenpairs
+	/// </summary>
+	static std::string FilePath(const std::string& directory, uint64_t topologyHash, unsigned int numEigenpairs);
+
+	/// <summary>
+	/// Compute the lowest eigenpairs by the shift-invert Lanczos iteration, which factorizes L_sym once and never forms a dense matrix
+	/// </summary>
+	/// <param name="topology"></param>
+	/// <param name="numEigenpairs">clamped to # of vertices - 1</param>
+	/// <returns>false if the iteration did not converge, in which case the basis is empty</returns>
+	bool Compute(const MeshTopology& topology, unsigned int numEigenpairs);
+
+	/// <summary>
+	/// Map the basis file if it is valid for the topology and the sizes
+	/// </summary>
+	/// <returns>false if there is no valid file, in which case the basis is empty</returns>
+	bool Load(const std::string& path, uint64_t topologyHash, unsigned int numVertices, unsigned int numEigenpairs);
+
+	/// <summary>
+	/// Write the basis to the file atomically, creating the directory if necessary
+	/// </summary>
+	bool Save(const std::string& path, uint64_t topologyHash) const;
+
+	void Clear();
+
+	unsigned int NumVertices() const
+	{
+		return m_numVertices;
+	}
+
+	unsigned int NumEigenpairs() const
+	{
+		return m_numEigenpairs;
+	}
+
+	/// <summary>
+	/// eigenvalues in ascending order, in [0, 2]
+	/// </summary>
+	const double* Eigenvalues() const
+	{
+		return m_eigenvalues;
+	}
+
+	/// <summary>
+	/// Response f(lambda) of each eigenvalue to the smoothing of the DDM: (1 - amount * lambda)^p, or (1 + amount * lambda)^-p if implicit
+	/// </summary>
+	void ComputeResponse(double amount, int p, bool isImplicit, Eigen::VectorXd& response) const;
+
+	/// <summary>
+	/// Replace the fields by B^t * fields with the low-rank B = D^1/2 * V * diag(response) * V^t * D^-1/2, when the fields are zero
+	/// outside the rows and only needed on the rows. The cost is O(# of rows * # of eigenpairs) per field. This is const and can be
+	/// called from multiple threads.
+	/// </summary>
+	/// <param name="rows">vertex of each row of the fields</param>
+	/// <param name="numRows"></param>
+	/// <param name="response">of each eigenvalue</param>
+	/// <param name="fields">[in, out] # of rows x # of fields</param>
+	void ApplyTransposedOnRows(const unsigned int* rows, size_t numRows, const Eigen::VectorXd& response, Eigen::MatrixXd& fields) const;
+
+private:
+	static constexpr uint32_t FormatVersion = 1;
+
+	/// <summary>
+	/// File layout: Header, eigenvalues (NumEigenpairs doubles), square roots of the degrees (NumVertices doubles),
+	/// eigenvectors (NumEigenpairs floats per vertex, vertex by vertex so that the rows of a region are contiguous)
+	/// </summary>
+	struct Header
+	{
+		char Magic[8];
+		uint32_t Version;
+		uint32_t HeaderSize;
+		uint64_t TopologyHash;
+		uint64_t NumVertices;
+		uint64_t NumEigenpairs;
+	};
+
+	unsigned int m_numVertices = 0;
+	unsigned int m_numEigenpairs = 0;
+
+	/// <summary>
+	/// the arrays below point into either the owned storage or the mapped file
+	/// </summary>
+	const double* m_eigenvalues = nullptr;
+	const double* m_sqrtDegrees = nullptr;
+	const float* m_eigenvectors = nullptr;
+
+	std::vector<double> m_ownedEigenvalues;
+	std::vector<double> m_ownedSqrtDegrees;
+	std::vector<float> m_ownedEigenvectors;
+	MappedFile m_file;
+};
@@ -0,0 +1,51 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+
+/// <summary>
+/// Read-only memory mapping of a whole file
+/// </summary>
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/// <summary>
+	/// Map the file. Returns false if the file does not exist or cannot be mapped.
+	/// </summary>
+	bool Open(const std::string& path);
+
+	void Close();
+
+	bool IsOpen() const
+	{
+		return m_data != nullptr;
+	}
+
+	const uint8_t* Data() const
+	{
+		return m_data;
+	}
+
+	size_t Size() const
+	{
+		return m_size;
+	}
+
+private:
+	const uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+
+#if defined(_WIN32)
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#else
+	int m_fd = -1;
+#endif
+};
@@ -1,6 +1,7 @@
 #include "MatrixUtil.h"
 #include <Eigen/Eigenvalues> 
 #include <Eigen/SVD>
+#include <cmath>
 
 
 void MatrixUtil::SingularValueDecomposition(const MMatrix& mat, MMatrix& u, MMatrix& vt)
@@ -162,6 +163,32 @@ MMatrix MatrixUtil::QuaternionToMatrix(const MQuaternion& q)
     return mat;
 }
 
+void MatrixUtil::AccumulateOuterProduct(const MPoint& a, double scale, double* packed)
+{
+    for (int r = 0, idx = 0; r < 4; r++)
+    {
+        const double sa = scale * a[r];
+        for (int c = r; c < 4; c++, idx++)
+        {
+            packed[idx] += sa * a[c];
+        }
+    }
+}
+
+MMatrix MatrixUtil::UnpackSymmetricMatrix(const float* packed)
+{
+    MMatrix mat;
+    for (int r = 0, idx = 0; r < 4; r++)
+    {
+        for (int c = r; c < 4; c++, idx++)
+        {
+            mat[r][c] = mat[c][r] = packed[idx];
+        }
+    }
+
+    return mat;
+}
+
 void MatrixUtil::FromMMatrixToEigenMat3(const MMatrix& in, Eigen::Matrix3d& out)
 {
     for (int c = 0; c < 3; c++)
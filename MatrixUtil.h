@@ -62,6 +62,27 @@ public:
 	/// <returns></returns>
 	static MMatrix QuaternionToMatrix(const MQuaternion& quat);
 
+	/// <summary>
+	/// # of unique elements of a symmetric 4x4 matrix
+	/// </summary>
+	static constexpr unsigned int NumSymmetricElements = 10;
+
+	/// <summary>
+	/// Add scale * a * a^t to the symmetric 4x4 matrix packed as its upper triangle row by row:
+	/// (00, 01, 02, 03, 11, 12, 13, 22, 23, 33)
+	/// </summary>
+	/// <param name="a">4d vector</param>
+	/// <param name="scale"></param>
+	/// <param name="packed">[in, out] NumSymmetricElements elements</param>
+	static void AccumulateOuterProduct(const MPoint& a, double scale, double* packed);
+
+	/// <summary>
+	/// Expand the packed symmetric matrix (see AccumulateOuterProduct) to 4x4 matrix
+	/// </summary>
+	/// <param name="packed">NumSymmetricElements elements</param>
+	/// <returns></returns>
+	static MMatrix UnpackSymmetricMatrix(const float* packed);
+
 private:
 	static void FromMMatrixToEigenMat3(const MMatrix& in, Eigen::Matrix3d& out);
 	static void FromEigenMat3ToMMatrix(const Eigen::Matrix3d& in, MMatrix& out);
@@ -1,304 +1,215 @@
 #include "MeshLaplacian.h"
-#include <Spectra/MatOp/SparseCholesky.h>
-#include <Spectra/GenEigsSolver.h>
-#include <Spectra/MatOp/SparseGenMatProd.h>
 
-#include <iomanip>
-#include <filesystem>
-#include <fstream>
-#include <sstream>
 #include <Eigen/Core>
-#include <Eigen/LU>
-#include <iostream>
-#include <set>
 #include <array>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <cassert>
+#include "ParallelUtil.h"
 
 typedef Eigen::Triplet<double> Trp;
-const double err = 1e-12;
 
 
-Eigen::SparseMatrix<double> MeshLaplacian::TestMatrix(int seed = -1)
+void MeshLaplacian::ComputeSmoothingMatrixIteratively(
+    const Eigen::SparseMatrix<double>& laplacian,
+    const int numVertices,
+    double lambda,
+    int p,
+    const SmoothingPruning& pruning,
+    int numThreads,
+    Eigen::SparseMatrix<double>& B,
+    SmoothingMatrixStats* stats)
 {
-    std::vector<Trp> tripletVec;
+    Eigen::SparseMatrix<double> Identity(numVertices, numVertices);
+    Identity.setIdentity();
 
-    if (seed == -1)
-    {
-        // case with complex eigen values and vectors
-        tripletVec.push_back(Trp(0, 3, -1));
-        tripletVec.push_back(Trp(3, 0, 1));
-        tripletVec.push_back(Trp(1, 1, 1));
-        tripletVec.push_back(Trp(2, 2, -1));
-    }
-    else
-    {
-        tripletVec.push_back(Trp(0, 3, 1));
-        tripletVec.push_back(Trp(1, 2, 2));
-        tripletVec.push_back(Trp(2, 1, 3));
-        tripletVec.push_back(Trp(3, 0, 2));
-    }
+    // one smoothing step, column-major so that S * x only visits the columns of the nonzeros of x
+    Eigen::SparseMatrix<double> S = Identity - lambda * laplacian;
+    S.makeCompressed();
 
-    Eigen::SparseMatrix<double> mat(4, 4);
-    mat.setFromTriplets(tripletVec.begin(), tripletVec.end());
-    return mat;
-}
+    // the j-th column of B is S^p * e_j, which is computed independently of the other columns
+    std::vector<std::vector<int>> colRows(numVertices);
+    std::vector<std::vector<double>> colValues(numVertices);
+    std::vector<double> droppedMass(numVertices, 0.0);
 
-void MeshLaplacian::DiagonalizeGenSparseMatrix(const Eigen::SparseMatrix<double>& Mat, const std::string filepath)
-{
-    int matSize = Mat.rows();
-    if (matSize != Mat.cols())
-    {
-        std::cerr << "Error: only regular matrix can be diagonalized." << std::endl;
-        return;
-    }
+    ParallelUtil::ForEachChunk(numVertices, numThreads, [&](int begin, int end)
+        {
+            // sparse accumulator: dense values and the slot of each row in the current column (-1 if absent)
+            std::vector<double> accum(numVertices, 0.0);
+            std::vector<int> slots(numVertices, -1);
+            std::vector<int> rows, nextRows;
+            std::vector<double> values, nextValues;
 
-    // decompose the process into two stages: compute larger half eigen values, and then smaller half
-    int numEigs = matSize / 2;
-    Spectra::SparseGenMatProd<double> op(Mat);
+            for (int colIdx = begin; colIdx < end; colIdx++)
+            {
+                rows.assign(1, colIdx);
+                values.assign(1, 1.0);
+                double dropped = 0.0;
+
+                for (int step = 1; step <= p; step++)
+                {
+                    // an entry first appears at the step equal to its ring distance from the vertex,
+                    // so freezing the pattern after MaxRing steps keeps the column within MaxRing rings
+                    const bool canGrow = pruning.MaxRing <= 0 || step <= pruning.MaxRing;
+
+                    nextRows.clear();
+                    if (!canGrow)
+                    {
+                        for (int row : rows)
+                        {
+                            slots[row] = static_cast<int>(nextRows.size());
+                            nextRows.push_back(row);
+                        }
+                    }
+
+                    for (size_t i = 0; i < rows.size(); i++)
+                    {
+                        const double x = values[i];
+                        for (Eigen::SparseMatrix<double>::InnerIterator it(S, rows[i]); it; ++it)
+                        {
+                            const int row = static_cast<int>(it.row());
+                            if (slots[row] < 0)
+                            {
+                                if (!canGrow)
+                                {
+                                    dropped += std::abs(x * it.value());
+                                    continue;
+                                }
+                                slots[row] = static_cast<int>(nextRows.size());
+                                nextRows.push_back(row);
+                            }
+                            accum[row] += x * it.value();
+                        }
+                    }
+
+                    // gather the column, dropping the small entries, and clear the accumulator
+                    rows.clear();
+                    values.clear();
+                    for (int row : nextRows)
+                    {
+                        const double value = accum[row];
+                        accum[row] = 0.0;
+                        slots[row] = -1;
+                        if (std::abs(value) < pruning.Threshold)
+                        {
+                            dropped += std::abs(value);
+                            continue;
+                        }
+                        rows.push_back(row);
+                        values.push_back(value);
+                    }
+                }
+
+                // the inner indices of each column must be sorted
+                std::vector<std::pair<int, double>> entries(rows.size());
+                for (size_t i = 0; i < rows.size(); i++)
+                {
+                    entries[i] = { rows[i], values[i] };
+                }
+                std::sort(entries.begin(), entries.end());
+
+                colRows[colIdx].resize(entries.size());
+                colValues[colIdx].resize(entries.size());
+                for (size_t i = 0; i < entries.size(); i++)
+                {
+                    colRows[colIdx][i] = entries[i].first;
+                    colValues[colIdx][i] = entries[i].second;
+                }
+                droppedMass[colIdx] = dropped;
+            }
+        });
 
-    // First, compute the larger half eigen values
-    Spectra::GenEigsSolver<Spectra::SparseGenMatProd<double>> solverLargerHalf(op, numEigs + matSize % 2, matSize);
-    solverLargerHalf.init();
-    solverLargerHalf.compute(Spectra::SortRule::LargestReal);
-    if (solverLargerHalf.info() != Spectra::CompInfo::Successful)
+    // assemble the compressed matrix from the columns
+    B.resize(numVertices, numVertices);
+    size_t numNonZeros = 0;
+    for (int colIdx = 0; colIdx < numVertices; colIdx++)
     {
-        std::cerr << "Error: failed to compute larger half eigen values" << std::endl;
-        return;
+        numNonZeros += colRows[colIdx].size();
     }
+    B.resizeNonZeros(static_cast<Eigen::Index>(numNonZeros));
 
-    // Next, compute the smaller half eigen values
-    Spectra::GenEigsSolver<Spectra::SparseGenMatProd<double>> solverSmallerHalf(op, numEigs, matSize);
-    solverSmallerHalf.init();
-    solverSmallerHalf.compute(Spectra::SortRule::SmallestReal);
-    if (solverSmallerHalf.info() != Spectra::CompInfo::Successful)
+    size_t offset = 0;
+    for (int colIdx = 0; colIdx < numVertices; colIdx++)
     {
-        std::cerr << "Error: failed to compute smaller half eigen values" << std::endl;
-        return;
+        B.outerIndexPtr()[colIdx] = static_cast<int>(offset);
+        std::copy(colRows[colIdx].begin(), colRows[colIdx].end(), B.innerIndexPtr() + offset);
+        std::copy(colValues[colIdx].begin(), colValues[colIdx].end(), B.valuePtr() + offset);
+        offset += colRows[colIdx].size();
     }
+    B.outerIndexPtr()[numVertices] = static_cast<int>(offset);
 
-    // Save the results in a csv file
-    std::ofstream file;
-    file.open(filepath, std::ios::out);
-    std::cout << std::fixed;
-
-    // write eigen values
-    Eigen::VectorXcd eigVals(matSize);
-    eigVals << solverLargerHalf.eigenvalues(), solverSmallerHalf.eigenvalues();
-    for (size_t i = 0; i < matSize; i++)
+    if (stats)
     {
-        file << std::setprecision(12) << eigVals[i];
-        if (i == matSize - 1)
+        stats->NumNonZeros = numNonZeros;
+        stats->MaxDroppedMass = 0.0;
+        stats->MeanDroppedMass = 0.0;
+        for (double mass : droppedMass)
         {
-            file << std::endl;
-            break;
+            stats->MaxDroppedMass = std::max(stats->MaxDroppedMass, mass);
+            stats->MeanDroppedMass += mass;
         }
-        file << " ";
-    }
-
-    // write eigen vectors
-    Eigen::MatrixXcd eigVecs(matSize, matSize);
-    eigVecs << solverLargerHalf.eigenvectors(), solverSmallerHalf.eigenvectors();
-    for (size_t i = 0; i < matSize; i++)
-    {
-        for (size_t j = 0; j < matSize; j++)
+        if (numVertices > 0)
         {
-            file << std::setprecision(12) << eigVecs.coeff(i, j);
-            if (j == matSize - 1)
-            {
-                file << std::endl;
-                break;
-            }
-            file << " ";
+            stats->MeanDroppedMass /= numVertices;
         }
     }
-    file.close();
-
-    // check
-    //std::cout << "original mat:" << std::endl << Mat << std::endl;
-
-    //std::cout << "eigvals: " << std::endl << eigVals << std::endl;
-    //std::cout << "eigVecs: " << std::endl << eigVecs << std::endl;
-
-    //Eigen::MatrixXcd inv = eigVecs.inverse();
-    //Eigen::MatrixXcd original = eigVecs * (eigVals.asDiagonal()) * inv;
-    //std::cout << "original:" << std::endl << original << std::endl;
 }
 
-void MeshLaplacian::GetDiagonalizationResult(
-    Eigen::VectorXcd& eigVals,
-    Eigen::MatrixXcd& eigVecs,
-    const std::vector<unsigned int>& indices,
-    const int numVertices,
-    const std::string filepath)
+bool ImplicitSmoothing::Compute(const Eigen::SparseMatrix<double>& laplacian, double lambda, int p)
 {
-    // if still not computed eigen vals and vectors, save it as the csv file
-    if (!std::filesystem::exists(filepath))
-    {
-        Eigen::SparseMatrix<double> laplacian;
-        //ComputeLaplacian(indices, numVertices, laplacian);
-        DiagonalizeGenSparseMatrix(laplacian, filepath);
-    }
-
-    // read eigen values and vectors from csv file
-    std::ifstream file;
-    file.open(filepath, std::ios::in);
-    std::string buf;
+    Clear();
 
-    // get eigen values from the first line
-    if (std::getline(file, buf))
+    // L = I - A * D^-1 has -1/d_j at the neighbors of vertex j in column j, so the adjacency is its off-diagonal pattern
+    const Eigen::Index numVertices = laplacian.cols();
+    Eigen::VectorXd degrees = Eigen::VectorXd::Zero(numVertices);
+    std::vector<Trp> tripletVec;
+    tripletVec.reserve(static_cast<size_t>(laplacian.nonZeros()) + numVertices);
+    for (Eigen::Index j = 0; j < numVertices; j++)
     {
-        std::istringstream ss(buf);
-        Eigen::dcomplex c;
-        int idx = 0;
-        while (ss >> c)
+        for (Eigen::SparseMatrix<double>::InnerIterator it(laplacian, j); it; ++it)
         {
-            eigVals[idx++] = c;
+            if (it.row() != j && it.value() != 0.0)
+            {
+                degrees[j] += 1.0;
+                tripletVec.push_back(Trp(static_cast<int>(it.row()), static_cast<int>(j), -lambda));
+            }
         }
-    }
 
-    // get eigen vectors
-    int row = 0;
-    while (std::getline(file, buf))
-    {
-        std::istringstream ss(buf);
-        Eigen::dcomplex c;
-        int col = 0;
-        while (ss >> c)
-        {
-            eigVecs(row, col++) = c;
-        }
-        row++;
+        // an isolated vertex has no neighbors to be smoothed with, and (I + lambda * L)_jj = 1 + lambda as the normalized Laplacian
+        degrees[j] = std::max(degrees[j], 1.0);
+        tripletVec.push_back(Trp(static_cast<int>(j), static_cast<int>(j), (1.0 + lambda) * degrees[j]));
     }
-}
 
-void MeshLaplacian::ComputeLaplacian(MItMeshEdge& itEdge, const int numVertices, Eigen::SparseMatrix<double>& laplacian)
-{
-    // generate the normalized Laplacian Matrix
-    unsigned int matSize = numVertices;
-    std::vector<Trp> tripletVec;
-    Eigen::VectorXd degrees = Eigen::VectorXd::Zero(matSize);
-    std::set<std::pair<int, int>> countedEdges;
-    for (itEdge.reset(); !itEdge.isDone(); itEdge.next())
-    {
-        // get the vertices in the edge
-        int idx0 = itEdge.index(0), idx1 = itEdge.index(1);
-
-        auto edge = std::pair<int, int>(idx0, idx1);
-        if (countedEdges.find(edge) == countedEdges.end())//  if ͕sv
-        {
-            degrees[idx0] += 1;
-            degrees[idx1] += 1;
+    // (1 + lambda) * D - lambda * A, which is symmetric and diagonally dominant
+    Eigen::SparseMatrix<double> system(numVertices, numVertices);
+    system.setFromTriplets(tripletVec.begin(), tripletVec.end());
 
-            tripletVec.push_back(Trp(idx0, idx1, 1));
-            tripletVec.push_back(Trp(idx1, idx0, 1));
-
-            countedEdges.emplace(std::move(edge));
-        }
-        else
-        {
-            std::cout << "ɂ͗Ȃ˂" << std::endl;
-        }
+    m_solver = std::make_unique<Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>>>(system);
+    if (m_solver->info() != Eigen::Success)
+    {
+        Clear();
+        return false;
     }
 
-    // Adjacency Matrix
-    Eigen::SparseMatrix<double> A(matSize, matSize);
-    A.setFromTriplets(tripletVec.begin(), tripletVec.end());
-
-    //std::cout << "A: " << A << std::endl;
-
-    // Inverse Degree Matrix
-    Eigen::SparseMatrix<double> Dinv = Eigen::SparseMatrix<double>(degrees.cwiseInverse().asDiagonal());
-
-    //std::cout << "Dinv: " << Dinv << std::endl;
-
-    // Identity Matrix
-    Eigen::SparseMatrix<double> Identity(matSize, matSize);
-    Identity.setIdentity();
-
-    // Normalized Laplacian
-    laplacian = Identity - A * Dinv;
-
-    //std::cout << "Laplacian: " << laplacian << std::endl;
+    m_degrees = std::move(degrees);
+    m_p = p;
+    return true;
 }
 
-void MeshLaplacian::ComputeSmoothingMatrix(
-    const std::vector<unsigned int>& indices,
-    const int numVertices,
-    const std::string filepath,
-    double lambda,
-    int p)
+void ImplicitSmoothing::ApplyTransposed(Eigen::MatrixXd& fields) const
 {
-    Eigen::VectorXcd eigVals(numVertices);
-    Eigen::MatrixXcd eigVecs(numVertices, numVertices);
-
-    GetDiagonalizationResult(eigVals, eigVecs, indices, numVertices, filepath);
-
-    // compute B = (I + lambda*L)^{-p} = V * (I + lambda*D)^{-p} * V^{-1}  where L = V * D * V^{-1}
-    Eigen::VectorXd diag(numVertices);
-    for (size_t i = 0; i < numVertices; i++)
+    assert(fields.rows() == m_degrees.size());
+    for (int i = 0; i < m_p; i++)
     {
-        // assume all eigen values are real
-        diag[i] = eigVals[i].real();//std::pow(1 + lambda * eigVals[i].real(), -p);
-    }
-
-    Eigen::MatrixXcd B = eigVecs /** diag.asDiagonal()*/ * eigVecs.inverse();
-
-    //std::cout << "B:" << std::endl << B << std::endl;
-    for (size_t i = 0; i < B.rows(); i++)
-    {
-        for (size_t j = 0; j < B.cols(); j++)
-        {
-            if (std::abs(B.coeff(i, j).imag()) > err)
-            {
-                std::cout << B.coeff(i, j) << std::endl;
-            }
-        }
+        fields = m_degrees.asDiagonal() * fields;
+        fields = m_solver->solve(fields);
     }
 }
 
-void MeshLaplacian::ComputeSmoothingMatrix(
-    const Eigen::SparseMatrix<double>& laplacian,
-    const int numVertices,
-    double lambda,
-    int p,
-    bool isImplicit,
-    Eigen::SparseMatrix<double>& B)
+void ImplicitSmoothing::Clear()
 {
-    Eigen::SparseMatrix<double> Identity(numVertices, numVertices);
-    Identity.setIdentity();
-
-    Eigen::SparseMatrix<double> seed = Identity;
-    if (isImplicit)
-    {
-        seed += lambda * laplacian;
-        Eigen::SimplicialLLT<Eigen::SparseMatrix<double>> inverseSolver;
-        inverseSolver.compute(seed);
-        if (inverseSolver.info() != Eigen::Success)
-        {
-            return;
-        }
-        seed = inverseSolver.solve(Identity);
-        if (inverseSolver.info() != Eigen::Success)
-        {
-            return;
-        }
-    }
-    else
-    {
-        seed -= lambda * laplacian;
-    }
-
-    B = Identity;
-    for (int i = 0; p != 0; i++)
-    {
-        if (i > 0)
-        {
-            seed = seed * seed;
-        }
-
-        if (p & (1 << i))
-        {
-            B = B * seed;
-            p &= ~(1 << i);
-        }
-    }
+    m_solver.reset();
+    m_degrees.resize(0);
+    m_p = 0;
 }
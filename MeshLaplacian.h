@@ -2,45 +2,104 @@
 
 #include <Eigen/Sparse>
 #include <vector>
-#include <maya/MItMeshEdge.h>
+#include <cstddef>
+#include <memory>
 
 class MeshLaplacian
 {
 public:
-	static Eigen::SparseMatrix<double> TestMatrix(int);
-
-	static void DiagonalizeGenSparseMatrix(const Eigen::SparseMatrix<double>& Mat, const std::string filepath);
+	/// <summary>
+	/// Pruning of the smoothing matrix built by ComputeSmoothingMatrixIteratively
+	/// </summary>
+	struct SmoothingPruning
+	{
+		/// <summary>
+		/// entries whose magnitude is below this are dropped after each step. Zero keeps all the entries.
+		/// </summary>
+		double Threshold {0.0};
 
-	static void GetDiagonalizationResult(
-		Eigen::VectorXcd& eigVals,
-		Eigen::MatrixXcd& eigVecs,
-		const std::vector<unsigned int>& indices,
-		const int numVertices,
-		const std::string filepath);
+		/// <summary>
+		/// entries farther than this many rings from the vertex of the column are dropped. Zero means no limit.
+		/// </summary>
+		int MaxRing {0};
+	};
 
 	/// <summary>
-	/// Compute Normalized Laplacian
+	/// Size and accuracy of the smoothing matrix built by ComputeSmoothingMatrixIteratively
 	/// </summary>
-	/// <param name="indices"></param>
-	/// <param name="numVertices"></param>
-	/// <returns></returns>
-	static void ComputeLaplacian(
-		MItMeshEdge& itEdge,
-		const int numVertices,
-		Eigen::SparseMatrix<double>& laplacian);
+	struct SmoothingMatrixStats
+	{
+		size_t NumNonZeros {0};
 
-	static void ComputeSmoothingMatrix(
-		const std::vector<unsigned int>& indices,
-		const int numVertices,
-		const std::string filepath,
-		double lambda,
-		int p);
+		/// <summary>
+		/// total magnitude of the dropped entries of each column, which bounds the 1-norm of the error of the column
+		/// as long as I - lambda * L has no negative entries (0 <= lambda <= 1)
+		/// </summary>
+		double MaxDroppedMass {0.0};
+		double MeanDroppedMass {0.0};
+	};
 
-	static void ComputeSmoothingMatrix(
+	/// <summary>
+	/// Compute the explicit smoothing matrix B = (I - lambda * L)^p by applying I - lambda * L to each column p times,
+	/// instead of squaring the whole matrix. Each column is pruned after every step, which bounds the fill-in
+	/// that otherwise makes B dense at high p.
+	/// </summary>
+	/// <param name="laplacian"></param>
+	/// <param name="numVertices"></param>
+	/// <param name="lambda"></param>
+	/// <param name="p"></param>
+	/// <param name="pruning"></param>
+	/// <param name="numThreads">zero means all the available threads</param>
+	/// <param name="B">[out]</param>
+	/// <param name="stats">[out] optional</param>
+	static void ComputeSmoothingMatrixIteratively(
 		const Eigen::SparseMatrix<double>& laplacian,
 		const int numVertices,
 		double lambda,
 		int p,
-		bool isImplicit,
-		Eigen::SparseMatrix<double>& B);
-};
\ No newline at end of file
+		const SmoothingPruning& pruning,
+		int numThreads,
+		Eigen::SparseMatrix<double>& B,
+		SmoothingMatrixStats* stats = nullptr);
+};
+
+/// <summary>
+/// Implicit smoothing B = (I + lambda * L)^-p of the normalized Laplacian L = I - A * D^-1, applied to vertex fields without forming B.
+/// Since I + lambda * L^t = D^-1 * ((1 + lambda) * D - lambda * A), B^t * f is computed by solving the symmetric positive definite system
+/// ((1 + lambda) * D - lambda * A) * g = D * f p times. The factorization only depends on the topology and the smoothing property,
+/// so it is kept and reused for any number of fields.
+/// </summary>
+class ImplicitSmoothing
+{
+public:
+	/// <summary>
+	/// Factorize the system for the given Laplacian computed by MeshTopology::ComputeLaplacian
+	/// </summary>
+	/// <param name="laplacian"></param>
+	/// <param name="lambda">non-negative</param>
+	/// <param name="p"></param>
+	/// <returns>false if the factorization failed</returns>
+	bool Compute(const Eigen::SparseMatrix<double>& laplacian, double lambda, int p);
+
+	/// <summary>
+	/// Replace each column f of fields with B^t * f. This is const and can be called from multiple threads.
+	/// </summary>
+	/// <param name="fields">[in, out] # of vertices x # of fields</param>
+	void ApplyTransposed(Eigen::MatrixXd& fields) const;
+
+	/// <summary>
+	/// # of vertices of the factorized system, zero if not computed
+	/// </summary>
+	Eigen::Index NumVertices() const
+	{
+		return m_degrees.size();
+	}
+
+	void Clear();
+
+private:
+	// the solver is not copyable, and is released by Clear
+	std::unique_ptr<Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>>> m_solver;
+	Eigen::VectorXd m_degrees;
+	int m_p {0};
+};
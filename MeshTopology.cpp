@@ -0,0 +1,320 @@
+#include "MeshTopology.h"
+#include "ParallelUtil.h"
+#include <maya/MFnMesh.h>
+#include <maya/MIntArray.h>
+#include <algorithm>
+#include <utility>
+
+
+MStatus MeshTopology::Build(MObject& mesh, int numThreads)
+{
+	MStatus stat;
+	MFnMesh meshFn(mesh, &stat);
+	CHECK_MSTATUS_AND_RETURN_IT(stat);
+
+	// counts and indices of all the polygons at once, instead of iterating the components
+	MIntArray polyCounts, polyConnects;
+	stat = meshFn.getVertices(polyCounts, polyConnects);
+	CHECK_MSTATUS_AND_RETURN_IT(stat);
+
+	std::vector<uint32_t> faceOffsets(polyCounts.length() + 1);
+	faceOffsets[0] = 0;
+	for (unsigned int faceIdx = 0; faceIdx < polyCounts.length(); faceIdx++)
+	{
+		faceOffsets[faceIdx + 1] = faceOffsets[faceIdx] + static_cast<uint32_t>(polyCounts[faceIdx]);
+	}
+
+	std::vector<uint32_t> faceVertices(polyConnects.length());
+	for (unsigned int fvIdx = 0; fvIdx < polyConnects.length(); fvIdx++)
+	{
+		faceVertices[fvIdx] = static_cast<uint32_t>(polyConnects[fvIdx]);
+	}
+
+	Build(static_cast<uint32_t>(meshFn.numVertices()), std::move(faceOffsets), std::move(faceVertices), numThreads);
+	return stat;
+}
+
+void MeshTopology::Build(uint32_t numVertices, std::vector<uint32_t> faceOffsets, std::vector<uint32_t> faceVertices, int numThreads)
+{
+	m_numVertices = numVertices;
+	m_faceOffsets = std::move(faceOffsets);
+	m_faceVertices = std::move(faceVertices);
+	if (m_faceOffsets.empty())
+	{
+		m_faceOffsets.assign(1, 0);
+	}
+	const uint32_t numFaces = NumFaces();
+
+	// faces around each vertex by a counting sort of the corners, so that they are in ascending order for each vertex
+	m_vertexFaceOffsets.assign(static_cast<size_t>(numVertices) + 1, 0);
+	for (const uint32_t vertIdx : m_faceVertices)
+	{
+		m_vertexFaceOffsets[vertIdx + 1]++;
+	}
+	for (uint32_t vertIdx = 0; vertIdx < numVertices; vertIdx++)
+	{
+		m_vertexFaceOffsets[vertIdx + 1] += m_vertexFaceOffsets[vertIdx];
+	}
+	m_vertexFaces.resize(m_faceVertices.size());
+	{
+		std::vector<uint32_t> cursors(m_vertexFaceOffsets.begin(), m_vertexFaceOffsets.end() - 1);
+		for (uint32_t faceIdx = 0; faceIdx < numFaces; faceIdx++)
+		{
+			for (uint32_t fvIdx = m_faceOffsets[faceIdx]; fvIdx < m_faceOffsets[faceIdx + 1]; fvIdx++)
+			{
+				m_vertexFaces[cursors[m_faceVertices[fvIdx]]++] = faceIdx;
+			}
+		}
+	}
+
+	// each corner of a vertex gives at most its 2 neighbours on the face, so the candidates of vertex v fit in
+	// 2 * [m_vertexFaceOffsets[v], m_vertexFaceOffsets[v + 1]), where they are sorted and deduplicated in place
+	std::vector<uint32_t> candidates(2 * m_vertexFaces.size());
+	std::vector<uint32_t> degrees(numVertices, 0);
+	ParallelUtil::ForEach(static_cast<int>(numVertices), numThreads, [&](int vertIdx)
+		{
+			uint32_t* begin = candidates.data() + 2 * static_cast<size_t>(m_vertexFaceOffsets[vertIdx]);
+			uint32_t* end = begin;
+			for (uint32_t vfIdx = m_vertexFaceOffsets[vertIdx]; vfIdx < m_vertexFaceOffsets[vertIdx + 1]; vfIdx++)
+			{
+				// a face the vertex appears more than once in is listed once per corner, and all its corners are visited the first time
+				const uint32_t faceIdx = m_vertexFaces[vfIdx];
+				if (vfIdx > m_vertexFaceOffsets[vertIdx] && m_vertexFaces[vfIdx - 1] == faceIdx)
+				{
+					continue;
+				}
+
+				const uint32_t faceBegin = m_faceOffsets[faceIdx];
+				const uint32_t faceEnd = m_faceOffsets[faceIdx + 1];
+				for (uint32_t fvIdx = faceBegin; fvIdx < faceEnd; fvIdx++)
+				{
+					if (m_faceVertices[fvIdx] != static_cast<uint32_t>(vertIdx))
+					{
+						continue;
+					}
+
+					const uint32_t prev = m_faceVertices[fvIdx > faceBegin ? fvIdx - 1 : faceEnd - 1];
+					const uint32_t next = m_faceVertices[fvIdx + 1 < faceEnd ? fvIdx + 1 : faceBegin];
+					if (prev != static_cast<uint32_t>(vertIdx))
+					{
+						*end++ = prev;
+					}
+					if (next != static_cast<uint32_t>(vertIdx))
+					{
+						*end++ = next;
+					}
+				}
+			}
+
+			std::sort(begin, end);
+			degrees[vertIdx] = static_cast<uint32_t>(std::unique(begin, end) - begin);
+		});
+
+	// compact the deduplicated neighbours
+	m_adjacencyOffsets.assign(static_cast<size_t>(numVertices) + 1, 0);
+	for (uint32_t vertIdx = 0; vertIdx < numVertices; vertIdx++)
+	{
+		m_adjacencyOffsets[vertIdx + 1] = m_adjacencyOffsets[vertIdx] + degrees[vertIdx];
+	}
+	m_adjacencyIndices.resize(m_adjacencyOffsets[numVertices]);
+	ParallelUtil::ForEach(static_cast<int>(numVertices), numThreads, [&](int vertIdx)
+		{
+			const uint32_t* begin = candidates.data() + 2 * static_cast<size_t>(m_vertexFaceOffsets[vertIdx]);
+			std::copy(begin, begin + degrees[vertIdx], m_adjacencyIndices.begin() + m_adjacencyOffsets[vertIdx]);
+		});
+}
+
+void MeshTopology::Clear()
+{
+	m_numVertices = 0;
+	m_faceOffsets.clear();
+	m_faceVertices.clear();
+	m_vertexFaceOffsets.clear();
+	m_vertexFaces.clear();
+	m_adjacencyOffsets.clear();
+	m_adjacencyIndices.clear();
+}
+
+void MeshTopology::Permute(const std::vector<uint32_t>& newToOld, int numThreads)
+{
+	std::vector<uint32_t> oldToNew(m_numVertices);
+	for (uint32_t newIdx = 0; newIdx < m_numVertices; newIdx++)
+	{
+		oldToNew[newToOld[newIdx]] = newIdx;
+	}
+
+	std::vector<uint32_t> faceVertices(m_faceVertices.size());
+	ParallelUtil::ForEach(static_cast<int>(faceVertices.size()), numThreads, [&](int fvIdx)
+		{
+			faceVertices[fvIdx] = oldToNew[m_faceVertices[fvIdx]];
+		});
+
+	Build(m_numVertices, std::move(m_faceOffsets), std::move(faceVertices), numThreads);
+}
+
+void MeshTopology::GetNeighboursAroundVertices(std::vector<uint32_t>& indices, int numThreads) const
+{
+	indices.resize(m_adjacencyIndices.size());
+
+	ParallelUtil::ForEachChunk(static_cast<int>(m_numVertices), numThreads, [&](int begin, int end)
+		{
+			// the corners of the vertex as the wedges from the next vertex to the previous one on the face
+			std::vector<std::pair<uint32_t, uint32_t>> wedges;
+			std::vector<uint8_t> isWedgeUsed;
+
+			for (int vertIdx = begin; vertIdx < end; vertIdx++)
+			{
+				const uint32_t adjBegin = m_adjacencyOffsets[vertIdx];
+				const uint32_t adjEnd = m_adjacencyOffsets[vertIdx + 1];
+				uint32_t* out = indices.data() + adjBegin;
+				uint32_t numOut = 0;
+
+				wedges.clear();
+				for (uint32_t vfIdx = m_vertexFaceOffsets[vertIdx]; vfIdx < m_vertexFaceOffsets[vertIdx + 1]; vfIdx++)
+				{
+					const uint32_t faceIdx = m_vertexFaces[vfIdx];
+					if (vfIdx > m_vertexFaceOffsets[vertIdx] && m_vertexFaces[vfIdx - 1] == faceIdx)
+					{
+						continue;
+					}
+
+					const uint32_t faceBegin = m_faceOffsets[faceIdx];
+					const uint32_t faceEnd = m_faceOffsets[faceIdx + 1];
+					for (uint32_t fvIdx = faceBegin; fvIdx < faceEnd; fvIdx++)
+					{
+						if (m_faceVertices[fvIdx] == static_cast<uint32_t>(vertIdx))
+						{
+							wedges.emplace_back(
+								m_faceVertices[fvIdx + 1 < faceEnd ? fvIdx + 1 : faceBegin],
+								m_faceVertices[fvIdx > faceBegin ? fvIdx - 1 : faceEnd - 1]);
+						}
+					}
+				}
+				isWedgeUsed.assign(wedges.size(), 0);
+
+				const auto isEmitted = [&](uint32_t neighbour)
+					{
+						return neighbour == static_cast<uint32_t>(vertIdx) || std::find(out, out + numOut, neighbour) != out + numOut;
+					};
+
+				// start each walk on the boundary if there is one, i.e. at a wedge no other wedge leads to
+				for (;;)
+				{
+					size_t start = wedges.size();
+					for (size_t wIdx = 0; wIdx < wedges.size(); wIdx++)
+					{
+						if (isWedgeUsed[wIdx])
+						{
+							continue;
+						}
+						if (start == wedges.size())
+						{
+							start = wIdx;
+						}
+
+						bool isLedTo = false;
+						for (size_t other = 0; other < wedges.size() && !isLedTo; other++)
+						{
+							isLedTo = !isWedgeUsed[other] && wedges[other].second == wedges[wIdx].first;
+						}
+						if (!isLedTo)
+						{
+							start = wIdx;
+							break;
+						}
+					}
+					if (start == wedges.size())
+					{
+						break;
+					}
+
+					if (!isEmitted(wedges[start].first))
+					{
+						out[numOut++] = wedges[start].first;
+					}
+					for (size_t wIdx = start; wIdx < wedges.size();)
+					{
+						isWedgeUsed[wIdx] = 1;
+						const uint32_t to = wedges[wIdx].second;
+						if (isEmitted(to))
+						{
+							break;
+						}
+						out[numOut++] = to;
+
+						// the next face of the fan is the one whose wedge starts where this one ends
+						size_t nextIdx = wedges.size();
+						for (size_t other = 0; other < wedges.size(); other++)
+						{
+							if (!isWedgeUsed[other] && wedges[other].first == to)
+							{
+								nextIdx = other;
+								break;
+							}
+						}
+						wIdx = nextIdx;
+					}
+				}
+
+				// neighbours without a face to follow, which only happens on broken meshes
+				for (uint32_t aIdx = adjBegin; aIdx < adjEnd && numOut < adjEnd - adjBegin; aIdx++)
+				{
+					if (!isEmitted(m_adjacencyIndices[aIdx]))
+					{
+						out[numOut++] = m_adjacencyIndices[aIdx];
+					}
+				}
+			}
+		});
+}
+
+void MeshTopology::ComputeLaplacian(Eigen::SparseMatrix<double>& laplacian, int numThreads) const
+{
+	// column j of L = I - A * D^-1 has 1 on the diagonal and -1 / d_j at the neighbours of vertex j, so its pattern is
+	// the sorted adjacency of j with j inserted. An isolated vertex only has the diagonal
+	const int numVertices = static_cast<int>(m_numVertices);
+	laplacian.resize(numVertices, numVertices);
+	laplacian.resizeNonZeros(static_cast<Eigen::Index>(m_adjacencyIndices.size()) + numVertices);
+
+	int* outer = laplacian.outerIndexPtr();
+	for (int vertIdx = 0; vertIdx <= numVertices; vertIdx++)
+	{
+		outer[vertIdx] = static_cast<int>(m_adjacencyOffsets[vertIdx]) + vertIdx;
+	}
+
+	int* inner = laplacian.innerIndexPtr();
+	double* values = laplacian.valuePtr();
+	ParallelUtil::ForEach(numVertices, numThreads, [&](int vertIdx)
+		{
+			const uint32_t adjBegin = m_adjacencyOffsets[vertIdx];
+			const uint32_t adjEnd = m_adjacencyOffsets[vertIdx + 1];
+			const double offDiagonal = adjEnd > adjBegin ? -1.0 / (adjEnd - adjBegin) : 0.0;
+
+			int pos = outer[vertIdx];
+			bool isDiagonalDone = false;
+			for (uint32_t aIdx = adjBegin; aIdx < adjEnd; aIdx++)
+			{
+				const int row = static_cast<int>(m_adjacencyIndices[aIdx]);
+				if (!isDiagonalDone && row > vertIdx)
+				{
+					inner[pos] = vertIdx;
+					values[pos++] = 1.0;
+					isDiagonalDone = true;
+				}
+				inner[pos] = row;
+				values[pos++] = offDiagonal;
+			}
+			if (!isDiagonalDone)
+			{
+				inner[pos] = vertIdx;
+				values[pos] = 1.0;
+			}
+		});
+}
+
+void MeshTopology::AddToHash(ContentHash& hash) const
+{
+	hash.AddValue(m_numVertices);
+	hash.AddArray(m_faceOffsets);
+	hash.AddArray(m_faceVertices);
+}
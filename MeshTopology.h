@@ -0,0 +1,130 @@
+#pragma once
+#include "ContentHash.h"
+#include <Eigen/Sparse>
+#include <maya/MObject.h>
+#include <maya/MStatus.h>
+#include <vector>
+#include <cstdint>
+
+
+/// <summary>
+/// Polygons and vertex adjacency of a mesh in the compressed sparse row (CSR) layout, read in bulk by MFnMesh::getVertices.
+/// The vertices of face f are FaceVertices()[FaceOffsets()[f]] ... FaceVertices()[FaceOffsets()[f + 1] - 1], and the faces
+/// around vertex v and its neighbours are stored in the same layout. Both the deformers are built from it, so the mesh is
+/// only walked once per bind.
+/// </summary>
+class MeshTopology
+{
+public:
+	MeshTopology() = default;
+	~MeshTopology() = default;
+
+	/// <summary>
+	/// Build from the polygons of the mesh
+	/// </summary>
+	/// <param name="mesh"></param>
+	/// <param name="numThreads">zero means all the available threads</param>
+	/// <returns></returns>
+	MStatus Build(MObject& mesh, int numThreads = 0);
+
+	/// <summary>
+	/// Build from the face-vertex arrays, which does not touch Maya data
+	/// </summary>
+	/// <param name="numVertices"></param>
+	/// <param name="faceOffsets"># of faces + 1 offsets into faceVertices, starting with zero</param>
+	/// <param name="faceVertices">vertex indices of all the faces</param>
+	/// <param name="numThreads">zero means all the available threads</param>
+	void Build(uint32_t numVertices, std::vector<uint32_t> faceOffsets, std::vector<uint32_t> faceVertices, int numThreads = 0);
+
+	void Clear();
+
+	/// <summary>
+	/// Relabel the vertices so that vertex newToOld[i] becomes vertex i, and rebuild the adjacency in the new labels.
+	/// The faces keep their order.
+	/// </summary>
+	/// <param name="newToOld">permutation of the vertices</param>
+	/// <param name="numThreads">zero means all the available threads</param>
+	void Permute(const std::vector<uint32_t>& newToOld, int numThreads = 0);
+
+	uint32_t NumVertices() const
+	{
+		return m_numVertices;
+	}
+
+	uint32_t NumFaces() const
+	{
+		return m_faceOffsets.empty() ? 0 : static_cast<uint32_t>(m_faceOffsets.size() - 1);
+	}
+
+	const std::vector<uint32_t>& FaceOffsets() const
+	{
+		return m_faceOffsets;
+	}
+
+	const std::vector<uint32_t>& FaceVertices() const
+	{
+		return m_faceVertices;
+	}
+
+	const std::vector<uint32_t>& VertexFaceOffsets() const
+	{
+		return m_vertexFaceOffsets;
+	}
+
+	const std::vector<uint32_t>& VertexFaces() const
+	{
+		return m_vertexFaces;
+	}
+
+	/// <summary>
+	/// # of vertices + 1 offsets into AdjacencyIndices
+	/// </summary>
+	const std::vector<uint32_t>& AdjacencyOffsets() const
+	{
+		return m_adjacencyOffsets;
+	}
+
+	/// <summary>
+	/// neighbours of each vertex without duplicates, in ascending order
+	/// </summary>
+	const std::vector<uint32_t>& AdjacencyIndices() const
+	{
+		return m_adjacencyIndices;
+	}
+
+	uint32_t Degree(uint32_t vertIdx) const
+	{
+		return m_adjacencyOffsets[vertIdx + 1] - m_adjacencyOffsets[vertIdx];
+	}
+
+	/// <summary>
+	/// Reorder the neighbours of each vertex so that consecutive ones share a face, walking the fan of the faces around the vertex.
+	/// Vertices on a non-manifold fan get one walk per fan, and the order is ascending where there is no face to follow.
+	/// </summary>
+	/// <param name="indices">[out] neighbours in the layout of AdjacencyOffsets</param>
+	/// <param name="numThreads">zero means all the available threads</param>
+	void GetNeighboursAroundVertices(std::vector<uint32_t>& indices, int numThreads = 0) const;
+
+	/// <summary>
+	/// Compute the normalized Laplacian L = I - A * D^-1 of the adjacency, filled straight into the compressed storage
+	/// </summary>
+	/// <param name="laplacian">[out]</param>
+	/// <param name="numThreads">zero means all the available threads</param>
+	void ComputeLaplacian(Eigen::SparseMatrix<double>& laplacian, int numThreads = 0) const;
+
+	/// <summary>
+	/// Add the face-vertex connectivity to the hash, which determines everything else
+	/// </summary>
+	void AddToHash(ContentHash& hash) const;
+
+private:
+	uint32_t m_numVertices = 0;
+
+	std::vector<uint32_t> m_faceOffsets;
+	std::vector<uint32_t> m_faceVertices;
+	std::vector<uint32_t> m_vertexFaceOffsets;
+	std::vector<uint32_t> m_vertexFaces;
+
+	std::vector<uint32_t> m_adjacencyOffsets;
+	std::vector<uint32_t> m_adjacencyIndices;
+};
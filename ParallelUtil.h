@@ -0,0 +1,107 @@
+#pragma once
+#include <algorithm>
+#include "omp.h"
+
+
+/// <summary>
+/// Utility to run loops over vertices in parallel with OpenMP
+/// </summary>
+class ParallelUtil
+{
+public:
+	/// <summary>
+	/// # of threads actually used for the given setting (zero or negative means all the available threads)
+	/// </summary>
+	static int NumThreads(int numThreads)
+	{
+		return numThreads > 0 ? numThreads : omp_get_max_threads();
+	}
+
+	/// <summary>
+	/// Split [0, numItems) into contiguous chunks and call func(begin, end) for each chunk in parallel.
+	/// The chunk boundaries only depend on numItems and the # of threads.
+	/// </summary>
+	/// <param name="numItems"></param>
+	/// <param name="numThreads">zero or negative means all the available threads</param>
+	/// <param name="func">void(int begin, int end)</param>
+	template <typename Func>
+	static void ForEachChunk(int numItems, int numThreads, Func&& func)
+	{
+		if (numItems <= 0)
+		{
+			return;
+		}
+
+		const int numUsedThreads = NumThreads(numThreads);
+
+		// a few chunks per thread for load balancing, but not too small to keep the overhead negligible
+		const int numChunks = std::max(1, std::min(numUsedThreads * ChunksPerThread, numItems / MinChunkSize));
+		if (numChunks == 1 || numUsedThreads == 1)
+		{
+			func(0, numItems);
+			return;
+		}
+
+#pragma omp parallel for num_threads(numUsedThreads) schedule(dynamic, 1)
+		for (int chunkIdx = 0; chunkIdx < numChunks; chunkIdx++)
+		{
+			const int begin = static_cast<int>(static_cast<long long>(numItems) * chunkIdx / numChunks);
+			const int end = static_cast<int>(static_cast<long long>(numItems) * (chunkIdx + 1) / numChunks);
+			func(begin, end);
+		}
+	}
+
+	/// <summary>
+	/// Call func(idx) for each idx in [0, numItems) in parallel
+	/// </summary>
+	/// <param name="numItems"></param>
+	/// <param name="numThreads">zero or negative means all the available threads</param>
+	/// <param name="func">void(int idx)</param>
+	template <typename Func>
+	static void ForEach(int numItems, int numThreads, Func&& func)
+	{
+		ForEachChunk(numItems, numThreads, [&func](int begin, int end)
+			{
+				for (int idx = begin; idx < end; idx++)
+				{
+					func(idx);
+				}
+			});
+	}
+
+	/// <summary>
+	/// Call func(idx) for each idx in [0, numItems) in parallel, scheduling the items one by one.
+	/// This is for a small # of heavy items, which ForEach would run in a single chunk.
+	/// </summary>
+	/// <param name="numItems"></param>
+	/// <param name="numThreads">zero or negative means all the available threads</param>
+	/// <param name="func">void(int idx)</param>
+	template <typename Func>
+	static void ForEachTask(int numItems, int numThreads, Func&& func)
+	{
+		if (numItems <= 0)
+		{
+			return;
+		}
+
+		const int numUsedThreads = std::min(NumThreads(numThreads), numItems);
+		if (numUsedThreads == 1)
+		{
+			for (int idx = 0; idx < numItems; idx++)
+			{
+				func(idx);
+			}
+			return;
+		}
+
+#pragma omp parallel for num_threads(numUsedThreads) schedule(dynamic, 1)
+		for (int idx = 0; idx < numItems; idx++)
+		{
+			func(idx);
+		}
+	}
+
+private:
+	static constexpr int ChunksPerThread = 4;
+	static constexpr int MinChunkSize = 256;
+};
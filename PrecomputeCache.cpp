@@ -0,0 +1,146 @@
+#include "PrecomputeCache.h"
+#include "MappedFile.h"
+#include "ContentHash.h"
+#include "MatrixUtil.h"
+#include <filesystem>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <cstring>
+
+namespace {
+	const char CacheMagic[8] = { 'D', 'D', 'M', 'C', 'A', 'C', 'H', 'E' };
+
+	using StorageIndex = Eigen::SparseMatrix<double>::StorageIndex;
+	static_assert(sizeof(StorageIndex) == sizeof(int32_t), "indices of B are stored as 32-bit integers");
+	static_assert(sizeof(float) == sizeof(int32_t), "every section after the values of B keeps 4-byte alignment");
+}
+
+
+std::string PrecomputeCache::FilePath(const std::string& directory, uint64_t key)
+{
+	return (std::filesystem::path(directory) / (ContentHash::ToHex(key) + ".ddmcache")).string();
+}
+
+bool PrecomputeCache::Load(
+	const std::string& path,
+	uint64_t key,
+	unsigned int numVertices,
+	unsigned int numEntries,
+	std::vector<float>& packedPsi,
+	Eigen::SparseMatrix<double>& smoothingMat)
+{
+	MappedFile file;
+	if (!file.Open(path) || file.Size() < sizeof(Header))
+	{
+		return false;
+	}
+
+	Header header;
+	std::memcpy(&header, file.Data(), sizeof(Header));
+	if (std::memcmp(header.Magic, CacheMagic, sizeof(CacheMagic)) != 0
+		|| header.Version != FormatVersion
+		|| header.HeaderSize != sizeof(Header)
+		|| header.Key != key
+		|| header.NumVertices != numVertices
+		|| header.NumEntries != numEntries
+		|| header.NumPackedPsi != MatrixUtil::NumSymmetricElements)
+	{
+		return false;
+	}
+
+	// the size must match exactly, which also rejects truncated files
+	const size_t valuesSize = header.NumNonZeros * sizeof(double);
+	const size_t psiSize = header.NumEntries * header.NumPackedPsi * sizeof(float);
+	const size_t outerSize = (header.NumVertices + 1) * sizeof(StorageIndex);
+	const size_t innerSize = header.NumNonZeros * sizeof(StorageIndex);
+	if (file.Size() != sizeof(Header) + psiSize + valuesSize + outerSize + innerSize)
+	{
+		return false;
+	}
+
+	// the doubles come first right after the header, and the other sections are 4-byte aligned,
+	// so the arrays can be read through typed pointers into the mapping. They are then copied into packedPsi and
+	// smoothingMat, which outlive the mapping, so mapping only saves the intermediate read buffer
+	const uint8_t* cursor = file.Data() + sizeof(Header);
+	const double* values = reinterpret_cast<const double*>(cursor);
+	cursor += valuesSize;
+
+	const float* psi = reinterpret_cast<const float*>(cursor);
+	packedPsi.assign(psi, psi + header.NumEntries * header.NumPackedPsi);
+	cursor += psiSize;
+
+	const StorageIndex* outer = reinterpret_cast<const StorageIndex*>(cursor);
+	cursor += outerSize;
+	const StorageIndex* inner = reinterpret_cast<const StorageIndex*>(cursor);
+
+	smoothingMat = Eigen::Map<const Eigen::SparseMatrix<double>>(
+		numVertices, numVertices, static_cast<Eigen::Index>(header.NumNonZeros), outer, inner, values);
+
+	return true;
+}
+
+bool PrecomputeCache::Save(
+	const std::string& path,
+	uint64_t key,
+	const std::vector<float>& packedPsi,
+	const Eigen::SparseMatrix<double>& smoothingMat)
+{
+	std::error_code err;
+	const std::filesystem::path filePath(path);
+	std::filesystem::create_directories(filePath.parent_path(), err);
+
+	Eigen::SparseMatrix<double> compressed;
+	const Eigen::SparseMatrix<double>* B = &smoothingMat;
+	if (!smoothingMat.isCompressed())
+	{
+		compressed = smoothingMat;
+		compressed.makeCompressed();
+		B = &compressed;
+	}
+
+	Header header;
+	std::memcpy(header.Magic, CacheMagic, sizeof(CacheMagic));
+	header.Version = FormatVersion;
+	header.HeaderSize = sizeof(Header);
+	header.Key = key;
+	header.NumVertices = static_cast<uint64_t>(B->cols());
+	header.NumEntries = packedPsi.size() / MatrixUtil::NumSymmetricElements;
+	header.NumPackedPsi = MatrixUtil::NumSymmetricElements;
+	header.NumNonZeros = static_cast<uint64_t>(B->nonZeros());
+
+	// write to a temporary file first, and rename it so that other processes see either nothing or the whole file
+	const uint64_t suffix = static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count())
+		^ std::hash<std::thread::id>()(std::this_thread::get_id());
+	const std::filesystem::path tmpPath = filePath.string() + "." + ContentHash::ToHex(suffix) + ".tmp";
+	{
+		std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			return false;
+		}
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+		file.write(reinterpret_cast<const char*>(B->valuePtr()), header.NumNonZeros * sizeof(double));
+		file.write(reinterpret_cast<const char*>(packedPsi.data()), packedPsi.size() * sizeof(float));
+		file.write(reinterpret_cast<const char*>(B->outerIndexPtr()), (header.NumVertices + 1) * sizeof(StorageIndex));
+		file.write(reinterpret_cast<const char*>(B->innerIndexPtr()), header.NumNonZeros * sizeof(StorageIndex));
+
+		if (!file)
+		{
+			file.close();
+			std::filesystem::remove(tmpPath, err);
+			return false;
+		}
+	}
+
+	std::filesystem::rename(tmpPath, filePath, err);
+	if (err)
+	{
+		std::filesystem::remove(tmpPath, err);
+		return false;
+	}
+
+	return true;
+}
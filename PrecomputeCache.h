@@ -0,0 +1,66 @@
+#pragma once
+#include <Eigen/Sparse>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+
+/// <summary>
+/// Binary cache file of the DDM precomputation (packed Psi matrices and the smoothing matrix).
+/// A file is named and validated by the content hash of all the inputs of the precomputation,
+/// so a file found for the key can be used as is. Files are written atomically, so that
+/// processes sharing the cache directory never read a partial file.
+/// </summary>
+class PrecomputeCache
+{
+public:
+	/// <summary>
+	/// Environment variable of the cache directory, used when the node does not specify one
+	/// </summary>
+	static constexpr const char* DirectoryEnvVar = "CUSTOM_SKIN_CLUSTER_CACHE_DIR";
+
+	/// <summary>
+	/// Path of the cache file for the key
+	/// </summary>
+	static std::string FilePath(const std::string& directory, uint64_t key);
+
+	/// <summary>
+	/// Map the cache file and read the results if it is valid for the key and the sizes
+	/// </summary>
+	/// <returns>false if there is no valid cache file, in which case the outputs are left as they are</returns>
+	static bool Load(
+		const std::string& path,
+		uint64_t key,
+		unsigned int numVertices,
+		unsigned int numEntries,
+		std::vector<float>& packedPsi,
+		Eigen::SparseMatrix<double>& smoothingMat);
+
+	/// <summary>
+	/// Write the results to the cache file, creating the directory if necessary
+	/// </summary>
+	static bool Save(
+		const std::string& path,
+		uint64_t key,
+		const std::vector<float>& packedPsi,
+		const Eigen::SparseMatrix<double>& smoothingMat);
+
+private:
+	static constexpr uint32_t FormatVersion = 3;
+
+	/// <summary>
+	/// File layout: Header, values of B, packed Psi matrices (NumPackedPsi floats per entry), outer indices of B, inner indices of B.
+	/// B is stored in the compressed column-major layout of Eigen.
+	/// </summary>
+	struct Header
+	{
+		char Magic[8];
+		uint32_t Version;
+		uint32_t HeaderSize;
+		uint64_t Key;
+		uint64_t NumVertices;
+		uint64_t NumEntries;
+		uint64_t NumPackedPsi;
+		uint64_t NumNonZeros;
+	};
+};
@@ -0,0 +1,369 @@
+#include "RotationKernel.h"
+#include <Eigen/Core>
+#include <Eigen/LU>
+#include <Eigen/SVD>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+
+// the rotation kernels must be inlined into the loop over matrices to be vectorized
+#if defined(_MSC_VER)
+#define ROTATION_INLINE __forceinline
+#else
+#define ROTATION_INLINE inline __attribute__((always_inline))
+#endif
+
+namespace {
+    // ExtractRotations processes the matrices in blocks of this size
+    constexpr unsigned int RotationBlockSize = 64;
+
+    // the 2nd eigenvalue of A^t A relative to the 1st one, below which the fast path loses precision
+    constexpr double RankDeficiencyThreshold = 1e-10;
+
+    // off-diagonal norm of the Jacobi iteration relative to the trace, below which a warm start is accepted.
+    // The error of the rotation is about the same order.
+    constexpr double WarmStartTolerance = 1e-10;
+
+    struct Vec3
+    {
+        double x, y, z;
+    };
+
+    ROTATION_INLINE double Dot(const Vec3& a, const Vec3& b)
+    {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    ROTATION_INLINE Vec3 Cross(const Vec3& a, const Vec3& b)
+    {
+        return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+    }
+
+    ROTATION_INLINE Vec3 Normalize(const Vec3& a)
+    {
+        const double len = std::sqrt(Dot(a, a));
+        const double invLen = 1.0 / (len + (len == 0.0 ? 1.0 : 0.0));
+        return { a.x * invLen, a.y * invLen, a.z * invLen };
+    }
+
+    /// <summary>
+    /// Jacobi rotation on the symmetric 3x3 matrix S, which annihilates S_pq. r is the remaining index.
+    /// v_p and v_q are the columns p and q of the accumulated eigenvectors.
+    /// </summary>
+    ROTATION_INLINE void JacobiRotate(double& s_pp, double& s_qq, double& s_pq, double& s_pr, double& s_qr, Vec3& v_p, Vec3& v_q)
+    {
+        const double theta = (s_qq - s_pp) / (2.0 * s_pq + (s_pq == 0.0 ? 1.0 : 0.0));
+        double t = std::copysign(1.0, theta) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+        t = s_pq == 0.0 ? 0.0 : t;
+        const double c = 1.0 / std::sqrt(t * t + 1.0);
+        const double s = t * c;
+
+        const double pr = c * s_pr - s * s_qr;
+        const double qr = s * s_pr + c * s_qr;
+        s_pp -= t * s_pq;
+        s_qq += t * s_pq;
+        s_pq = 0.0;
+        s_pr = pr;
+        s_qr = qr;
+
+        const Vec3 vp = v_p;
+        const Vec3 vq = v_q;
+        v_p = { c * vp.x - s * vq.x, c * vp.y - s * vq.y, c * vp.z - s * vq.z };
+        v_q = { s * vp.x + c * vq.x, s * vp.y + c * vq.y, s * vp.z + c * vq.z };
+    }
+
+    /// <summary>
+    /// One cyclic sweep of the Jacobi eigenvalue algorithm on the symmetric 3x3 matrix S.
+    /// Each sweep roughly squares the off-diagonal error, so 4 sweeps converge to double precision.
+    /// </summary>
+    ROTATION_INLINE void JacobiSweep(double& s00, double& s01, double& s02, double& s11, double& s12, double& s22, Vec3& v0, Vec3& v1, Vec3& v2)
+    {
+        JacobiRotate(s00, s11, s01, s02, s12, v0, v1);
+        JacobiRotate(s00, s22, s02, s01, s12, v0, v2);
+        JacobiRotate(s11, s22, s12, s01, s02, v1, v2);
+    }
+
+    /// <summary>
+    /// Swap the eigenpairs i and j so that the eigenvalue i is the larger one
+    /// </summary>
+    ROTATION_INLINE void SortEigenPair(double& e_i, double& e_j, Vec3& v_i, Vec3& v_j)
+    {
+        const bool swap = e_i < e_j;
+        const double e = e_i;
+        const Vec3 vi = v_i;
+        const Vec3 vj = v_j;
+        e_i = swap ? e_j : e_i;
+        e_j = swap ? e : e_j;
+        v_i = { swap ? vj.x : vi.x, swap ? vj.y : vi.y, swap ? vj.z : vi.z };
+        v_j = { swap ? vi.x : vj.x, swap ? vi.y : vj.y, swap ? vi.z : vj.z };
+    }
+
+    struct Quat
+    {
+        double x, y, z, w;
+    };
+
+    ROTATION_INLINE Quat Select(bool condition, const Quat& a, const Quat& b)
+    {
+        return { condition ? a.x : b.x, condition ? a.y : b.y, condition ? a.z : b.z, condition ? a.w : b.w };
+    }
+
+    /// <summary>
+    /// Rotation matrix of the quaternion (x, y, z, w) given by its columns
+    /// </summary>
+    ROTATION_INLINE void QuaternionToBasis(double x, double y, double z, double w, Vec3& v0, Vec3& v1, Vec3& v2)
+    {
+        // the scale also normalizes the quaternion
+        const double s = 2.0 / (x * x + y * y + z * z + w * w);
+        v0 = { 1.0 - s * (y * y + z * z), s * (x * y + z * w), s * (x * z - y * w) };
+        v1 = { s * (x * y - z * w), 1.0 - s * (x * x + z * z), s * (y * z + x * w) };
+        v2 = { s * (x * z + y * w), s * (y * z - x * w), 1.0 - s * (x * x + y * y) };
+    }
+
+    /// <summary>
+    /// Store the quaternion (x, y, z, w) of the rotation matrix given by its columns at quat[k * stride + i].
+    /// The largest of the 4 candidates is selected without branches.
+    /// </summary>
+    ROTATION_INLINE void BasisToQuaternion(const Vec3& v0, const Vec3& v1, const Vec3& v2, double* quat, size_t stride, size_t i)
+    {
+        // m_rc = (v_c)_r. Each candidate is the quaternion scaled by 4 times one of its components,
+        // and the one with the largest scale is the most accurate.
+        // The largest is found by a tournament of plain selections, in the same way as SortEigenPair
+        const Quat candX = { 1.0 + v0.x - v1.y - v2.z, v1.x + v0.y, v2.x + v0.z, v1.z - v2.y };
+        const Quat candY = { v1.x + v0.y, 1.0 - v0.x + v1.y - v2.z, v2.y + v1.z, v2.x - v0.z };
+        const Quat candZ = { v2.x + v0.z, v2.y + v1.z, 1.0 - v0.x - v1.y + v2.z, v0.y - v1.x };
+        const Quat candW = { v1.z - v2.y, v2.x - v0.z, v0.y - v1.x, 1.0 + v0.x + v1.y + v2.z };
+
+        const Quat candXY = Select(candX.x >= candY.y, candX, candY);
+        const Quat candZW = Select(candZ.z >= candW.w, candZ, candW);
+        const double scaleXY = candX.x >= candY.y ? candX.x : candY.y;
+        const double scaleZW = candZ.z >= candW.w ? candZ.z : candW.w;
+        const Quat q = Select(scaleXY >= scaleZW, candXY, candZW);
+
+        const double invLen = 1.0 / std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+        quat[0 * stride + i] = q.x * invLen;
+        quat[1 * stride + i] = q.y * invLen;
+        quat[2 * stride + i] = q.z * invLen;
+        quat[3 * stride + i] = q.w * invLen;
+    }
+
+    // flags of the result of ExtractRotation. Zero means solved.
+    // They are combined arithmetically rather than selected, so that the kernel has no branches
+    constexpr uint8_t RotationNotConverged = 1;
+    constexpr uint8_t RotationRankDeficient = 2;
+
+    /// <summary>
+    /// Closest rotation of the 3x3 matrix A given by its rows, without branches so that the loop over matrices can be vectorized.
+    /// A = U * S * V^t is obtained from the eigen decomposition A^t A = V * S^2 * V^t by Jacobi sweeps on V0^t A^t A V0,
+    /// where V0 is the initial guess of V. Taking u0, u1 from A * V and u2 = u0 x u1 (and v2 = v0 x v1)
+    /// gives U * diag(1, 1, det(U V^t)) * V^t directly.
+    /// A cold start (V0 = I) runs 4 sweeps, which always converge. A warm start runs 2 sweeps and reports RotationNotConverged
+    /// if V0 was too far from the solution.
+    /// </summary>
+    /// <param name="v0">[in, out] 1st column of V</param>
+    /// <param name="v1">[in, out] 2nd column of V</param>
+    /// <param name="v2">[in, out] 3rd column of V. V is a proper rotation on output.</param>
+    /// <param name="r0">[out] 1st row of the rotation</param>
+    /// <param name="r1">[out] 2nd row of the rotation</param>
+    /// <param name="r2">[out] 3rd row of the rotation</param>
+    /// <returns>RotationNotConverged and RotationRankDeficient flags, in which cases the result is unreliable</returns>
+    template <bool IsWarmStart>
+    ROTATION_INLINE uint8_t ExtractRotation(
+        const Vec3& a0, const Vec3& a1, const Vec3& a2, Vec3& v0, Vec3& v1, Vec3& v2, Vec3& r0, Vec3& r1, Vec3& r2)
+    {
+        // columns of A * V0
+        const Vec3 b0 = { Dot(a0, v0), Dot(a1, v0), Dot(a2, v0) };
+        const Vec3 b1 = { Dot(a0, v1), Dot(a1, v1), Dot(a2, v1) };
+        const Vec3 b2 = { Dot(a0, v2), Dot(a1, v2), Dot(a2, v2) };
+
+        double s00 = Dot(b0, b0);
+        double s01 = Dot(b0, b1);
+        double s02 = Dot(b0, b2);
+        double s11 = Dot(b1, b1);
+        double s12 = Dot(b1, b2);
+        double s22 = Dot(b2, b2);
+
+        // the sweeps are written out, since the vectorizer does not accept an inner loop
+        JacobiSweep(s00, s01, s02, s11, s12, s22, v0, v1, v2);
+        JacobiSweep(s00, s01, s02, s11, s12, s22, v0, v1, v2);
+        if (!IsWarmStart)
+        {
+            JacobiSweep(s00, s01, s02, s11, s12, s22, v0, v1, v2);
+            JacobiSweep(s00, s01, s02, s11, s12, s22, v0, v1, v2);
+        }
+
+        const double offDiagonal = s01 * s01 + s02 * s02 + s12 * s12;
+        const double trace = s00 + s11 + s22;
+        const bool isConverged = !IsWarmStart || offDiagonal <= WarmStartTolerance * WarmStartTolerance * trace * trace;
+
+        SortEigenPair(s00, s11, v0, v1);
+        SortEigenPair(s00, s22, v0, v2);
+        SortEigenPair(s11, s22, v1, v2);
+
+        const Vec3 u0 = Normalize({ Dot(a0, v0), Dot(a1, v0), Dot(a2, v0) });
+        Vec3 u1 = { Dot(a0, v1), Dot(a1, v1), Dot(a2, v1) };
+        const double d = Dot(u0, u1);
+        u1 = Normalize({ u1.x - d * u0.x, u1.y - d * u0.y, u1.z - d * u0.z });
+        const Vec3 u2 = Cross(u0, u1);
+        v2 = Cross(v0, v1);
+
+        r0 = { u0.x * v0.x + u1.x * v1.x + u2.x * v2.x, u0.x * v0.y + u1.x * v1.y + u2.x * v2.y, u0.x * v0.z + u1.x * v1.z + u2.x * v2.z };
+        r1 = { u0.y * v0.x + u1.y * v1.x + u2.y * v2.x, u0.y * v0.y + u1.y * v1.y + u2.y * v2.y, u0.y * v0.z + u1.y * v1.z + u2.y * v2.z };
+        r2 = { u0.z * v0.x + u1.z * v1.x + u2.z * v2.x, u0.z * v0.y + u1.z * v1.y + u2.z * v2.y, u0.z * v0.z + u1.z * v1.z + u2.z * v2.z };
+
+        const bool isRankDeficient = s11 <= RankDeficiencyThreshold * s00;
+        return static_cast<uint8_t>(isRankDeficient) * RotationRankDeficient + static_cast<uint8_t>(!isConverged) * RotationNotConverged;
+    }
+
+    /// <summary>
+    /// Closest rotation of the 3x3 matrix A with the general SVD, for the rank deficient matrices
+    /// </summary>
+    void ExtractRotationBySVD(const Vec3& a0, const Vec3& a1, const Vec3& a2, Vec3& v0, Vec3& v1, Vec3& v2, Vec3& r0, Vec3& r1, Vec3& r2)
+    {
+        Eigen::Matrix3d target;
+        target << a0.x, a0.y, a0.z, a1.x, a1.y, a1.z, a2.x, a2.y, a2.z;
+        Eigen::JacobiSVD<Eigen::Matrix3d, Eigen::ComputeFullU | Eigen::ComputeFullV> solver(
+            target, Eigen::ComputeFullU | Eigen::ComputeFullV);
+
+        // make both U and V proper rotations, which flips the axis of the smallest singular value if det(A) < 0
+        Eigen::Matrix3d u = solver.matrixU();
+        Eigen::Matrix3d v = solver.matrixV();
+        if (u.determinant() < 0.0)
+        {
+            u.col(2) *= -1.0;
+        }
+        if (v.determinant() < 0.0)
+        {
+            v.col(2) *= -1.0;
+        }
+
+        const Eigen::Matrix3d rot = u * v.transpose();
+        r0 = { rot(0, 0), rot(0, 1), rot(0, 2) };
+        r1 = { rot(1, 0), rot(1, 1), rot(1, 2) };
+        r2 = { rot(2, 0), rot(2, 1), rot(2, 2) };
+        v0 = { v(0, 0), v(1, 0), v(2, 0) };
+        v1 = { v(0, 1), v(1, 1), v(2, 1) };
+        v2 = { v(0, 2), v(1, 2), v(2, 2) };
+    }
+
+    ROTATION_INLINE void LoadMatrix(const double* mats, size_t stride, size_t i, Vec3& a0, Vec3& a1, Vec3& a2)
+    {
+        a0 = { mats[0 * stride + i], mats[1 * stride + i], mats[2 * stride + i] };
+        a1 = { mats[3 * stride + i], mats[4 * stride + i], mats[5 * stride + i] };
+        a2 = { mats[6 * stride + i], mats[7 * stride + i], mats[8 * stride + i] };
+    }
+
+    ROTATION_INLINE void StoreMatrix(const Vec3& a0, const Vec3& a1, const Vec3& a2, size_t stride, size_t i, double* mats)
+    {
+        mats[0 * stride + i] = a0.x;
+        mats[1 * stride + i] = a0.y;
+        mats[2 * stride + i] = a0.z;
+        mats[3 * stride + i] = a1.x;
+        mats[4 * stride + i] = a1.y;
+        mats[5 * stride + i] = a1.z;
+        mats[6 * stride + i] = a2.x;
+        mats[7 * stride + i] = a2.y;
+        mats[8 * stride + i] = a2.z;
+    }
+
+    ROTATION_INLINE void LoadBasis(const double* bases, size_t stride, size_t i, Vec3& v0, Vec3& v1, Vec3& v2)
+    {
+        QuaternionToBasis(bases[0 * stride + i], bases[1 * stride + i], bases[2 * stride + i], bases[3 * stride + i], v0, v1, v2);
+    }
+
+    ROTATION_INLINE void StoreBasis(const Vec3& v0, const Vec3& v1, const Vec3& v2, size_t stride, size_t i, double* bases)
+    {
+        BasisToQuaternion(v0, v1, v2, bases, stride, i);
+    }
+
+    /// <summary>
+    /// ExtractRotations for the matrices [blockBegin, blockEnd)
+    /// </summary>
+    template <bool IsWarmStart, bool KeepsBases>
+    void ExtractRotationBlock(
+        const double* mats, unsigned int stride, unsigned int blockBegin, unsigned int blockEnd, double* rotations, double* bases)
+    {
+        uint8_t status[RotationBlockSize];
+#pragma omp simd
+        for (unsigned int i = blockBegin; i < blockEnd; i++)
+        {
+            Vec3 a0, a1, a2;
+            LoadMatrix(mats, stride, i, a0, a1, a2);
+
+            Vec3 v0 = { 1.0, 0.0, 0.0 };
+            Vec3 v1 = { 0.0, 1.0, 0.0 };
+            Vec3 v2 = { 0.0, 0.0, 1.0 };
+            if (IsWarmStart)
+            {
+                LoadBasis(bases, stride, i, v0, v1, v2);
+            }
+
+            Vec3 r0, r1, r2;
+            status[i - blockBegin] = ExtractRotation<IsWarmStart>(a0, a1, a2, v0, v1, v2, r0, r1, r2);
+
+            StoreMatrix(r0, r1, r2, stride, i, rotations);
+            if (KeepsBases)
+            {
+                StoreBasis(v0, v1, v2, stride, i, bases);
+            }
+        }
+
+        // redo the matrices the warm start failed on with the cold start, and the rank deficient ones with the general SVD
+        // since the singular vectors of the small singular values are lost in A^t A
+        for (unsigned int i = blockBegin; i < blockEnd; i++)
+        {
+            uint8_t result = status[i - blockBegin];
+            if (result == 0)
+            {
+                continue;
+            }
+
+            Vec3 a0, a1, a2;
+            LoadMatrix(mats, stride, i, a0, a1, a2);
+
+            Vec3 v0 = { 1.0, 0.0, 0.0 };
+            Vec3 v1 = { 0.0, 1.0, 0.0 };
+            Vec3 v2 = { 0.0, 0.0, 1.0 };
+            Vec3 r0, r1, r2;
+            if (!(result & RotationRankDeficient))
+            {
+                result = ExtractRotation<false>(a0, a1, a2, v0, v1, v2, r0, r1, r2);
+            }
+            if (result & RotationRankDeficient)
+            {
+                ExtractRotationBySVD(a0, a1, a2, v0, v1, v2, r0, r1, r2);
+            }
+
+            StoreMatrix(r0, r1, r2, stride, i, rotations);
+            if (KeepsBases)
+            {
+                StoreBasis(v0, v1, v2, stride, i, bases);
+            }
+        }
+    }
+}
+
+
+
+void RotationKernel::ExtractRotations(
+    const double* mats, unsigned int stride, unsigned int count, double* rotations, double* bases, bool warmStart)
+{
+    for (unsigned int blockBegin = 0; blockBegin < count; blockBegin += RotationBlockSize)
+    {
+        const unsigned int blockEnd = std::min(count, blockBegin + RotationBlockSize);
+        if (bases == nullptr)
+        {
+            ExtractRotationBlock<false, false>(mats, stride, blockBegin, blockEnd, rotations, bases);
+        }
+        else if (warmStart)
+        {
+            ExtractRotationBlock<true, true>(mats, stride, blockBegin, blockEnd, rotations, bases);
+        }
+        else
+        {
+            ExtractRotationBlock<false, true>(mats, stride, blockBegin, blockEnd, rotations, bases);
+        }
+    }
+}
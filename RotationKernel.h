@@ -0,0 +1,31 @@
+#pragma once
+
+
+/// <summary>
+/// Batch fit of the closest rotations to 3x3 matrices, vectorized over the matrices.
+/// It depends only on Eigen, so that it can be checked outside Maya (see benchmarks/rotation_kernel_accuracy.cpp).
+/// </summary>
+class RotationKernel
+{
+public:
+	/// <summary>
+	/// Compute the rotations closest to a batch of 3x3 matrices, i.e. the rotation R maximizing tr(R^t * A),
+	/// which is the rotation part of the polar decomposition of A when det(A) > 0.
+	/// Reflections are never returned: when det(A) < 0, the axis of the smallest singular value is flipped.
+	/// The matrices are stored as structure of arrays: element (r, c) of the i-th matrix is at mats[(3 * r + c) * stride + i].
+	/// </summary>
+	/// <param name="mats">9 * stride elements</param>
+	/// <param name="stride">distance between the same elements of the consecutive matrices (>= count)</param>
+	/// <param name="count"># of matrices</param>
+	/// <param name="rotations">[out] 9 * stride elements in the same layout as mats</param>
+	/// <param name="bases">
+	/// [in, out] optional 4 * stride elements, the quaternion (x, y, z, w) of the right singular vectors of each matrix
+	/// at bases[k * stride + i]. They are written on output, and read as the initial guess if warmStart is true.
+	/// </param>
+	/// <param name="warmStart">
+	/// start from bases, which converges in fewer iterations if the matrices have changed only slightly since bases was written.
+	/// The matrices the warm start does not converge on are solved again from scratch.
+	/// </param>
+	static void ExtractRotations(
+		const double* mats, unsigned int stride, unsigned int count, double* rotations, double* bases = nullptr, bool warmStart = false);
+};
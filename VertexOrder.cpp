@@ -0,0 +1,158 @@
+#include "VertexOrder.h"
+#include "ParallelUtil.h"
+#include <algorithm>
+#include <utility>
+#include <cmath>
+
+
+void VertexOrder::Compute(Kind kind, const MeshTopology& topology, const MPointArray& restPoints)
+{
+	Clear();
+
+	switch (kind)
+	{
+	case Kind::ReverseCuthillMcKee: ComputeReverseCuthillMcKee(topology); break;
+	case Kind::Morton: ComputeMorton(restPoints); break;
+	default: return;
+	}
+
+	const uint32_t numVertices = static_cast<uint32_t>(m_newToOld.size());
+	m_oldToNew.resize(numVertices);
+	bool isIdentity = true;
+	for (uint32_t newIdx = 0; newIdx < numVertices; newIdx++)
+	{
+		m_oldToNew[m_newToOld[newIdx]] = newIdx;
+		isIdentity = isIdentity && m_newToOld[newIdx] == newIdx;
+	}
+
+	// the identity is represented by the empty arrays, so that the deformers skip the remapping
+	if (isIdentity)
+	{
+		Clear();
+	}
+}
+
+void VertexOrder::Clear()
+{
+	m_newToOld.clear();
+	m_oldToNew.clear();
+}
+
+void VertexOrder::Gather(const MPointArray& original, MPointArray& internal, int numThreads) const
+{
+	const uint32_t numVertices = static_cast<uint32_t>(m_newToOld.size());
+	internal.setLength(numVertices);
+	ParallelUtil::ForEach(static_cast<int>(numVertices), numThreads, [&](int newIdx)
+		{
+			internal[newIdx] = original[m_newToOld[newIdx]];
+		});
+}
+
+void VertexOrder::Scatter(const MPointArray& internal, MPointArray& original, int numThreads) const
+{
+	const uint32_t numVertices = static_cast<uint32_t>(m_newToOld.size());
+	original.setLength(numVertices);
+	ParallelUtil::ForEach(static_cast<int>(numVertices), numThreads, [&](int newIdx)
+		{
+			original[m_newToOld[newIdx]] = internal[newIdx];
+		});
+}
+
+void VertexOrder::ComputeReverseCuthillMcKee(const MeshTopology& topology)
+{
+	const uint32_t numVertices = topology.NumVertices();
+	const std::vector<uint32_t>& offsets = topology.AdjacencyOffsets();
+	const std::vector<uint32_t>& indices = topology.AdjacencyIndices();
+
+	// vertices by ascending degree, so that each component starts from a vertex of the lowest degree, which is usually on its periphery
+	std::vector<uint32_t> byDegree(numVertices);
+	for (uint32_t vertIdx = 0; vertIdx < numVertices; vertIdx++)
+	{
+		byDegree[vertIdx] = vertIdx;
+	}
+	std::stable_sort(byDegree.begin(), byDegree.end(), [&](uint32_t a, uint32_t b) { return topology.Degree(a) < topology.Degree(b); });
+
+	// breadth-first search, visiting the neighbours of each vertex in ascending order of degree
+	m_newToOld.clear();
+	m_newToOld.reserve(numVertices);
+	std::vector<uint8_t> isVisited(numVertices, 0);
+	std::vector<uint32_t> neighbours;
+	for (const uint32_t start : byDegree)
+	{
+		if (isVisited[start])
+		{
+			continue;
+		}
+
+		isVisited[start] = 1;
+		m_newToOld.push_back(start);
+		for (size_t head = m_newToOld.size() - 1; head < m_newToOld.size(); head++)
+		{
+			const uint32_t vertIdx = m_newToOld[head];
+			neighbours.clear();
+			for (uint32_t aIdx = offsets[vertIdx]; aIdx < offsets[vertIdx + 1]; aIdx++)
+			{
+				if (!isVisited[indices[aIdx]])
+				{
+					isVisited[indices[aIdx]] = 1;
+					neighbours.push_back(indices[aIdx]);
+				}
+			}
+			std::stable_sort(neighbours.begin(), neighbours.end(), [&](uint32_t a, uint32_t b) { return topology.Degree(a) < topology.Degree(b); });
+			m_newToOld.insert(m_newToOld.end(), neighbours.begin(), neighbours.end());
+		}
+	}
+
+	std::reverse(m_newToOld.begin(), m_newToOld.end());
+}
+
+void VertexOrder::ComputeMorton(const MPointArray& restPoints)
+{
+	const uint32_t numVertices = restPoints.length();
+	if (numVertices == 0)
+	{
+		return;
+	}
+
+	MPoint lower = restPoints[0];
+	MPoint upper = lower;
+	for (uint32_t vertIdx = 0; vertIdx < numVertices; vertIdx++)
+	{
+		const MPoint& p = restPoints[vertIdx];
+		lower = MPoint(std::min(lower.x, p.x), std::min(lower.y, p.y), std::min(lower.z, p.z));
+		upper = MPoint(std::max(upper.x, p.x), std::max(upper.y, p.y), std::max(upper.z, p.z));
+	}
+
+	// 21 bits per axis in the bounding cube, interleaved into a 63-bit code
+	const double extent = std::max({ upper.x - lower.x, upper.y - lower.y, upper.z - lower.z });
+	const double scale = extent > 0.0 ? ((1u << 21) - 1) / extent : 0.0;
+	const auto spread = [](uint64_t x)
+		{
+			x &= 0x1fffff;
+			x = (x | (x << 32)) & 0x1f00000000ffffull;
+			x = (x | (x << 16)) & 0x1f0000ff0000ffull;
+			x = (x | (x << 8)) & 0x100f00f00f00f00full;
+			x = (x | (x << 4)) & 0x10c30c30c30c30c3ull;
+			x = (x | (x << 2)) & 0x1249249249249249ull;
+			return x;
+		};
+
+	std::vector<std::pair<uint64_t, uint32_t>> codes(numVertices);
+	for (uint32_t vertIdx = 0; vertIdx < numVertices; vertIdx++)
+	{
+		const MPoint& p = restPoints[vertIdx];
+		const uint64_t x = static_cast<uint64_t>((p.x - lower.x) * scale);
+		const uint64_t y = static_cast<uint64_t>((p.y - lower.y) * scale);
+		const uint64_t z = static_cast<uint64_t>((p.z - lower.z) * scale);
+		codes[vertIdx] = { spread(x) | (spread(y) << 1) | (spread(z) << 2), vertIdx };
+	}
+
+	// the vertex index breaks the ties of coincident points, so the order is deterministic
+	std::sort(codes.begin(), codes.end());
+
+	m_newToOld.resize(numVertices);
+	for (uint32_t newIdx = 0; newIdx < numVertices; newIdx++)
+	{
+		m_newToOld[newIdx] = codes[newIdx].second;
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include "MeshTopology.h"
+#include <maya/MPointArray.h>
+#include <vector>
+#include <cstdint>
+
+
+/// <summary>
+/// Permutation of the vertices the deformers run in internally, so that the neighbours of a vertex are close in memory.
+/// Internal vertex i is vertex NewToOld()[i] of the mesh. Only the inputs and the outputs are remapped, and all the
+/// per-vertex buffers, the adjacency and the weights are stored in the internal order.
+/// </summary>
+class VertexOrder
+{
+public:
+	VertexOrder() = default;
+	~VertexOrder() = default;
+
+	enum class Kind : int8_t
+	{
+		/// <summary>
+		/// the order of the mesh, which is the identity permutation
+		/// </summary>
+		Original = 0,
+
+		/// <summary>
+		/// reverse Cuthill-McKee on the adjacency, which minimizes the bandwidth of the Laplacian
+		/// </summary>
+		ReverseCuthillMcKee,
+
+		/// <summary>
+		/// Z-order curve of the rest positions
+		/// </summary>
+		Morton,
+	};
+
+	/// <summary>
+	/// Compute the permutation. It is deterministic, so the same inputs always give the same order
+	/// </summary>
+	/// <param name="kind"></param>
+	/// <param name="topology">used by ReverseCuthillMcKee</param>
+	/// <param name="restPoints">used by Morton</param>
+	void Compute(Kind kind, const MeshTopology& topology, const MPointArray& restPoints);
+
+	void Clear();
+
+	bool IsIdentity() const
+	{
+		return m_newToOld.empty();
+	}
+
+	/// <summary>
+	/// vertex of the mesh of each internal vertex, empty for the identity
+	/// </summary>
+	const std::vector<uint32_t>& NewToOld() const
+	{
+		return m_newToOld;
+	}
+
+	/// <summary>
+	/// internal vertex of each vertex of the mesh, empty for the identity
+	/// </summary>
+	const std::vector<uint32_t>& OldToNew() const
+	{
+		return m_oldToNew;
+	}
+
+	/// <summary>
+	/// internal[i] = original[NewToOld()[i]]
+	/// </summary>
+	/// <param name="numThreads">zero means all the available threads</param>
+	void Gather(const MPointArray& original, MPointArray& internal, int numThreads = 0) const;
+
+	/// <summary>
+	/// original[NewToOld()[i]] = internal[i]
+	/// </summary>
+	/// <param name="numThreads">zero means all the available threads</param>
+	void Scatter(const MPointArray& internal, MPointArray& original, int numThreads = 0) const;
+
+	friend bool operator==(const VertexOrder& a, const VertexOrder& b)
+	{
+		return a.m_newToOld == b.m_newToOld;
+	}
+
+	friend bool operator!=(const VertexOrder& a, const VertexOrder& b)
+	{
+		return !(a == b);
+	}
+
+private:
+	std::vector<uint32_t> m_newToOld;
+	std::vector<uint32_t> m_oldToNew;
+
+	void ComputeReverseCuthillMcKee(const MeshTopology& topology);
+	void ComputeMorton(const MPointArray& restPoints);
+};
@@ -0,0 +1,266 @@
+#include "WeightTable.h"
+#include <maya/MPxSkinCluster.h>
+#include <maya/MDataHandle.h>
+#include <algorithm>
+#include <cmath>
+
+
+MStatus WeightTable::Build(MArrayDataHandle& weightListsHandle, unsigned int numVertices)
+{
+	MStatus status;
+
+	m_offsets.assign(numVertices + 1, 0);
+	m_joints.clear();
+	m_weights.clear();
+
+	// vertex index of each entry, in the order they are read
+	std::vector<uint32_t> entryVertIdxs;
+	bool isSorted = true;
+
+	const unsigned int numWeightLists = weightListsHandle.elementCount(&status);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+	for (unsigned int lIdx = 0; lIdx < numWeightLists; lIdx++)
+	{
+		weightListsHandle.jumpToArrayElement(lIdx); // jump to physical index
+
+		// logical index corresponds to the vertex index
+		const unsigned int vertIdx = weightListsHandle.elementIndex(&status);
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+		if (vertIdx >= numVertices)
+		{
+			continue;
+		}
+		isSorted = isSorted && (entryVertIdxs.empty() || entryVertIdxs.back() <= vertIdx);
+
+		MArrayDataHandle weightsHandle = weightListsHandle.inputValue(&status).child(MPxSkinCluster::weights);
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+
+		const unsigned int numWeights = weightsHandle.elementCount(); // # of nonzero weights
+		for (unsigned int wIdx = 0; wIdx < numWeights; wIdx++)
+		{
+			weightsHandle.jumpToArrayElement(wIdx); // jump to physical index
+			const double w = weightsHandle.inputValue().asDouble();
+			if (w == 0.0)
+			{
+				continue;
+			}
+
+			// logical index corresponds to the joint index
+			const uint32_t jointIdx = weightsHandle.elementIndex(&status);
+			CHECK_MSTATUS_AND_RETURN_IT(status);
+
+			m_joints.push_back(jointIdx);
+			m_weights.push_back(w);
+			entryVertIdxs.push_back(vertIdx);
+			m_offsets[vertIdx + 1]++;
+		}
+	}
+
+	// convert the counts to the offsets
+	m_maxInfluences = 0;
+	for (unsigned int vertIdx = 0; vertIdx < numVertices; vertIdx++)
+	{
+		m_maxInfluences = std::max(m_maxInfluences, m_offsets[vertIdx + 1]);
+		m_offsets[vertIdx + 1] += m_offsets[vertIdx];
+	}
+
+	m_numJoints = m_joints.empty() ? 0 : *std::max_element(m_joints.begin(), m_joints.end()) + 1;
+
+	// weightList elements are usually sorted by the logical index, otherwise scatter the entries into the CSR order
+	if (!isSorted)
+	{
+		std::vector<uint32_t> joints(m_joints.size());
+		std::vector<double> weights(m_weights.size());
+		std::vector<uint32_t> cursors(m_offsets.begin(), m_offsets.end() - 1);
+		for (size_t eIdx = 0; eIdx < entryVertIdxs.size(); eIdx++)
+		{
+			const uint32_t dst = cursors[entryVertIdxs[eIdx]]++;
+			joints[dst] = m_joints[eIdx];
+			weights[dst] = m_weights[eIdx];
+		}
+		m_joints.swap(joints);
+		m_weights.swap(weights);
+	}
+
+	BuildBuckets();
+
+	m_version++;
+
+	return status;
+}
+
+void WeightTable::Condition(const Conditioning& conditioning, ConditioningStats* stats)
+{
+	const unsigned int numVertices = NumVertices();
+
+	ConditioningStats result;
+	result.NumEntriesBefore = NumEntries();
+	result.MaxInfluencesBefore = m_maxInfluences;
+
+	// entries of the vertex ordered by weight, and whether each of them is kept
+	std::vector<uint32_t> order;
+	std::vector<uint8_t> isKept;
+
+	// compact the entries in place, since the kept entries never move forward
+	unsigned int dst = 0;
+	unsigned int begin = m_offsets[0];
+	for (unsigned int vertIdx = 0; vertIdx < numVertices; vertIdx++)
+	{
+		const unsigned int end = m_offsets[vertIdx + 1];
+		const unsigned int numInfluences = end - begin;
+
+		order.resize(numInfluences);
+		for (unsigned int i = 0; i < numInfluences; i++)
+		{
+			order[i] = i;
+		}
+		std::stable_sort(order.begin(), order.end(),
+			[&](uint32_t a, uint32_t b) { return std::abs(m_weights[begin + a]) > std::abs(m_weights[begin + b]); });
+
+		isKept.assign(numInfluences, 0);
+		double totalWeight = 0.0;
+		double keptWeight = 0.0;
+		for (unsigned int rank = 0; rank < numInfluences; rank++)
+		{
+			const double w = m_weights[begin + order[rank]];
+			totalWeight += w;
+
+			const bool isOverLimit = conditioning.MaxInfluences > 0 && rank >= conditioning.MaxInfluences;
+			if (rank == 0 || (!isOverLimit && std::abs(w) >= conditioning.MinWeight))
+			{
+				isKept[order[rank]] = 1;
+				keptWeight += w;
+			}
+		}
+
+		// keep the order of the joints of the vertex
+		const double scale = keptWeight != 0.0 ? totalWeight / keptWeight : 1.0;
+		m_offsets[vertIdx] = dst;
+		for (unsigned int i = 0; i < numInfluences; i++)
+		{
+			if (isKept[i])
+			{
+				m_joints[dst] = m_joints[begin + i];
+				m_weights[dst] = m_weights[begin + i] * scale;
+				dst++;
+			}
+		}
+
+		result.MaxDroppedWeight = std::max(result.MaxDroppedWeight, std::abs(totalWeight - keptWeight));
+		begin = end;
+	}
+	m_offsets[numVertices] = dst;
+	m_joints.resize(dst);
+	m_weights.resize(dst);
+
+	m_maxInfluences = 0;
+	for (unsigned int vertIdx = 0; vertIdx < numVertices; vertIdx++)
+	{
+		m_maxInfluences = std::max(m_maxInfluences, NumInfluences(vertIdx));
+	}
+	m_numJoints = m_joints.empty() ? 0 : *std::max_element(m_joints.begin(), m_joints.end()) + 1;
+
+	BuildBuckets();
+
+	m_version++;
+
+	result.NumDroppedEntries = result.NumEntriesBefore - NumEntries();
+	if (stats)
+	{
+		*stats = result;
+	}
+}
+
+void WeightTable::Permute(const std::vector<uint32_t>& newToOld)
+{
+	const unsigned int numVertices = NumVertices();
+
+	std::vector<uint32_t> offsets(numVertices + 1);
+	offsets[0] = 0;
+	for (unsigned int newIdx = 0; newIdx < numVertices; newIdx++)
+	{
+		offsets[newIdx + 1] = offsets[newIdx] + NumInfluences(newToOld[newIdx]);
+	}
+
+	std::vector<uint32_t> joints(m_joints.size());
+	std::vector<double> weights(m_weights.size());
+	for (unsigned int newIdx = 0; newIdx < numVertices; newIdx++)
+	{
+		const unsigned int begin = Begin(newToOld[newIdx]);
+		const unsigned int end = End(newToOld[newIdx]);
+		std::copy(m_joints.begin() + begin, m_joints.begin() + end, joints.begin() + offsets[newIdx]);
+		std::copy(m_weights.begin() + begin, m_weights.begin() + end, weights.begin() + offsets[newIdx]);
+	}
+
+	m_offsets.swap(offsets);
+	m_joints.swap(joints);
+	m_weights.swap(weights);
+
+	BuildBuckets();
+
+	m_version++;
+}
+
+void WeightTable::BuildBuckets()
+{
+	const unsigned int numVertices = NumVertices();
+
+	// counting sort of the vertices by their # of influences
+	m_bucketOffsets.assign(m_maxInfluences + 2, 0);
+	for (unsigned int vertIdx = 0; vertIdx < numVertices; vertIdx++)
+	{
+		m_bucketOffsets[NumInfluences(vertIdx) + 1]++;
+	}
+	for (unsigned int numInfluences = 0; numInfluences <= m_maxInfluences; numInfluences++)
+	{
+		m_bucketOffsets[numInfluences + 1] += m_bucketOffsets[numInfluences];
+	}
+
+	m_bucketVertices.resize(numVertices);
+	std::vector<uint32_t> cursors(m_bucketOffsets.begin(), m_bucketOffsets.end() - 1);
+	for (unsigned int vertIdx = 0; vertIdx < numVertices; vertIdx++)
+	{
+		m_bucketVertices[cursors[NumInfluences(vertIdx)]++] = vertIdx;
+	}
+}
+
+double WeightTable::FindWeight(unsigned int vertIdx, uint32_t jointIdx) const
+{
+	for (unsigned int eIdx = Begin(vertIdx); eIdx < End(vertIdx); eIdx++)
+	{
+		if (m_joints[eIdx] == jointIdx)
+		{
+			return m_weights[eIdx];
+		}
+	}
+
+	return 0.0;
+}
+
+void WeightTable::FindChangedVertices(const WeightTable& previous, std::vector<uint32_t>& changedVerts) const
+{
+	changedVerts.clear();
+
+	const unsigned int numVertices = NumVertices();
+	if (previous.NumVertices() != numVertices)
+	{
+		changedVerts.resize(numVertices);
+		for (unsigned int vertIdx = 0; vertIdx < numVertices; vertIdx++)
+		{
+			changedVerts[vertIdx] = vertIdx;
+		}
+		return;
+	}
+
+	for (unsigned int vertIdx = 0; vertIdx < numVertices; vertIdx++)
+	{
+		const unsigned int begin = Begin(vertIdx);
+		const unsigned int prevBegin = previous.Begin(vertIdx);
+		if (NumInfluences(vertIdx) != previous.NumInfluences(vertIdx)
+			|| !std::equal(m_joints.data() + begin, m_joints.data() + End(vertIdx), previous.m_joints.data() + prevBegin)
+			|| !std::equal(m_weights.data() + begin, m_weights.data() + End(vertIdx), previous.m_weights.data() + prevBegin))
+		{
+			changedVerts.push_back(vertIdx);
+		}
+	}
+}
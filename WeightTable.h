@@ -0,0 +1,267 @@
+#pragma once
+#include "ContentHash.h"
+#include <maya/MArrayDataHandle.h>
+#include <maya/MStatus.h>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+
+
+/// <summary>
+/// Skin weights of all the vertices in the compressed sparse row (CSR) layout.
+/// The influences of vertex v are stored in [Begin(v), End(v)) of Joints() and Weights().
+/// </summary>
+class WeightTable
+{
+public:
+	WeightTable() = default;
+	~WeightTable() = default;
+
+	/// <summary>
+	/// Build the table from the weightList attribute
+	/// </summary>
+	/// <param name="weightListsHandle">weightList attribute</param>
+	/// <param name="numVertices"># of vertices in the deformed geometry</param>
+	/// <returns></returns>
+	MStatus Build(MArrayDataHandle& weightListsHandle, unsigned int numVertices);
+
+	/// <summary>
+	/// Limits on the influences of each vertex applied by Condition
+	/// </summary>
+	struct Conditioning
+	{
+		/// <summary>
+		/// # of the largest weights kept on each vertex (0 means no limit)
+		/// </summary>
+		unsigned int MaxInfluences = 0;
+
+		/// <summary>
+		/// weights below this are dropped, except for the largest one of each vertex
+		/// </summary>
+		double MinWeight = 0.0;
+
+		bool operator==(const Conditioning& other) const
+		{
+			return MaxInfluences == other.MaxInfluences && MinWeight == other.MinWeight;
+		}
+		bool operator!=(const Conditioning& other) const
+		{
+			return !(*this == other);
+		}
+	};
+
+	/// <summary>
+	/// Result of Condition
+	/// </summary>
+	struct ConditioningStats
+	{
+		unsigned int NumEntriesBefore = 0;
+		unsigned int NumDroppedEntries = 0;
+		unsigned int MaxInfluencesBefore = 0;
+
+		/// <summary>
+		/// the largest sum of the dropped weights of a vertex, before renormalization
+		/// </summary>
+		double MaxDroppedWeight = 0.0;
+	};
+
+	/// <summary>
+	/// Drop the small weights of each vertex, and scale the rest so that the sum of the weights of the vertex is kept.
+	/// Every deformer works on the entries of the table, so its cost decreases in proportion to the # of entries.
+	/// </summary>
+	/// <param name="conditioning"></param>
+	/// <param name="stats">[out] optional</param>
+	void Condition(const Conditioning& conditioning, ConditioningStats* stats = nullptr);
+
+	/// <summary>
+	/// Reorder the vertices so that vertex newToOld[i] of the table becomes vertex i
+	/// </summary>
+	/// <param name="newToOld">permutation of the vertices</param>
+	void Permute(const std::vector<uint32_t>& newToOld);
+
+	unsigned int NumVertices() const
+	{
+		return m_offsets.empty() ? 0 : static_cast<unsigned int>(m_offsets.size() - 1);
+	}
+
+	/// <summary>
+	/// # of (vertex, joint) pairs with nonzero weight
+	/// </summary>
+	unsigned int NumEntries() const
+	{
+		return static_cast<unsigned int>(m_joints.size());
+	}
+
+	/// <summary>
+	/// the largest # of influences among all the vertices
+	/// </summary>
+	unsigned int MaxInfluences() const
+	{
+		return m_maxInfluences;
+	}
+
+	/// <summary>
+	/// the largest joint index referred by the weights + 1
+	/// </summary>
+	unsigned int NumJoints() const
+	{
+		return m_numJoints;
+	}
+
+	unsigned int Begin(unsigned int vertIdx) const
+	{
+		return m_offsets[vertIdx];
+	}
+
+	unsigned int End(unsigned int vertIdx) const
+	{
+		return m_offsets[vertIdx + 1];
+	}
+
+	unsigned int NumInfluences(unsigned int vertIdx) const
+	{
+		return m_offsets[vertIdx + 1] - m_offsets[vertIdx];
+	}
+
+	uint32_t Joint(unsigned int entryIdx) const
+	{
+		return m_joints[entryIdx];
+	}
+
+	double Weight(unsigned int entryIdx) const
+	{
+		return m_weights[entryIdx];
+	}
+
+	/// <summary>
+	/// weight of the given joint on the given vertex, or zero if the joint does not influence the vertex
+	/// </summary>
+	double FindWeight(unsigned int vertIdx, uint32_t jointIdx) const;
+
+	/// <summary>
+	/// Find the vertices whose influences or weights differ from the previous table, e.g. after the weights are painted.
+	/// All the vertices are returned if the # of vertices differs.
+	/// </summary>
+	/// <param name="previous"></param>
+	/// <param name="changedVerts">[out] in ascending order</param>
+	void FindChangedVertices(const WeightTable& previous, std::vector<uint32_t>& changedVerts) const;
+
+	const std::vector<uint32_t>& Offsets() const
+	{
+		return m_offsets;
+	}
+
+	const std::vector<uint32_t>& Joints() const
+	{
+		return m_joints;
+	}
+
+	const std::vector<double>& Weights() const
+	{
+		return m_weights;
+	}
+
+	/// <summary>
+	/// Largest influence count with its own unrolled kernel instantiation in ForEachBucket
+	/// </summary>
+	static constexpr unsigned int MaxUnrolledInfluences = 8;
+
+	/// <summary>
+	/// vertex indices sorted by their # of influences (stable, so the vertex order is kept inside a bucket)
+	/// </summary>
+	const std::vector<uint32_t>& BucketVertices() const
+	{
+		return m_bucketVertices;
+	}
+
+	/// <summary>
+	/// vertices with numInfluences influences are in [BucketBegin, BucketEnd) of BucketVertices()
+	/// </summary>
+	unsigned int BucketBegin(unsigned int numInfluences) const
+	{
+		return m_bucketOffsets[numInfluences];
+	}
+
+	unsigned int BucketEnd(unsigned int numInfluences) const
+	{
+		return m_bucketOffsets[numInfluences + 1];
+	}
+
+	/// <summary>
+	/// Call func(tag, vertIdxs, numBucketVerts) for each non-empty bucket of vertices with the same # of influences.
+	/// tag is std::integral_constant<unsigned int, N> where N is the # of influences for 1 <= N <= MaxUnrolledInfluences,
+	/// and N = 0 for the other buckets, whose kernels should read the count at runtime.
+	/// </summary>
+	template <typename Func>
+	void ForEachBucket(Func&& func) const
+	{
+		for (unsigned int numInfluences = 0; numInfluences + 1 < m_bucketOffsets.size(); numInfluences++)
+		{
+			const unsigned int numBucketVerts = BucketEnd(numInfluences) - BucketBegin(numInfluences);
+			if (numBucketVerts == 0)
+			{
+				continue;
+			}
+
+			const uint32_t* vertIdxs = &m_bucketVertices[BucketBegin(numInfluences)];
+			switch (numInfluences)
+			{
+			case 1: func(std::integral_constant<unsigned int, 1>(), vertIdxs, numBucketVerts); break;
+			case 2: func(std::integral_constant<unsigned int, 2>(), vertIdxs, numBucketVerts); break;
+			case 3: func(std::integral_constant<unsigned int, 3>(), vertIdxs, numBucketVerts); break;
+			case 4: func(std::integral_constant<unsigned int, 4>(), vertIdxs, numBucketVerts); break;
+			case 5: func(std::integral_constant<unsigned int, 5>(), vertIdxs, numBucketVerts); break;
+			case 6: func(std::integral_constant<unsigned int, 6>(), vertIdxs, numBucketVerts); break;
+			case 7: func(std::integral_constant<unsigned int, 7>(), vertIdxs, numBucketVerts); break;
+			case 8: func(std::integral_constant<unsigned int, 8>(), vertIdxs, numBucketVerts); break;
+			default: func(std::integral_constant<unsigned int, 0>(), vertIdxs, numBucketVerts); break;
+			}
+			static_assert(MaxUnrolledInfluences == 8, "update the cases above");
+		}
+	}
+
+	/// <summary>
+	/// Add the contents of the table to the hash
+	/// </summary>
+	void AddToHash(ContentHash& hash) const
+	{
+		hash.AddArray(m_offsets);
+		hash.AddArray(m_joints);
+		hash.AddArray(m_weights);
+	}
+
+	/// <summary>
+	/// counter incremented every time the table is rebuilt, so that consumers can tell if their copies are stale
+	/// </summary>
+	uint64_t Version() const
+	{
+		return m_version;
+	}
+
+private:
+	/// <summary>
+	/// offsets of each vertex in m_joints and m_weights (# of vertices + 1 elements)
+	/// </summary>
+	std::vector<uint32_t> m_offsets;
+
+	/// <summary>
+	/// joint indices, i.e. the logical indices of the matrix attribute
+	/// </summary>
+	std::vector<uint32_t> m_joints;
+
+	std::vector<double> m_weights;
+
+	unsigned int m_maxInfluences = 0;
+
+	unsigned int m_numJoints = 0;
+
+	/// <summary>
+	/// vertex indices bucketed by the # of influences, and the offsets of each bucket (MaxInfluences() + 2 elements)
+	/// </summary>
+	std::vector<uint32_t> m_bucketVertices;
+	std::vector<uint32_t> m_bucketOffsets;
+
+	void BuildBuckets();
+
+	uint64_t m_version = 0;
+};
@@ -0,0 +1,112 @@
+"""
+Fixture shared by the benchmarks: a sphere bound to a joint chain with 4 influences per vertex
+and converted to customSkinCluster, and the timing of its evaluation.
+
+Importing this module initializes maya.standalone, so it has to be imported before maya.cmds.
+"""
+import math
+import sys
+import time
+
+import maya.standalone
+
+maya.standalone.initialize(name="python")
+
+import maya.cmds as cmds  # noqa: E402
+
+NUM_JOINTS = 8
+MAX_INFLUENCES = 4
+NUM_REPEATS = 3
+
+SKINNING_METHOD_LBS = 0
+SKINNING_METHOD_DMLBS = 1
+SKINNING_METHOD_DDM = 2
+
+
+def load_plugin(doc, default_resolutions):
+    """Load the plugin given on the command line, and return the resolutions to run, or None after printing the usage."""
+    if len(sys.argv) < 2:
+        print(doc)
+        return None
+
+    cmds.loadPlugin(sys.argv[1])
+    return [int(arg) for arg in sys.argv[2:]] or default_resolutions
+
+
+def build_scene(subdivisions, smooth_amount, smooth_iteration, method=None, bend=False, mesh_factory=None):
+    """Build the skinned sphere in a new scene, and return the mesh, the joints and the customSkinCluster.
+
+    mesh_factory(subdivisions) replaces the polySphere, and bend rotates the chain so that the frames of the mesh rotate.
+    """
+    cmds.file(new=True, force=True)
+
+    if mesh_factory:
+        mesh = mesh_factory(subdivisions)
+    else:
+        mesh = cmds.polySphere(subdivisionsAxis=subdivisions, subdivisionsHeight=subdivisions, radius=1.0)[0]
+
+    cmds.select(clear=True)
+    joints = []
+    for i in range(NUM_JOINTS):
+        y = -1.0 + 2.0 * i / (NUM_JOINTS - 1)
+        joints.append(cmds.joint(position=(0.0, y, 0.0)))
+
+    cmds.skinCluster(joints, mesh, maximumInfluences=MAX_INFLUENCES, toSelectedBones=True)
+
+    cmds.select(mesh)
+    cmds.replaceSkcl()
+    skcl = cmds.ls(cmds.listHistory(mesh), type="customSkinCluster")[0]
+    if method is not None:
+        cmds.setAttr(skcl + ".customSkinningMethod", method)
+    cmds.setAttr(skcl + ".smoothAmount", smooth_amount)
+    cmds.setAttr(skcl + ".smoothItr", smooth_iteration)
+
+    if bend:
+        for joint in joints[1:]:
+            cmds.setAttr(joint + ".rotateZ", 60.0 / (NUM_JOINTS - 1))
+
+    return mesh, joints, skcl
+
+
+def time_evaluation(skcl):
+    """Seconds of one evaluation of the deformer."""
+    start = time.perf_counter()
+    cmds.dgeval(skcl + ".outputGeometry[0]")
+    return time.perf_counter() - start
+
+
+def time_frames(skcl, joints, pose=None):
+    """Best seconds of NUM_REPEATS evaluations, each after pose(i), which twists the last joint by default."""
+    best = float("inf")
+    for i in range(NUM_REPEATS):
+        if pose:
+            pose(i)
+        else:
+            cmds.setAttr(joints[-1] + ".rotateX", 5.0 * (i + 1))
+
+        best = min(best, time_evaluation(skcl))
+
+    return best
+
+
+def get_positions(mesh):
+    return cmds.xform(mesh + ".vtx[*]", query=True, translation=True, worldSpace=True)
+
+
+def relative_deviations(mesh, positions, reference):
+    """Distance of each vertex from the reference positions, relative to the bounding box diagonal of the mesh."""
+    bbox = cmds.exactWorldBoundingBox(mesh)
+    diagonal = math.sqrt(sum((bbox[i + 3] - bbox[i]) ** 2 for i in range(3)))
+
+    deviations = []
+    for v in range(len(positions) // 3):
+        d = [positions[3 * v + c] - reference[3 * v + c] for c in range(3)]
+        deviations.append(math.sqrt(sum(x * x for x in d)) / diagonal)
+    return deviations
+
+
+def run(main):
+    """Run main and exit with its status after shutting down maya.standalone."""
+    status = main()
+    maya.standalone.uninitialize()
+    sys.exit(status)
@@ -0,0 +1,59 @@
+"""
+Timing benchmark of the DDM precomputation against the mesh size.
+
+Run with mayapy after building the plugin:
+    mayapy benchmarks/ddm_precompute_scaling.py <path to the plugin> [subdivisions ...]
+
+For each resolution, a sphere is bound to a joint chain with 4 influences per vertex,
+converted to customSkinCluster, and evaluated with LBS and DDM. needRebindMesh is set
+before every evaluation to force DDM to recompute the Psi matrices, so the difference
+of the two evaluation times is the cost of the precomputation.
+"""
+import math
+
+import common
+from common import cmds
+
+SMOOTH_AMOUNT = 0.5
+SMOOTH_ITERATION = 4
+
+
+def time_evaluation(skcl, joints, method):
+    cmds.setAttr(skcl + ".customSkinningMethod", method)
+    cmds.setAttr(skcl + ".doRecompute", True)
+
+    def pose(i):
+        # rebind so that the Laplacian is also rebuilt, as binding does
+        cmds.setAttr(skcl + ".needRebindMesh", True)
+        cmds.setAttr(joints[-1] + ".rotateZ", 10.0 * (i + 1))
+
+    return common.time_frames(skcl, joints, pose)
+
+
+def main():
+    resolutions = common.load_plugin(__doc__, [20, 40, 80, 160, 320])
+    if resolutions is None:
+        return 1
+
+    print("{:>10} {:>12} {:>12} {:>14}".format("vertices", "LBS [s]", "DDM [s]", "precompute [s]"))
+    results = []
+    for subdivisions in resolutions:
+        mesh, joints, skcl = common.build_scene(subdivisions, SMOOTH_AMOUNT, SMOOTH_ITERATION)
+        num_verts = cmds.polyEvaluate(mesh, vertex=True)
+
+        lbs = time_evaluation(skcl, joints, common.SKINNING_METHOD_LBS)
+        ddm = time_evaluation(skcl, joints, common.SKINNING_METHOD_DDM)
+        precompute = max(ddm - lbs, 1e-9)
+        results.append((num_verts, precompute))
+
+        print("{:>10} {:>12.4f} {:>12.4f} {:>14.4f}".format(num_verts, lbs, ddm, precompute))
+
+    # slope of the log-log curve, which is about 1 if the precomputation is linear in the mesh size
+    for (n0, t0), (n1, t1) in zip(results, results[1:]):
+        print("{:>10} -> {:<10} exponent {:.2f}".format(n0, n1, math.log(t1 / t0) / math.log(n1 / n0)))
+
+    return 0
+
+
+if __name__ == "__main__":
+    common.run(main)
@@ -0,0 +1,65 @@
+"""
+Bind and per-frame timing of the smoothing engines of Delta Mush.
+
+Run with mayapy after building the plugin:
+    mayapy benchmarks/delta_mush_smoothing.py <path to the plugin> [subdivisions ...]
+
+For each resolution, a sphere is bound to a joint chain with 4 influences per vertex,
+converted to customSkinCluster, and evaluated with DM+LBS using the plain smoothItr passes,
+the Chebyshev expansion (deltaMushChebyshevTolerance) and the implicit step (smoothImplicit).
+The bind time is the evaluation that rebuilds the Delta Mush data after the engine changes,
+and the frame time is the best of a few evaluations in different poses. The deviation of each
+engine from the plain passes is reported relative to the bounding box of the mesh.
+"""
+import common
+from common import cmds
+
+SMOOTH_AMOUNT = 0.5
+SMOOTH_ITERATION = 40
+CHEBYSHEV_TOLERANCE = 1e-2
+
+# (name, smoothImplicit, deltaMushChebyshevTolerance)
+ENGINES = [
+    ("plain", False, 0.0),
+    ("chebyshev", False, CHEBYSHEV_TOLERANCE),
+    ("implicit", True, 0.0),
+]
+
+
+def evaluate(mesh, joints, skcl, implicit, tolerance):
+    cmds.setAttr(joints[-1] + ".rotateX", 0.0)
+    cmds.setAttr(skcl + ".smoothImplicit", implicit)
+    cmds.setAttr(skcl + ".deltaMushChebyshevTolerance", tolerance)
+
+    # the first evaluation binds with the new engine
+    bind = common.time_evaluation(skcl)
+
+    best = common.time_frames(skcl, joints)
+    return bind, best, common.get_positions(mesh)
+
+
+def main():
+    resolutions = common.load_plugin(__doc__, [20, 40, 80, 160])
+    if resolutions is None:
+        return 1
+
+    print("{:>10} {:>10} {:>10} {:>10} {:>12}".format("vertices", "engine", "bind [s]", "frame [s]", "max dev"))
+    for subdivisions in resolutions:
+        mesh, joints, skcl = common.build_scene(
+            subdivisions, SMOOTH_AMOUNT, SMOOTH_ITERATION, method=common.SKINNING_METHOD_DMLBS, bend=True)
+        num_verts = cmds.polyEvaluate(mesh, vertex=True)
+
+        plain = None
+        for name, implicit, tolerance in ENGINES:
+            bind, frame, positions = evaluate(mesh, joints, skcl, implicit, tolerance)
+            if plain is None:
+                plain = positions
+
+            deviation = max(common.relative_deviations(mesh, positions, plain))
+            print("{:>10} {:>10} {:>10.4f} {:>10.4f} {:>12.2e}".format(num_verts, name, bind, frame, deviation))
+
+    return 0
+
+
+if __name__ == "__main__":
+    common.run(main)
@@ -0,0 +1,57 @@
+"""
+Accuracy and timing comparison of the tangent frames of Delta Mush.
+
+Run with mayapy after building the plugin:
+    mayapy benchmarks/delta_mush_tangent_frames.py <path to the plugin> [subdivisions ...]
+
+For each resolution, a sphere is bound to a joint chain with 4 influences per vertex,
+converted to customSkinCluster, and evaluated with DM+LBS in a bent pose using the
+per-neighbour frames and the single frame per vertex (deltaMushFrame). The deviation of
+the single frame from the per-neighbour frames is reported relative to the bounding box
+of the mesh, together with the evaluation time of each mode.
+"""
+import common
+from common import cmds
+
+SMOOTH_AMOUNT = 0.5
+SMOOTH_ITERATION = 20
+
+FRAME_PER_NEIGHBOUR = 0
+FRAME_SINGLE = 1
+
+
+def evaluate(mesh, joints, skcl, frame):
+    cmds.setAttr(skcl + ".deltaMushFrame", frame)
+
+    # the first evaluation binds with the new frames
+    common.time_evaluation(skcl)
+
+    best = common.time_frames(skcl, joints)
+    return best, common.get_positions(mesh)
+
+
+def main():
+    resolutions = common.load_plugin(__doc__, [20, 40, 80, 160])
+    if resolutions is None:
+        return 1
+
+    print("{:>10} {:>16} {:>12} {:>12} {:>12}".format(
+        "vertices", "per-neighbour [s]", "single [s]", "max dev", "mean dev"))
+    for subdivisions in resolutions:
+        mesh, joints, skcl = common.build_scene(
+            subdivisions, SMOOTH_AMOUNT, SMOOTH_ITERATION, method=common.SKINNING_METHOD_DMLBS, bend=True)
+        num_verts = cmds.polyEvaluate(mesh, vertex=True)
+
+        per_neighbour_time, per_neighbour = evaluate(mesh, joints, skcl, FRAME_PER_NEIGHBOUR)
+        single_time, single = evaluate(mesh, joints, skcl, FRAME_SINGLE)
+
+        deviations = common.relative_deviations(mesh, single, per_neighbour)
+
+        print("{:>10} {:>16.4f} {:>12.4f} {:>12.2e} {:>12.2e}".format(
+            num_verts, per_neighbour_time, single_time, max(deviations), sum(deviations) / num_verts))
+
+    return 0
+
+
+if __name__ == "__main__":
+    common.run(main)
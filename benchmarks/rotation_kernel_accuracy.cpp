@@ -0,0 +1,290 @@
+// Accuracy check of RotationKernel::ExtractRotations against Eigen::JacobiSVD.
+//
+// Build and run without Maya:
+//     cmake -S benchmarks -B build/benchmarks && cmake --build build/benchmarks && ctest --test-dir build/benchmarks
+//
+// The reference of each matrix A = U * S * V^t is U * diag(1, 1, det(U V^t)) * V^t, the closest rotation with
+// the axis of the smallest singular value flipped if A is a reflection. The matrices are generated from a fixed seed:
+// random matrices, reflections (det(A) < 0), nearly rank 1 matrices that take the general SVD fallback,
+// and an animation of small perturbations solved with the warm start from the bases of the previous frame.
+// The maximum element error of each case is reported, and the exit status is 1 if any of them exceeds its tolerance.
+#include "../RotationKernel.h"
+#include <Eigen/Core>
+#include <Eigen/LU>
+#include <Eigen/SVD>
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+	constexpr unsigned int Seed = 1;
+
+	// more than one block of the kernel, and a stride larger than the count to check the layout
+	constexpr unsigned int NumMatrices = 1000;
+	constexpr unsigned int Stride = 1003;
+
+	constexpr unsigned int NumWarmStartFrames = 10;
+
+	// relative perturbation of the matrices between the frames of the warm start
+	constexpr double FrameDelta = 1e-3;
+
+	/// <summary>
+	/// Random numbers from the raw output of mt19937, which is the same in every standard library unlike the distributions
+	/// </summary>
+	class Random
+	{
+	public:
+		explicit Random(unsigned int seed) : m_engine(seed) {}
+
+		/// <summary>
+		/// uniform in [lo, hi]
+		/// </summary>
+		double Uniform(double lo, double hi)
+		{
+			return lo + (hi - lo) * (static_cast<double>(m_engine()) / static_cast<double>(std::mt19937::max()));
+		}
+
+		Eigen::Matrix3d Matrix()
+		{
+			Eigen::Matrix3d mat;
+			for (int idx = 0; idx < 9; idx++)
+			{
+				mat(idx / 3, idx % 3) = Uniform(-1.0, 1.0);
+			}
+			return mat;
+		}
+
+		Eigen::Matrix3d Rotation()
+		{
+			Eigen::Vector4d q;
+			do
+			{
+				q = Eigen::Vector4d(Uniform(-1.0, 1.0), Uniform(-1.0, 1.0), Uniform(-1.0, 1.0), Uniform(-1.0, 1.0));
+			} while (q.squaredNorm() > 1.0 || q.squaredNorm() < 1e-6);
+
+			return Eigen::Quaterniond(q.w(), q.x(), q.y(), q.z()).normalized().toRotationMatrix();
+		}
+
+	private:
+		std::mt19937 m_engine;
+	};
+
+	/// <summary>
+	/// Closest rotation by the general SVD with the determinant fix
+	/// </summary>
+	Eigen::Matrix3d ReferenceRotation(const Eigen::Matrix3d& mat)
+	{
+		Eigen::JacobiSVD<Eigen::Matrix3d, Eigen::ComputeFullU | Eigen::ComputeFullV> solver(
+			mat, Eigen::ComputeFullU | Eigen::ComputeFullV);
+
+		const Eigen::Matrix3d& u = solver.matrixU();
+		const Eigen::Matrix3d& v = solver.matrixV();
+		const double det = (u * v.transpose()).determinant();
+		return u * Eigen::Vector3d(1.0, 1.0, det < 0.0 ? -1.0 : 1.0).asDiagonal() * v.transpose();
+	}
+
+	/// <summary>
+	/// Matrices in the structure of arrays layout of ExtractRotations
+	/// </summary>
+	class MatrixBatch
+	{
+	public:
+		MatrixBatch() : m_mats(9 * Stride, 0.0), m_rotations(9 * Stride, 0.0), m_bases(4 * Stride, 0.0) {}
+
+		void Set(unsigned int i, const Eigen::Matrix3d& mat)
+		{
+			for (unsigned int idx = 0; idx < 9; idx++)
+			{
+				m_mats[idx * Stride + i] = mat(idx / 3, idx % 3);
+			}
+		}
+
+		Eigen::Matrix3d Get(unsigned int i) const
+		{
+			Eigen::Matrix3d mat;
+			for (unsigned int idx = 0; idx < 9; idx++)
+			{
+				mat(idx / 3, idx % 3) = m_mats[idx * Stride + i];
+			}
+			return mat;
+		}
+
+		Eigen::Matrix3d Rotation(unsigned int i) const
+		{
+			Eigen::Matrix3d rot;
+			for (unsigned int idx = 0; idx < 9; idx++)
+			{
+				rot(idx / 3, idx % 3) = m_rotations[idx * Stride + i];
+			}
+			return rot;
+		}
+
+		void Solve(bool keepsBases, bool warmStart)
+		{
+			RotationKernel::ExtractRotations(
+				m_mats.data(), Stride, NumMatrices, m_rotations.data(), keepsBases ? m_bases.data() : nullptr, warmStart);
+		}
+
+		/// <summary>
+		/// Largest element error from the reference rotations
+		/// </summary>
+		double MaxError() const
+		{
+			double maxError = 0.0;
+			for (unsigned int i = 0; i < NumMatrices; i++)
+			{
+				maxError = std::max(maxError, (Rotation(i) - ReferenceRotation(Get(i))).cwiseAbs().maxCoeff());
+			}
+			return maxError;
+		}
+
+		/// <summary>
+		/// Largest element error of R^t R from the identity and of det(R) from 1
+		/// </summary>
+		double MaxOrthogonalityError() const
+		{
+			double maxError = 0.0;
+			for (unsigned int i = 0; i < NumMatrices; i++)
+			{
+				const Eigen::Matrix3d rot = Rotation(i);
+				maxError = std::max(maxError, (rot.transpose() * rot - Eigen::Matrix3d::Identity()).cwiseAbs().maxCoeff());
+				maxError = std::max(maxError, std::abs(rot.determinant() - 1.0));
+			}
+			return maxError;
+		}
+
+	private:
+		std::vector<double> m_mats;
+		std::vector<double> m_rotations;
+		std::vector<double> m_bases;
+	};
+
+	/// <summary>
+	/// U * diag(singularValues) * V^t with random rotations U and V
+	/// </summary>
+	Eigen::Matrix3d FromSingularValues(Random& random, const Eigen::Vector3d& singularValues)
+	{
+		return random.Rotation() * singularValues.asDiagonal() * random.Rotation().transpose();
+	}
+
+	bool Report(const char* name, double error, double tolerance)
+	{
+		const bool isPassed = error <= tolerance;
+		std::printf("%-28s %12.2e %12.2e %6s\n", name, error, tolerance, isPassed ? "ok" : "FAILED");
+		return isPassed;
+	}
+}
+
+int main()
+{
+	Random random(Seed);
+	bool isPassed = true;
+
+	std::printf("%-28s %12s %12s %6s\n", "case", "max error", "tolerance", "");
+
+	// uniform random elements, about half of which are reflections
+	{
+		MatrixBatch batch;
+		for (unsigned int i = 0; i < NumMatrices; i++)
+		{
+			batch.Set(i, random.Matrix());
+		}
+
+		batch.Solve(false, false);
+		isPassed &= Report("random", batch.MaxError(), 1e-8);
+		isPassed &= Report("random orthogonality", batch.MaxOrthogonalityError(), 1e-12);
+	}
+
+	// det(A) < 0 with well separated singular values, so the flipped axis is unique
+	{
+		MatrixBatch batch;
+		for (unsigned int i = 0; i < NumMatrices; i++)
+		{
+			const double s0 = random.Uniform(1.0, 2.0);
+			const double s1 = random.Uniform(0.5, 0.9);
+			const double s2 = random.Uniform(0.1, 0.4);
+			batch.Set(i, FromSingularValues(random, Eigen::Vector3d(s0, s1, -s2)));
+		}
+
+		batch.Solve(true, false);
+		isPassed &= Report("reflection", batch.MaxError(), 1e-10);
+		isPassed &= Report("reflection orthogonality", batch.MaxOrthogonalityError(), 1e-12);
+	}
+
+	// 2nd singular value far below the 1st one, which the fast path reports as rank deficient and the general SVD solves
+	{
+		MatrixBatch batch;
+		for (unsigned int i = 0; i < NumMatrices; i++)
+		{
+			const double s0 = random.Uniform(0.5, 2.0);
+			const double s1 = s0 * random.Uniform(1e-7, 2e-7);
+			const double s2 = s0 * random.Uniform(1e-8, 5e-8) * (i % 2 == 0 ? 1.0 : -1.0);
+			batch.Set(i, FromSingularValues(random, Eigen::Vector3d(s0, s1, s2)));
+		}
+
+		// the closest rotation moves by about eps / (s1 + s2) relative to the perturbation
+		batch.Solve(true, false);
+		isPassed &= Report("rank deficient", batch.MaxError(), 1e-6);
+		isPassed &= Report("rank deficient orthogonality", batch.MaxOrthogonalityError(), 1e-12);
+	}
+
+	// exactly rank 2, which the fast path solves since u2 = u0 x u1 does not need the 3rd singular vector
+	{
+		MatrixBatch batch;
+		for (unsigned int i = 0; i < NumMatrices; i++)
+		{
+			batch.Set(i, FromSingularValues(random, Eigen::Vector3d(random.Uniform(1.0, 2.0), random.Uniform(0.1, 0.9), 0.0)));
+		}
+
+		batch.Solve(true, false);
+		isPassed &= Report("rank 2", batch.MaxError(), 1e-10);
+	}
+
+	// an animation: each frame perturbs the matrices slightly and starts from the bases of the previous frame.
+	// Every 10th matrix jumps to a new random one, on which the warm start mostly does not converge and the cold start is taken instead.
+	// The jumps it does accept are only as accurate as the convergence tolerance of the warm start
+	{
+		MatrixBatch batch;
+		for (unsigned int i = 0; i < NumMatrices; i++)
+		{
+			batch.Set(i, random.Matrix());
+		}
+		batch.Solve(true, false);
+
+		double maxError = 0.0;
+		double maxJumpError = 0.0;
+		for (unsigned int frame = 0; frame < NumWarmStartFrames; frame++)
+		{
+			for (unsigned int i = 0; i < NumMatrices; i++)
+			{
+				const bool isJump = i % 10 == frame % 10;
+				if (isJump)
+				{
+					batch.Set(i, random.Matrix());
+				}
+				else
+				{
+					const Eigen::Matrix3d mat = batch.Get(i);
+					batch.Set(i, mat + FrameDelta * mat.norm() * random.Matrix());
+				}
+			}
+
+			batch.Solve(true, true);
+			for (unsigned int i = 0; i < NumMatrices; i++)
+			{
+				const double error = (batch.Rotation(i) - ReferenceRotation(batch.Get(i))).cwiseAbs().maxCoeff();
+				double& target = i % 10 == frame % 10 ? maxJumpError : maxError;
+				target = std::max(target, error);
+			}
+		}
+
+		isPassed &= Report("warm start", maxError, 1e-8);
+		isPassed &= Report("warm start after a jump", maxJumpError, 1e-8);
+		isPassed &= Report("warm start orthogonality", batch.MaxOrthogonalityError(), 1e-12);
+	}
+
+	return isPassed ? 0 : 1;
+}
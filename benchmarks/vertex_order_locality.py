@@ -0,0 +1,104 @@
+"""
+Bind and per-frame timing of the internal vertex orders of DDM and Delta Mush.
+
+Run with mayapy after building the plugin:
+    mayapy benchmarks/vertex_order_locality.py <path to the plugin> [subdivisions ...]
+
+For each resolution, a sphere whose vertex ids are shuffled, as in meshes that went through
+many edits, is bound to a joint chain with 4 influences per vertex, converted to customSkinCluster,
+and evaluated with DM+LBS and DDM in each vertexOrder. The neighbours of a vertex are scattered
+over the whole arrays in the original order, so the smoothing and the Psi matrices miss the cache
+on almost every access, while the internal orders keep them a few vertices apart. The bind time is
+the evaluation that computes the order and rebuilds the data, and the frame time is the best of
+a few evaluations in different poses. The deviation from the original order is reported relative
+to the bounding box of the mesh, and should be at the rounding level.
+"""
+import random
+
+import common
+from common import cmds
+
+import maya.api.OpenMaya as om  # noqa: E402
+
+SMOOTH_AMOUNT = 0.5
+SMOOTH_ITERATION = 20
+SHUFFLE_SEED = 1
+
+# (name, customSkinningMethod)
+METHODS = [
+    ("DM+LBS", common.SKINNING_METHOD_DMLBS),
+    ("DDM", common.SKINNING_METHOD_DDM),
+]
+
+# (name, vertexOrder)
+ORDERS = [
+    ("original", 0),
+    ("rcm", 1),
+    ("morton", 2),
+]
+
+
+def build_shuffled_sphere(subdivisions):
+    sphere = cmds.polySphere(subdivisionsAxis=subdivisions, subdivisionsHeight=subdivisions, radius=1.0, constructionHistory=False)[0]
+
+    sel = om.MSelectionList()
+    sel.add(sphere)
+    fn = om.MFnMesh(sel.getDagPath(0))
+    points = fn.getPoints(om.MSpace.kObject)
+    counts, connects = fn.getVertices()
+
+    # vertex old of the sphere becomes vertex order[old] of the new mesh
+    order = list(range(len(points)))
+    random.Random(SHUFFLE_SEED).shuffle(order)
+    shuffled = om.MPointArray([om.MPoint() for _ in range(len(points))])
+    for old, new in enumerate(order):
+        shuffled[new] = points[old]
+
+    transform = om.MFnMesh().create(shuffled, counts, om.MIntArray([order[v] for v in connects]))
+    mesh = om.MFnDagNode(transform).partialPathName()
+    cmds.delete(sphere)
+    cmds.sets(mesh, edit=True, forceElement="initialShadingGroup")
+    return mesh
+
+
+def evaluate(mesh, joints, skcl, method, order):
+    cmds.setAttr(joints[-1] + ".rotateX", 0.0)
+    cmds.setAttr(skcl + ".customSkinningMethod", method)
+    cmds.setAttr(skcl + ".vertexOrder", order)
+    cmds.setAttr(skcl + ".needRebindMesh", True)
+
+    # the first evaluation computes the order and binds in it
+    bind = common.time_evaluation(skcl)
+
+    best = common.time_frames(skcl, joints)
+    return bind, best, common.get_positions(mesh)
+
+
+def main():
+    resolutions = common.load_plugin(__doc__, [40, 80, 160, 320])
+    if resolutions is None:
+        return 1
+
+    print("{:>10} {:>8} {:>10} {:>10} {:>10} {:>12}".format("vertices", "method", "order", "bind [s]", "frame [s]", "max dev"))
+    for subdivisions in resolutions:
+        mesh, joints, skcl = common.build_scene(
+            subdivisions, SMOOTH_AMOUNT, SMOOTH_ITERATION, bend=True, mesh_factory=build_shuffled_sphere)
+        cmds.setAttr(skcl + ".asyncPrecompute", False)
+        num_verts = cmds.polyEvaluate(mesh, vertex=True)
+
+        for method_name, method in METHODS:
+            original = None
+            for order_name, order in ORDERS:
+                bind, frame, positions = evaluate(mesh, joints, skcl, method, order)
+                if original is None:
+                    original = positions
+
+                deviation = max(common.relative_deviations(mesh, positions, original))
+                print("{:>10} {:>8} {:>10} {:>10.4f} {:>10.4f} {:>12.2e}".format(
+                    num_verts, method_name, order_name, bind, frame, deviation))
+
+    return 0
+
+
+if __name__ == "__main__":
+    common.run(main)
@@ -3,6 +3,7 @@ __kernel void skinLBS(
     __global const float* initialPos, // float3
     __global const float* weights,    // float
     __global const uint* influences,  // uint
+    __global const uint* offsets,     // uint, influences of vertex i are in [offsets[i], offsets[i+1])
     __global const float4* matrices,  // mat4x3
     const uint positionCount
     )
@@ -13,15 +14,14 @@ __kernel void skinLBS(
         return;
     }
 
-    // FIXME: this constant should be sent from host
-    const uint numInfluenceJoints = 2;
+    const uint weightBegin = offsets[positionId];
+    const uint weightEnd = offsets[positionId + 1];
 
     // compute skinning matrix (4x3 matrix)
     float4 skinMat[3];
     for (uint c = 0; c < 3; c++) {
         skinMat[c] = (float4)(0.0f);
-        for (uint wIdx = 0; wIdx < numInfluenceJoints; wIdx++) {
-            const uint weightIdx = positionId * numInfluenceJoints + wIdx;
+        for (uint weightIdx = weightBegin; weightIdx < weightEnd; weightIdx++) {
             skinMat[c] += weights[weightIdx] * matrices[influences[weightIdx] * 3 + c];
         }
     }